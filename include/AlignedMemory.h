@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PluginParameters_AlignedMemory_h__
+#define __PluginParameters_AlignedMemory_h__
+
+#include <stdlib.h>
+#include <new>
+#if WIN32
+#include <malloc.h>
+#endif
+
+namespace teragon {
+
+/**
+ * Allocates memory with a given alignment, for instance for objects which must
+ * occupy whole cache lines or arrays which are accessed with SIMD instructions.
+ */
+class AlignedMemory {
+public:
+    /**
+     * Allocate memory which must be freed with deallocate().
+     *
+     * @param size Number of bytes to allocate
+     * @param alignment Alignment in bytes, which must be a power of two and a
+     *                  multiple of sizeof(void *)
+     * @return The memory, never NULL. Throws std::bad_alloc on failure.
+     */
+    static void *allocate(size_t size, size_t alignment) {
+        void *memory = NULL;
+#if WIN32
+        memory = _aligned_malloc(size, alignment);
+#else
+        if(posix_memalign(&memory, alignment, size) != 0) {
+            memory = NULL;
+        }
+#endif
+        if(memory == NULL) {
+            throw std::bad_alloc();
+        }
+        return memory;
+    }
+
+    static void deallocate(void *memory) {
+#if WIN32
+        _aligned_free(memory);
+#else
+        free(memory);
+#endif
+    }
+};
+
+} // namespace teragon
+
+#endif // __PluginParameters_AlignedMemory_h__
@@ -28,62 +28,196 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include "BlobStore.h"
 #include "DataParameter.h"
 
 namespace teragon {
 
+/**
+ * Holds arbitrary binary data, such as an impulse response or a sample map.
+ *
+ * Large contents can be uploaded in chunks, for instance by a thread which
+ * loads them from disk. The chunks are written into a staging buffer which is
+ * owned by the parameter and invisible to readers, and commitUpload() then
+ * publishes the staging buffer without copying it. Only one thread may upload
+ * to a parameter at a time.
+ *
+ * Contents which are set with a copy are kept in the BlobStore, so identical
+ * blobs are only stored once, and setting a blob to its current contents has
+ * no effect.
+ */
 class BlobParameter : public DataParameter {
 public:
     BlobParameter(const ParameterString &inName, void *inData = NULL, size_t inDataSize = 0) :
-    DataParameter(inName),
-    data(NULL), dataSize(inDataSize) {
-        if(inData != NULL && inDataSize > 0) {
-            data = malloc(inDataSize);
-            memcpy(data, inData, inDataSize);
-        }
-    }
+    DataParameter(inName, BlobStore::share(inData, inDataSize)),
+    newestData(getBuffer() != NULL ? getBuffer()->getData() : NULL),
+    stagingData(NULL), stagingSize(0), stagingWritten(0) {}
 
     virtual ~BlobParameter() {
-        if(data != NULL) {
-            free(data);
-        }
+        cancelUpload();
+    }
+
+    virtual Parameter *clone() const {
+        return new BlobParameter(*this, copyBuffer(*this));
     }
 
     virtual const ParameterString getDisplayText() const {
-        return (data != NULL && dataSize > 0) ? "(Data)" : "(Null)";
+        return getBuffer() != NULL ? "(Data)" : "(Null)";
     }
 
     virtual void *getData() const {
-        return data;
+        const DataBuffer *current = getBuffer();
+        return current != NULL ? const_cast<char *>(current->getData()) : NULL;
     }
 
     virtual size_t getDataSize() const {
-        return dataSize;
+        const DataBuffer *current = getBuffer();
+        return current != NULL ? current->getSize() : 0;
     }
 
+    virtual DataBuffer *createBuffer(const void *inData, const size_t inDataSize) const {
+        return BlobStore::share(inData, inDataSize);
+    }
+
+    virtual bool hasSameContents(const DataBuffer *newBuffer) const {
+        // Shared contents are identical if and only if they have the same address
+        return newBuffer != NULL && newBuffer->getData() == newestData;
+    }
+
+    /**
+     * Start a new upload, discarding any upload which was not yet committed.
+     *
+     * @param totalSize Size of the new contents, in bytes
+     * @return True if the staging buffer was allocated
+     */
+    virtual bool beginUpload(const size_t totalSize) {
+        cancelUpload();
+        if(totalSize == 0) {
+            return false;
+        }
+        stagingData = reinterpret_cast<char *>(malloc(totalSize));
+        if(stagingData == NULL) {
+            return false;
+        }
+        stagingSize = totalSize;
+        return true;
+    }
+
+    /**
+     * Append a chunk of data to the current upload.
+     *
+     * @param chunk Data to append
+     * @param chunkSize Chunk size, in bytes
+     * @return Number of bytes which were written, which is less than the chunk
+     *         size if the upload would exceed the size given to beginUpload()
+     */
+    virtual size_t writeUpload(const void *chunk, const size_t chunkSize) {
+        if(stagingData == NULL || chunk == NULL) {
+            return 0;
+        }
+        const size_t written = stagingWritten;
+        const size_t numBytes = chunkSize < stagingSize - written ? chunkSize : stagingSize - written;
+        memcpy(stagingData + written, chunk, numBytes);
+        stagingWritten = written + numBytes;
+        return numBytes;
+    }
+
+    /**
+     * Discard the current upload, if any.
+     */
+    virtual void cancelUpload() {
+        free(takeUpload());
+    }
+
+    /**
+     * @return True if an upload has been started but not yet committed
+     */
+    bool isUploading() const {
+        return stagingSize > 0;
+    }
+
+    /**
+     * @return Fraction of the current upload which has been written, between
+     *         0.0 and 1.0. This method may be called from any thread.
+     */
+    double getUploadProgress() const {
+        const size_t total = stagingSize;
+        return total > 0 ? (double)stagingWritten / (double)total : 0.0;
+    }
 
 #if PLUGINPARAMETERS_MULTITHREADED
+    friend class ConcurrentParameterSet;
+
 protected:
 #endif
 
-    virtual void setValue(const void *inData, const size_t inDataSize) {
-        if(inData == NULL || inDataSize == 0) {
-            return;
+    /**
+     * Publish the data written by the current upload, without copying it.
+     *
+     * @return True if there was an upload to commit
+     */
+    virtual bool commitUpload() {
+        const size_t size = stagingWritten;
+        void *data = takeUpload();
+        if(data == NULL) {
+            return false;
         }
-        if(data != NULL) {
-            free(data);
+        adoptValue(data, size, DataBuffer::freeDeleter);
+        return true;
+    }
+
+protected:
+    /**
+     * Copy constructor for clone(). Any upload in progress is not copied.
+     */
+    BlobParameter(const BlobParameter &other, DataBuffer *inBuffer) :
+    DataParameter(other, inBuffer),
+    newestData(inBuffer != NULL ? inBuffer->getData() : NULL),
+    stagingData(NULL), stagingSize(0), stagingWritten(0) {}
+
+    virtual DataBuffer *exchangeBuffer(DataBuffer *newBuffer) {
+        // Setting an empty blob has no effect
+        if(newBuffer == NULL) {
+            return NULL;
         }
+#if !PLUGINPARAMETERS_MULTITHREADED
+        newestData = newBuffer->getData();
+#endif
+        return DataParameter::exchangeBuffer(newBuffer);
+    }
 
-        data = malloc(inDataSize);
-        dataSize = inDataSize;
-        memcpy(data, inData, inDataSize);
+#if PLUGINPARAMETERS_MULTITHREADED
+    virtual void onDataScheduled(const void *newData) {
+        // Setting an empty blob has no effect
+        if(newData != NULL) {
+            newestData = reinterpret_cast<const char *>(newData);
+        }
+    }
+#endif
 
-        notifyObservers();
+private:
+    // Releases ownership of the staging buffer, which the caller must free
+    void *takeUpload() {
+        void *result = stagingData;
+        stagingData = NULL;
+        stagingSize = 0;
+        stagingWritten = 0;
+        return result;
     }
 
 private:
-    void *data;
-    size_t dataSize;
+    // Data of the newest buffer which was set or, in multi-threaded builds,
+    // scheduled. Only compared by hasSameContents(), and never dereferenced.
+    const char *newestData;
+    char *stagingData;
+#if PLUGINPARAMETERS_MULTITHREADED
+    // Read by other threads to report progress
+    std::atomic<size_t> stagingSize;
+    std::atomic<size_t> stagingWritten;
+#else
+    size_t stagingSize;
+    size_t stagingWritten;
+#endif
 };
 
 } // namespace teragon
@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __PluginParameters_BlobStore_h__
+#define __PluginParameters_BlobStore_h__
+
+#include <map>
+#include "DataParameter.h"
+
+namespace teragon {
+
+/**
+ * Process-wide store of blob contents, which are identified by their hash so
+ * that identical contents are only kept in memory once, even when they are
+ * loaded by many parameters or plugin instances. Contents are immutable, and
+ * each change to a parameter refers to another entry in the store, so sharing
+ * contents is always safe.
+ *
+ * Hashing and copying is done by the thread which creates the buffer, and
+ * entries are freed when the last buffer referring to them is destroyed, which
+ * for ConcurrentParameterSet happens on the asynchronous thread.
+ */
+class BlobStore {
+public:
+    /**
+     * Get a buffer with the given contents, copying them into the store only
+     * if they are not already present.
+     *
+     * @param inData Data to share
+     * @param inDataSize Data size, in bytes
+     * @return New buffer, or NULL if there is no data. Buffers with the same
+     *         contents return the same pointer from DataBuffer::getData().
+     */
+    static DataBuffer *share(const void *inData, const size_t inDataSize) {
+        if(inData == NULL || inDataSize == 0) {
+            return NULL;
+        }
+        const unsigned long long hash = DataBuffer::computeHash(inData, inDataSize);
+
+        Store &store = getStore();
+        Entry *entry = NULL;
+        {
+#if PLUGINPARAMETERS_MULTITHREADED
+            tthread::lock_guard<tthread::mutex> guard(store.mutex);
+#endif
+            std::pair<EntryMap::iterator, EntryMap::iterator> range = store.entries.equal_range(hash);
+            for(EntryMap::iterator iterator = range.first; iterator != range.second; ++iterator) {
+                if(iterator->second->size == inDataSize &&
+                   memcmp(iterator->second->getData(), inData, inDataSize) == 0) {
+                    entry = iterator->second;
+                    break;
+                }
+            }
+            if(entry == NULL) {
+                entry = Entry::create(inData, inDataSize);
+                entry->position = store.entries.insert(std::make_pair(hash, entry));
+            }
+            entry->numReferences++;
+        }
+        return DataBuffer::adopt(entry->getData(), inDataSize, releaseDeleter, entry);
+    }
+
+    /**
+     * @return Number of distinct contents which are currently stored
+     */
+    static size_t getNumEntries() {
+        Store &store = getStore();
+#if PLUGINPARAMETERS_MULTITHREADED
+        tthread::lock_guard<tthread::mutex> guard(store.mutex);
+#endif
+        return store.entries.size();
+    }
+
+private:
+    class Entry;
+    typedef std::multimap<unsigned long long, Entry *> EntryMap;
+
+    // Contents are stored in the same allocation, directly after the entry
+    class Entry {
+    public:
+        static Entry *create(const void *inData, const size_t inDataSize) {
+            void *memory = malloc(getHeaderSize() + inDataSize + 1);
+            if(memory == NULL) {
+                throw std::bad_alloc();
+            }
+            Entry *result = new(memory) Entry(inDataSize);
+            memcpy(result->getData(), inData, inDataSize);
+            result->getData()[inDataSize] = '\0';
+            return result;
+        }
+
+        static void destroy(Entry *entry) {
+            entry->~Entry();
+            free(entry);
+        }
+
+        char *getData() {
+            return reinterpret_cast<char *>(this) + getHeaderSize();
+        }
+
+        const size_t size;
+        size_t numReferences;
+        EntryMap::iterator position;
+
+    private:
+        explicit Entry(size_t inSize) : size(inSize), numReferences(0), position() {}
+        ~Entry() {}
+
+        static size_t getHeaderSize() {
+            return ((sizeof(Entry) + kDataBufferAlignment - 1) / kDataBufferAlignment) * kDataBufferAlignment;
+        }
+    };
+
+    class Store {
+    public:
+        EntryMap entries;
+#if PLUGINPARAMETERS_MULTITHREADED
+        tthread::mutex mutex;
+#endif
+    };
+
+    static Store &getStore() {
+        // Never deleted, since parameters in other static objects may still
+        // release their contents while the process exits
+        static Store *store = new Store();
+        return *store;
+    }
+
+    static void releaseDeleter(void *inData, void *inContext) {
+        Entry *entry = reinterpret_cast<Entry *>(inContext);
+        Store &store = getStore();
+#if PLUGINPARAMETERS_MULTITHREADED
+        tthread::lock_guard<tthread::mutex> guard(store.mutex);
+#endif
+        if(--entry->numReferences == 0) {
+            store.entries.erase(entry->position);
+            Entry::destroy(entry);
+        }
+    }
+};
+
+} // namespace teragon
+
+#endif // __PluginParameters_BlobStore_h__
@@ -33,22 +33,22 @@ namespace teragon {
 class BooleanParameter : public Parameter {
 public:
     BooleanParameter(const ParameterString &inName, bool inDefaultValue = false) :
-    Parameter(inName), value(inDefaultValue) {}
+    Parameter(inName, 0.0, 1.0, inDefaultValue ? 1.0 : 0.0) {}
 
     virtual ~BooleanParameter() {}
 
+    virtual Parameter *clone() const {
+        return new BooleanParameter(*this);
+    }
+
     virtual const ParameterString getDisplayText() const {
-        return value ? "Enabled" : "Disabled";
+        return getValue() > 0.5 ? "Enabled" : "Disabled";
     }
 
     virtual const ParameterValue getScaledValue() const {
         return getValue();
     }
 
-    virtual const ParameterValue getValue() const {
-        return value ? 1.0 : 0.0;
-    }
-
 #if PLUGINPARAMETERS_MULTITHREADED
 protected:
 #endif
@@ -58,12 +58,8 @@ protected:
     }
 
     virtual void setValue(const ParameterValue inValue) {
-        value = inValue > 0.5 ? true : false;
-        Parameter::setValue(inValue);
+        Parameter::setValue(inValue > 0.5 ? 1.0 : 0.0);
     }
-
-private:
-    bool value;
 };
 
 } // namespace teragon
@@ -28,33 +28,13 @@
 
 #include "ParameterSet.h"
 #include "Parameter.h"
+#include "BlobParameter.h"
 #include "EventDispatcher.h"
+#include "EventDispatcherService.h"
+#include "EventExecutor.h"
 
 namespace teragon {
 
-#if PLUGINPARAMETERS_MULTITHREADED
-static void asyncDispatcherCallback(void *arg) {
-    EventDispatcher *dispatcher = reinterpret_cast<EventDispatcher *>(arg);
-    dispatcher->start();
-
-    while(!dispatcher->isKilled()) {
-        // WARNING: Deadlock can occur here
-        // If this thread is interrupted between these two lines, and the main thread
-        // exits (ie, the ConcurrentParameterSet is destroyed directly after creation),
-        // then the corresponding notify() call thrown by kill() will not be received.
-        // To avoid this problem, you should not destroy a ConcurrentParameterSet right
-        // after creating it.
-        dispatcher->wait();
-        // This thread can be notified both in case of an event callback or when the
-        // thread should join and exit. In the second case, we should not attempt to
-        // run process(), as bad things may happen.
-        if(!dispatcher->isKilled()) {
-            dispatcher->process();
-        }
-    }
-}
-#endif // PLUGINPARAMETERS_MULTITHREADED
-
 class ConcurrentParameterSet : public ParameterSet, public EventScheduler {
 #if PLUGINPARAMETERS_MULTITHREADED
 public:
@@ -66,23 +46,62 @@ public:
      * Simply using this class in place of ParameterSet does not guarantee
      * thread-safe code. See the top-level README for information and examples
      * regarding correct usage of this class.
+     *
+     * @param inExecutor Executor which delivers asynchronous events, which must
+     *                   outlive this parameter set. If NULL, then the set will
+     *                   create a dedicated thread (see ThreadEventExecutor).
+     *                   For example, a shared EventDispatcherService is
+     *                   recommended for plugins which may be instantiated many
+     *                   times in a single host session, and a
+     *                   ManualEventExecutor allows asynchronous observers to be
+     *                   called directly from the host's UI thread.
+     * @param inQueueOptions Capacity and overflow policy of the event queues
      */
-    explicit ConcurrentParameterSet() : ParameterSet(), EventScheduler(),
-    asyncDispatcher(this, false), realtimeDispatcher(this, true),
-    asyncDispatcherThread(asyncDispatcherCallback, &asyncDispatcher),
+    explicit ConcurrentParameterSet(EventExecutor *inExecutor = NULL,
+                                    const EventQueueOptions &inQueueOptions = EventQueueOptions()) :
+    ParameterSet(), EventScheduler(),
+    asyncDispatcher(this, false, inQueueOptions), realtimeDispatcher(this, true, inQueueOptions),
+    executor(inExecutor != NULL ? inExecutor : new ThreadEventExecutor()),
+    ownsExecutor(inExecutor == NULL),
     realtimeEventLoopPaused(false) {
-        asyncDispatcherThread.set_name("PluginParametersAsyncDispatcher");
-        asyncDispatcherThread.set_low_priority();
+        executor->attach(&asyncDispatcher);
+    }
 
-        // Wait for the async dispatcher thread to be fully started.
-        while(!asyncDispatcher.isStarted()) {
-            sleep(10);
+    virtual ~ConcurrentParameterSet() {
+        executor->detach(&asyncDispatcher);
+        if(ownsExecutor) {
+            delete executor;
         }
     }
 
-    virtual ~ConcurrentParameterSet() {
-        asyncDispatcher.kill();
-        asyncDispatcherThread.join();
+    /**
+     * Add a parameter to the set with normal priority.
+     *
+     * @param parameter Pointer to parameter instance
+     * @return parameter which was added if successful, NULL otherwise
+     */
+    virtual Parameter *add(Parameter *parameter) {
+        return add(parameter, kParameterPriorityNormal);
+    }
+
+    /**
+     * Add a parameter to the set. Changes to parameters with urgent priority
+     * are kept in a separate queue, which is drained before any other events.
+     * This way controls such as bypass or mute are applied during the next
+     * call to processRealtimeEvents(), regardless of how many other changes
+     * (for instance from a preset load) are still queued. Changes to a single
+     * parameter are always applied in order.
+     *
+     * @param parameter Pointer to parameter instance
+     * @param priority Priority for all changes made to this parameter
+     * @return parameter which was added if successful, NULL otherwise
+     */
+    virtual Parameter *add(Parameter *parameter, ParameterPriority priority) {
+        Parameter *result = ParameterSet::add(parameter);
+        if(result != NULL) {
+            result->priority = priority;
+        }
+        return result;
     }
 
     /**
@@ -93,6 +112,53 @@ public:
         realtimeDispatcher.process();
     }
 
+    /**
+     * Process events on the realtime dispatcher, but stop once a limit has been
+     * reached. Loading a preset or a burst of GUI activity can schedule
+     * thousands of events, so this can be used to bound the worst-case cost of
+     * a single audio block. Any remaining events stay queued in order, and will
+     * be processed first during the next call.
+     *
+     * @param maxEvents Maximum number of events to process
+     * @param budgetNanoseconds If non-zero, stop processing events once this
+     *                          much time has passed. The check is made after
+     *                          each event, so at least one event is processed.
+     * @return Approximate number of events which remain queued
+     */
+    virtual size_t processRealtimeEvents(size_t maxEvents, unsigned long long budgetNanoseconds = 0) {
+        const unsigned long long deadline = budgetNanoseconds > 0 ?
+                                            EventClock::now() + budgetNanoseconds : 0;
+        return realtimeDispatcher.process(maxEvents, deadline);
+    }
+
+    /**
+     * Process pending events on the asynchronous dispatcher, which will notify
+     * all non-realtime observers. This method should only be called when the
+     * set was created with a ManualEventExecutor, and always from the same
+     * thread. It never blocks, and returns immediately if nothing is pending.
+     */
+    virtual void processAsyncEvents() {
+        asyncDispatcher.process();
+    }
+
+    /**
+     * Get statistics about the delivery of asynchronous events, such as the
+     * number of wakeups per second and the average batch size. These can be
+     * used to tune the EventBatchingOptions of a ThreadEventExecutor.
+     */
+    EventDispatcherStatistics getAsyncStatistics() const {
+        return asyncDispatcher.getStatistics();
+    }
+
+    /**
+     * Get statistics about the processing of realtime events. In particular,
+     * EventDispatcherStatistics::numOverflows can be used to check whether the
+     * realtime queue capacity is large enough.
+     */
+    EventDispatcherStatistics getRealtimeStatistics() const {
+        return realtimeDispatcher.getStatistics();
+    }
+
     /**
      * Set a parameter's value. When PLUGINPARAMETERS_MULTITHREADED is set,
      * then this method must be used rather than Parameter::set(). The actual
@@ -109,13 +175,13 @@ public:
      *               will *not* receive notifications on the observer callback,
      *               since presumably this object is pushing state to other
      *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue
      */
-    virtual void set(const ParameterString &name, const ParameterValue value,
+    virtual bool set(const ParameterString &name, const ParameterValue value,
                      ParameterObserver *sender = NULL) {
         Parameter *parameter = get(name);
-        if(parameter != NULL) {
-            set(parameter, value, sender);
-        }
+        return parameter != NULL && set(parameter, value, sender);
     }
 
     /**
@@ -134,8 +200,10 @@ public:
      *               will *not* receive notifications on the observer callback,
      *               since presumably this object is pushing state to other
      *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue
      */
-    virtual void set(const size_t index, const ParameterValue value,
+    virtual bool set(const size_t index, const ParameterValue value,
                      ParameterObserver *sender = NULL) {
         return set(parameterList.at(index), value, sender);
     }
@@ -155,10 +223,36 @@ public:
      *               will *not* receive notifications on the observer callback,
      *               since presumably this object is pushing state to other
      *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue
      */
-    virtual void set(Parameter *parameter, const ParameterValue value,
+    virtual bool set(Parameter *parameter, const ParameterValue value,
                      ParameterObserver *sender = NULL) {
-        scheduleEvent(new Event(parameter, value, true, sender));
+        return scheduleOrDelete(new Event(parameter, value, true, sender));
+    }
+
+    /**
+     * Set the values of the first parameters in the set from an array, for
+     * instance when restoring a state which was saved with getValues(). The
+     * values are not checked, so states from untrusted sources should first
+     * be passed through a ParameterValidator.
+     *
+     * @param values New values, in the same order as the parameters
+     * @param numValues Number of values
+     * @param sender Sending object (can be NULL). If non-NULL, then this object
+     *               will *not* receive notifications on the observer callback.
+     * @return Number of changes which were scheduled
+     */
+    virtual size_t setValues(const ParameterValue *values, size_t numValues,
+                             ParameterObserver *sender = NULL) {
+        const size_t count = numValues < parameterList.size() ? numValues : parameterList.size();
+        size_t result = 0;
+        for(size_t i = 0; i < count; i++) {
+            if(set(parameterList[i], values[i], sender)) {
+                result++;
+            }
+        }
+        return result;
     }
 
     /**
@@ -177,13 +271,13 @@ public:
      *               will *not* receive notifications on the observer callback,
      *               since presumably this object is pushing state to other
      *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue
      */
-    virtual void setScaled(const ParameterString &name, const ParameterValue value,
+    virtual bool setScaled(const ParameterString &name, const ParameterValue value,
                            ParameterObserver *sender = NULL) {
         Parameter *parameter = get(name);
-        if(parameter != NULL) {
-            setScaled(parameter, value, sender);
-        }
+        return parameter != NULL && setScaled(parameter, value, sender);
     }
 
     /**
@@ -202,8 +296,10 @@ public:
      *               will *not* receive notifications on the observer callback,
      *               since presumably this object is pushing state to other
      *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue
      */
-    virtual void setScaled(const size_t index, const ParameterValue value,
+    virtual bool setScaled(const size_t index, const ParameterValue value,
                            ParameterObserver *sender = NULL) {
         return setScaled(parameterList.at(index), value, sender);
     }
@@ -223,10 +319,12 @@ public:
      *               will *not* receive notifications on the observer callback,
      *               since presumably this object is pushing state to other
      *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue
      */
-    virtual void setScaled(Parameter *parameter, const ParameterValue value,
+    virtual bool setScaled(Parameter *parameter, const ParameterValue value,
                            ParameterObserver *sender = NULL) {
-        scheduleEvent(new ScaledEvent(parameter, value, true, sender));
+        return scheduleOrDelete(new ScaledEvent(parameter, value, true, sender));
     }
 
     /**
@@ -246,13 +344,13 @@ public:
      *               will *not* receive notifications on the observer callback,
      *               since presumably this object is pushing state to other
      *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue
      */
-    virtual void setData(const ParameterString &name, const void *data,
+    virtual bool setData(const ParameterString &name, const void *data,
                          const size_t dataSize, ParameterObserver *sender = NULL) {
         Parameter *parameter = get(name);
-        if(parameter != NULL) {
-            setData(parameter, data, dataSize, sender);
-        }
+        return parameter != NULL && setData(parameter, data, dataSize, sender);
     }
 
     /**
@@ -272,8 +370,10 @@ public:
      *               will *not* receive notifications on the observer callback,
      *               since presumably this object is pushing state to other
      *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue
      */
-    virtual void setData(const size_t index, const void *data,
+    virtual bool setData(const size_t index, const void *data,
                          const size_t dataSize, ParameterObserver *sender = NULL) {
         return setData(parameterList.at(index), data, dataSize, sender);
     }
@@ -294,13 +394,319 @@ public:
      *               will *not* receive notifications on the observer callback,
      *               since presumably this object is pushing state to other
      *               observers.
+     * @return True if the change was scheduled or the parameter already holds
+     *         the same contents, false if the parameter was not found or the
+     *         event was rejected by a full queue
      */
-    virtual void setData(Parameter *parameter, const void *data,
+    virtual bool setData(Parameter *parameter, const void *data,
                          const size_t dataSize, ParameterObserver *sender = NULL) {
         DataParameter *dataParameter = dynamic_cast<DataParameter *>(parameter);
-        if(dataParameter != NULL) {
-            scheduleEvent(new DataEvent(dataParameter, data, dataSize, true, sender));
+        if(dataParameter == NULL) {
+            return false;
+        }
+        DataBuffer *buffer = dataParameter->createBuffer(data, dataSize);
+        if(dataParameter->hasSameContents(buffer)) {
+            // Nothing would change, so don't bother the realtime thread or observers
+            DataBuffer::destroy(buffer);
+            return true;
         }
+        return scheduleData(dataParameter, buffer, sender);
+    }
+
+    /**
+     * Set a data parameter's value without copying the data. This works like
+     * setData(), except that the parameter takes ownership of the data, which
+     * is freed with the given deleter once it has been replaced by newer data.
+     * The deleter is called on the asynchronous thread, or immediately if the
+     * change could not be scheduled.
+     *
+     * @param name Parameter name
+     * @param data New data value, which must remain valid until the deleter is
+     *             called
+     * @param dataSize Data size, in bytes
+     * @param deleter Function which frees the data, for example
+     *                DataBuffer::freeDeleter() for data allocated with malloc()
+     * @param context Passed to the deleter
+     * @param sender Sending object (can be NULL). If non-NULL, then this object
+     *               will *not* receive notifications on the observer callback,
+     *               since presumably this object is pushing state to other
+     *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue
+     */
+    virtual bool adoptData(const ParameterString &name, void *data, const size_t dataSize,
+                           DataBufferDeleter deleter, void *context = NULL,
+                           ParameterObserver *sender = NULL) {
+        return adoptData(get(name), data, dataSize, deleter, context, sender);
+    }
+
+    /**
+     * Set a data parameter's value without copying the data. This works like
+     * setData(), except that the parameter takes ownership of the data, which
+     * is freed with the given deleter once it has been replaced by newer data.
+     * The deleter is called on the asynchronous thread, or immediately if the
+     * change could not be scheduled.
+     *
+     * @param index Parameter index. No error checking is done here, you must
+     *              ensure that the index is valid.
+     * @param data New data value, which must remain valid until the deleter is
+     *             called
+     * @param dataSize Data size, in bytes
+     * @param deleter Function which frees the data, for example
+     *                DataBuffer::freeDeleter() for data allocated with malloc()
+     * @param context Passed to the deleter
+     * @param sender Sending object (can be NULL). If non-NULL, then this object
+     *               will *not* receive notifications on the observer callback,
+     *               since presumably this object is pushing state to other
+     *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue
+     */
+    virtual bool adoptData(const size_t index, void *data, const size_t dataSize,
+                           DataBufferDeleter deleter, void *context = NULL,
+                           ParameterObserver *sender = NULL) {
+        return adoptData(parameterList.at(index), data, dataSize, deleter, context, sender);
+    }
+
+    /**
+     * Set a data parameter's value without copying the data. This works like
+     * setData(), except that the parameter takes ownership of the data, which
+     * is freed with the given deleter once it has been replaced by newer data.
+     * The deleter is called on the asynchronous thread, or immediately if the
+     * change could not be scheduled.
+     *
+     * @param parameter Parameter
+     * @param data New data value, which must remain valid until the deleter is
+     *             called
+     * @param dataSize Data size, in bytes
+     * @param deleter Function which frees the data, for example
+     *                DataBuffer::freeDeleter() for data allocated with malloc()
+     * @param context Passed to the deleter
+     * @param sender Sending object (can be NULL). If non-NULL, then this object
+     *               will *not* receive notifications on the observer callback,
+     *               since presumably this object is pushing state to other
+     *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue
+     */
+    virtual bool adoptData(Parameter *parameter, void *data, const size_t dataSize,
+                           DataBufferDeleter deleter, void *context = NULL,
+                           ParameterObserver *sender = NULL) {
+        DataParameter *dataParameter = dynamic_cast<DataParameter *>(parameter);
+        DataBuffer *buffer = DataBuffer::adopt(data, dataSize, deleter, context);
+        if(dataParameter == NULL) {
+            DataBuffer::destroy(buffer);
+            return false;
+        }
+        return scheduleData(dataParameter, buffer, sender);
+    }
+
+    /**
+     * Change a parameter's value relative to its current value, for example in
+     * response to an endless encoder or a relative MIDI controller. The delta
+     * is added to the value on the realtime thread, so increments are not lost
+     * when the value is changed concurrently, and the result is clamped to the
+     * parameter's minimum and maximum values. Deltas which are made before the
+     * realtime thread has processed the pending change are summed, so that only
+     * a single event is queued for the parameter. In this case the sender of
+     * the first delta will be skipped for notifications.
+     *
+     * @param name Parameter name
+     * @param delta Amount to add to the value
+     * @param sender Sending object (can be NULL). If non-NULL, then this object
+     *               will *not* receive notifications on the observer callback,
+     *               since presumably this object is pushing state to other
+     *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue
+     */
+    virtual bool nudge(const ParameterString &name, const ParameterValue delta,
+                       ParameterObserver *sender = NULL) {
+        Parameter *parameter = get(name);
+        return parameter != NULL && nudge(parameter, delta, sender);
+    }
+
+    /**
+     * Change a parameter's value relative to its current value, for example in
+     * response to an endless encoder or a relative MIDI controller. The delta
+     * is added to the value on the realtime thread, so increments are not lost
+     * when the value is changed concurrently, and the result is clamped to the
+     * parameter's minimum and maximum values. Deltas which are made before the
+     * realtime thread has processed the pending change are summed, so that only
+     * a single event is queued for the parameter. In this case the sender of
+     * the first delta will be skipped for notifications.
+     *
+     * @param index Parameter index. No error checking is done here, you must
+     *              ensure that the index is valid.
+     * @param delta Amount to add to the value
+     * @param sender Sending object (can be NULL). If non-NULL, then this object
+     *               will *not* receive notifications on the observer callback,
+     *               since presumably this object is pushing state to other
+     *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue
+     */
+    virtual bool nudge(const size_t index, const ParameterValue delta,
+                       ParameterObserver *sender = NULL) {
+        return nudge(parameterList.at(index), delta, sender);
+    }
+
+    /**
+     * Change a parameter's value relative to its current value, for example in
+     * response to an endless encoder or a relative MIDI controller. The delta
+     * is added to the value on the realtime thread, so increments are not lost
+     * when the value is changed concurrently, and the result is clamped to the
+     * parameter's minimum and maximum values. Deltas which are made before the
+     * realtime thread has processed the pending change are summed, so that only
+     * a single event is queued for the parameter. In this case the sender of
+     * the first delta will be skipped for notifications.
+     *
+     * @param parameter Parameter
+     * @param delta Amount to add to the value
+     * @param sender Sending object (can be NULL). If non-NULL, then this object
+     *               will *not* receive notifications on the observer callback,
+     *               since presumably this object is pushing state to other
+     *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue
+     */
+    virtual bool nudge(Parameter *parameter, const ParameterValue delta,
+                       ParameterObserver *sender = NULL) {
+        addPendingDelta(parameter, delta);
+        if(parameter->state->deltaScheduled.exchange(true)) {
+            // The queued event will also apply this delta
+            return true;
+        }
+        else if(!scheduleOrDelete(new DeltaEvent(parameter, true, sender))) {
+            // Withdraw this delta, unless it has already been taken by an event
+            // which was being applied, or other deltas were added meanwhile.
+            parameter->state->deltaScheduled.store(false);
+            ParameterValue expected = delta;
+            if(parameter->state->pendingDelta.compare_exchange_strong(expected, 0.0)) {
+                return false;
+            }
+            else if(parameter->state->deltaScheduled.exchange(true)) {
+                // Another event has been scheduled, which will take the sum
+                return true;
+            }
+            // Callers which added their deltas while this event was being
+            // scheduled have already been told that the change was accepted, so
+            // the event must be queued even though the queue is full. There can
+            // only be one such event per parameter at any time.
+            return scheduleOrDelete(new DeltaEvent(parameter, true, sender), false);
+        }
+        return true;
+    }
+
+    /**
+     * Set a parameter's value only if it currently has an expected value. The
+     * comparison is made on the realtime thread when the event is processed, so
+     * it cannot race with other changes. If the comparison fails, then nothing
+     * happens and no observers are notified.
+     *
+     * @param name Parameter name
+     * @param expected Value which the parameter must have for the change to
+     *                 take effect. Note that the values are compared exactly.
+     * @param desired New value
+     * @param sender Sending object (can be NULL). If non-NULL, then this object
+     *               will *not* receive notifications on the observer callback,
+     *               since presumably this object is pushing state to other
+     *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue. Note that this
+     *         does not tell whether the comparison will succeed.
+     */
+    virtual bool compareAndSet(const ParameterString &name, const ParameterValue expected,
+                               const ParameterValue desired, ParameterObserver *sender = NULL) {
+        Parameter *parameter = get(name);
+        return parameter != NULL && compareAndSet(parameter, expected, desired, sender);
+    }
+
+    /**
+     * Set a parameter's value only if it currently has an expected value. The
+     * comparison is made on the realtime thread when the event is processed, so
+     * it cannot race with other changes. If the comparison fails, then nothing
+     * happens and no observers are notified.
+     *
+     * @param index Parameter index. No error checking is done here, you must
+     *              ensure that the index is valid.
+     * @param expected Value which the parameter must have for the change to
+     *                 take effect. Note that the values are compared exactly.
+     * @param desired New value
+     * @param sender Sending object (can be NULL). If non-NULL, then this object
+     *               will *not* receive notifications on the observer callback,
+     *               since presumably this object is pushing state to other
+     *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue. Note that this
+     *         does not tell whether the comparison will succeed.
+     */
+    virtual bool compareAndSet(const size_t index, const ParameterValue expected,
+                               const ParameterValue desired, ParameterObserver *sender = NULL) {
+        return compareAndSet(parameterList.at(index), expected, desired, sender);
+    }
+
+    /**
+     * Set a parameter's value only if it currently has an expected value. The
+     * comparison is made on the realtime thread when the event is processed, so
+     * it cannot race with other changes. If the comparison fails, then nothing
+     * happens and no observers are notified.
+     *
+     * @param parameter Parameter
+     * @param expected Value which the parameter must have for the change to
+     *                 take effect. Note that the values are compared exactly.
+     * @param desired New value
+     * @param sender Sending object (can be NULL). If non-NULL, then this object
+     *               will *not* receive notifications on the observer callback,
+     *               since presumably this object is pushing state to other
+     *               observers.
+     * @return True if the change was scheduled, false if the parameter was not
+     *         found or the event was rejected by a full queue. Note that this
+     *         does not tell whether the comparison will succeed.
+     */
+    virtual bool compareAndSet(Parameter *parameter, const ParameterValue expected,
+                               const ParameterValue desired, ParameterObserver *sender = NULL) {
+        return scheduleOrDelete(new CompareAndSetEvent(parameter, expected, desired, true, sender));
+    }
+
+    /**
+     * Append a chunk of data to an upload which was started with
+     * BlobParameter::beginUpload(), and report the progress to asynchronous
+     * observers, which may call BlobParameter::getUploadProgress(). This is
+     * intended to be called from a loader thread, and the realtime thread is
+     * not involved until the upload is committed.
+     *
+     * @param parameter Parameter being uploaded to
+     * @param chunk Data to append
+     * @param chunkSize Chunk size, in bytes
+     * @param sender Sending object (can be NULL). If non-NULL, then this object
+     *               will *not* receive progress notifications.
+     * @return Number of bytes which were written
+     */
+    virtual size_t writeUpload(BlobParameter *parameter, const void *chunk,
+                               const size_t chunkSize, ParameterObserver *sender = NULL) {
+        const size_t result = parameter->writeUpload(chunk, chunkSize);
+        if(result > 0) {
+            scheduleOrDelete(new ProgressEvent(parameter, sender));
+        }
+        return result;
+    }
+
+    /**
+     * Publish the data written by the current upload. The staging buffer is
+     * handed to the realtime thread without copying it, so that the new
+     * contents become visible with a single pointer swap.
+     *
+     * @param parameter Parameter being uploaded to
+     * @param sender Sending object (can be NULL). If non-NULL, then this object
+     *               will *not* receive notifications on the observer callback.
+     * @return True if the change was scheduled, false if there was no upload
+     *         to commit or the event was rejected by a full queue
+     */
+    virtual bool commitUpload(BlobParameter *parameter, ParameterObserver *sender = NULL) {
+        const size_t size = parameter->stagingWritten;
+        void *data = parameter->takeUpload();
+        return data != NULL && adoptData(parameter, data, size, DataBuffer::freeDeleter, NULL, sender);
     }
 
     /**
@@ -336,31 +742,61 @@ public:
     }
 
 protected:
-    virtual void scheduleEvent(Event *event) {
+    virtual bool scheduleEvent(Event *event) {
+        return scheduleEvent(event, true);
+    }
+
+    bool scheduleEvent(Event *event, bool mayReject) {
         if(!asyncDispatcher.isStarted()) {
-            return;
+            return false;
         }
         else if(asyncDispatcher.isKilled()) {
-            return;
+            return false;
         }
 
+        bool result;
         if(event->isRealtime) {
-            realtimeDispatcher.add(event);
+            result = realtimeDispatcher.add(event, mayReject);
         }
         else {
-            asyncDispatcher.add(event);
-            asyncDispatcher.notify();
+            result = asyncDispatcher.add(event);
+            executor->notify(&asyncDispatcher);
         }
 
         if(realtimeEventLoopPaused) {
             processRealtimeEvents();
         }
+        return result;
+    }
+
+    bool scheduleOrDelete(Event *event, bool mayReject = true) {
+        if(!scheduleEvent(event, mayReject)) {
+            delete event;
+            return false;
+        }
+        return true;
     }
 
 private:
+    bool scheduleData(DataParameter *parameter, DataBuffer *buffer, ParameterObserver *sender) {
+        // The buffer belongs to the event once it has been scheduled
+        const void *data = buffer != NULL ? buffer->getData() : NULL;
+        if(!scheduleOrDelete(new DataEvent(parameter, buffer, true, sender))) {
+            return false;
+        }
+        parameter->onDataScheduled(data);
+        return true;
+    }
+
+    static void addPendingDelta(Parameter *parameter, const ParameterValue delta) {
+        ParameterValue current = parameter->state->pendingDelta.load();
+        while(!parameter->state->pendingDelta.compare_exchange_weak(current, current + delta)) {}
+    }
+
     EventDispatcher asyncDispatcher;
     EventDispatcher realtimeDispatcher;
-    EventDispatcherThread asyncDispatcherThread;
+    EventExecutor *executor;
+    bool ownsExecutor;
     bool realtimeEventLoopPaused;
 
 #endif // PLUGINPARAMETERS_MULTITHREADED
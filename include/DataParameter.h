@@ -26,17 +26,273 @@
 #ifndef __PluginParameters_DataParameter_h__
 #define __PluginParameters_DataParameter_h__
 
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
 #include "Parameter.h"
 
 namespace teragon {
 
+// Payloads start at a multiple of this offset, which keeps them as well aligned
+// as memory returned by malloc()
+static const size_t kDataBufferAlignment = 16;
+// Small buffers are allocated in blocks of this size, which are recycled rather
+// than returned to the system
+static const size_t kDataBufferPoolBlockSize = 128;
+static const size_t kDataBufferMaxPooledBlocks = 256;
+
+/**
+ * Called when a DataBuffer which has adopted external data is destroyed.
+ *
+ * @param data Data which was passed to DataBuffer::adopt()
+ * @param context Context which was passed to DataBuffer::adopt()
+ */
+typedef void (*DataBufferDeleter)(void *data, void *context);
+
+/**
+ * Immutable block of data owned by a DataParameter. Copied payloads are always
+ * followed by a terminating null byte so that they may be read as a C string.
+ * Payloads which fit into kDataBufferPoolBlockSize are stored in recycled
+ * blocks, so that frequent updates of short strings do not reach the system
+ * allocator. Large payloads may also be adopted without copying them, in which
+ * case the buffer calls a deleter once it is destroyed.
+ *
+ * In multi-threaded builds, a new buffer is prepared by the thread which
+ * schedules a DataEvent. The realtime thread then publishes it by swapping a
+ * single pointer, and the retired buffer is kept by the event until it is
+ * deleted on the asynchronous dispatcher thread. This way no allocator calls
+ * are made on the realtime thread.
+ */
+class DataBuffer {
+public:
+    /**
+     * Allocate a new buffer and copy data into it.
+     *
+     * @param inData Data to copy
+     * @param inDataSize Data size, in bytes
+     * @return New buffer, or NULL if there is no data to copy
+     */
+    static DataBuffer *create(const void *inData, const size_t inDataSize) {
+        if(inData == NULL || inDataSize == 0) {
+            return NULL;
+        }
+        const size_t allocationSize = getHeaderSize() + inDataSize + 1;
+        const bool isPooled = allocationSize <= kDataBufferPoolBlockSize;
+        void *memory = isPooled ? acquireBlock() : allocate(allocationSize);
+        DataBuffer *result = new(memory) DataBuffer(reinterpret_cast<char *>(memory) + getHeaderSize(),
+                                                     inDataSize, isPooled, NULL, NULL);
+        memcpy(result->data, inData, inDataSize);
+        result->data[inDataSize] = '\0';
+        return result;
+    }
+
+    /**
+     * Create a buffer which takes ownership of existing data, without copying
+     * it. Note that adopted data is not null terminated.
+     *
+     * @param inData Data to adopt
+     * @param inDataSize Data size, in bytes
+     * @param inDeleter Function which frees the data, see freeDeleter()
+     * @param inContext Passed to the deleter
+     * @return New buffer, or NULL if there is no data to adopt. If the data
+     *         is empty, it is deleted immediately.
+     */
+    static DataBuffer *adopt(void *inData, const size_t inDataSize,
+                             DataBufferDeleter inDeleter, void *inContext = NULL) {
+        if(inData == NULL) {
+            return NULL;
+        }
+        if(inDataSize == 0) {
+            if(inDeleter != NULL) {
+                inDeleter(inData, inContext);
+            }
+            return NULL;
+        }
+        return new(acquireBlock()) DataBuffer(reinterpret_cast<char *>(inData), inDataSize,
+                                              true, inDeleter, inContext);
+    }
+
+    /**
+     * Free a buffer returned by create() or adopt(). Passing NULL is allowed.
+     */
+    static void destroy(DataBuffer *buffer) {
+        if(buffer != NULL) {
+            const bool isPooled = buffer->isPooled;
+            if(buffer->deleter != NULL) {
+                buffer->deleter(buffer->data, buffer->deleterContext);
+            }
+            buffer->~DataBuffer();
+            if(isPooled) {
+                releaseBlock(buffer);
+            }
+            else {
+                free(buffer);
+            }
+        }
+    }
+
+    /**
+     * Deleter for data which was allocated with malloc()
+     */
+    static void freeDeleter(void *inData, void *inContext) {
+        free(inData);
+    }
+
+    /**
+     * Calculate a 64-bit FNV-1a hash of a block of data. This hash is fast
+     * but not cryptographically secure, and is intended to identify contents
+     * which are stored or loaded elsewhere.
+     */
+    static unsigned long long computeHash(const void *inData, const size_t inDataSize) {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(inData);
+        unsigned long long result = 14695981039346656037ull;
+        for(size_t i = 0; i < inDataSize; ++i) {
+            result ^= bytes[i];
+            result *= 1099511628211ull;
+        }
+        return result;
+    }
+
+    /**
+     * @return Number of unused blocks which are kept for small buffers
+     */
+    static size_t getNumPooledBlocks() {
+        Pool &pool = getPool();
+#if PLUGINPARAMETERS_MULTITHREADED
+        tthread::lock_guard<tthread::mutex> guard(pool.mutex);
+#endif
+        return pool.blocks.size();
+    }
+
+    char *getData() {
+        return data;
+    }
+
+    const char *getData() const {
+        return data;
+    }
+
+    size_t getSize() const {
+        return size;
+    }
+
+    /**
+     * @return Deleter which was passed to adopt(), or NULL for copied data
+     */
+    DataBufferDeleter getDeleter() const {
+        return deleter;
+    }
+
+    /**
+     * @return Context which was passed to adopt(), or NULL for copied data
+     */
+    void *getDeleterContext() const {
+        return deleterContext;
+    }
+
+private:
+    DataBuffer(char *inData, size_t inSize, bool inIsPooled,
+               DataBufferDeleter inDeleter, void *inContext) :
+    data(inData), size(inSize), isPooled(inIsPooled), deleter(inDeleter), deleterContext(inContext) {}
+    ~DataBuffer() {}
+
+    static size_t getHeaderSize() {
+        return ((sizeof(DataBuffer) + kDataBufferAlignment - 1) / kDataBufferAlignment) * kDataBufferAlignment;
+    }
+
+    static void *allocate(size_t size) {
+        void *memory = malloc(size);
+        if(memory == NULL) {
+            throw std::bad_alloc();
+        }
+        return memory;
+    }
+
+    class Pool {
+    public:
+        Pool() : blocks() {
+            blocks.reserve(kDataBufferMaxPooledBlocks);
+        }
+
+        std::vector<void *> blocks;
+#if PLUGINPARAMETERS_MULTITHREADED
+        tthread::mutex mutex;
+#endif
+    };
+
+    static Pool &getPool() {
+        // Never deleted, since parameters in other static objects may still
+        // release their buffers while the process exits
+        static Pool *pool = new Pool();
+        return *pool;
+    }
+
+    static void *acquireBlock() {
+        Pool &pool = getPool();
+        {
+#if PLUGINPARAMETERS_MULTITHREADED
+            tthread::lock_guard<tthread::mutex> guard(pool.mutex);
+#endif
+            if(!pool.blocks.empty()) {
+                void *block = pool.blocks.back();
+                pool.blocks.pop_back();
+                return block;
+            }
+        }
+        return allocate(kDataBufferPoolBlockSize);
+    }
+
+    static void releaseBlock(void *block) {
+        Pool &pool = getPool();
+        {
+#if PLUGINPARAMETERS_MULTITHREADED
+            tthread::lock_guard<tthread::mutex> guard(pool.mutex);
+#endif
+            if(pool.blocks.size() < kDataBufferMaxPooledBlocks) {
+                pool.blocks.push_back(block);
+                return;
+            }
+        }
+        free(block);
+    }
+
+    // Disallow copy and assignment
+    DataBuffer(const DataBuffer &);
+    DataBuffer &operator = (const DataBuffer &);
+
+private:
+    char *const data;
+    const size_t size;
+    const bool isPooled;
+    const DataBufferDeleter deleter;
+    void *const deleterContext;
+};
+
+/**
+ * Contents of a file which were opened by DataParameter::openBackingFile(),
+ * in the form which is passed to DataParameter::adoptValue().
+ */
+class BackingFile {
+public:
+    BackingFile() : data(NULL), size(0), deleter(NULL), context(NULL) {}
+
+    void *data;
+    size_t size;
+    DataBufferDeleter deleter;
+    void *context;
+};
+
 /**
 * This class is intended for non-calculation data holders, such as strings or blobs.
 */
 class DataParameter : public Parameter {
 public:
-    DataParameter(const ParameterString &inName) : Parameter(inName, 0.0, 1.0, 0.0) {}
-    virtual ~DataParameter() {}
+    DataParameter(const ParameterString &inName, DataBuffer *inBuffer = NULL) :
+    Parameter(inName, 0.0, 1.0, 0.0), buffer(inBuffer) {}
+
+    virtual ~DataParameter() {
+        DataBuffer::destroy(buffer);
+    }
 
     virtual const ParameterValue getScaledValue() const {
         return 0.0;
@@ -46,14 +302,157 @@ public:
 
     virtual void setValue(const ParameterValue inValue) {}
 
+    /**
+     * Get the current contents. Unlike reading the data and its size through
+     * separate calls, this always returns a consistent pair. In multi-threaded
+     * builds, the buffer remains valid until the asynchronous thread has
+     * processed the event which replaces it.
+     *
+     * @return The current buffer, or NULL if the parameter holds no data
+     */
+    const DataBuffer *getBuffer() const {
+        return buffer;
+    }
+
+    /**
+     * Create a buffer holding the given data, in the form in which this
+     * parameter stores it. By default, the data is copied.
+     *
+     * @return New buffer, or NULL if there is no data
+     */
+    virtual DataBuffer *createBuffer(const void *inData, const size_t inDataSize) const {
+        return DataBuffer::create(inData, inDataSize);
+    }
+
+    /**
+     * Check if a buffer returned by createBuffer() holds the same contents as
+     * the parameter, in which case setting it would have no effect. In
+     * multi-threaded builds, the buffer is compared to the newest contents
+     * which have been scheduled rather than those which were applied, so this
+     * method may only be called from the thread which schedules changes. It
+     * may return false negatives.
+     */
+    virtual bool hasSameContents(const DataBuffer *newBuffer) const {
+        return false;
+    }
+
+    /**
+     * Get the file which backs the parameter's current contents, so that only
+     * a reference to it needs to be saved. This is overridden by parameters
+     * which support files, such as MappedBlobParameter, so that code which
+     * saves and restores state does not depend on how files are mapped.
+     *
+     * @param outPath Receives the path of the file
+     * @param outContentHash Receives the hash of the file's contents, see
+     *                       DataBuffer::computeHash()
+     * @return False if the contents are not backed by a file
+     */
+    virtual bool getBackingFile(ParameterString &outPath, unsigned long long &outContentHash) const {
+        return false;
+    }
+
+    /**
+     * Open a file which can back the parameter, see getBackingFile(). The
+     * contents are not applied, and must either be passed to adoptValue() or
+     * ConcurrentParameterSet::adoptData(), or released with their deleter.
+     *
+     * @param inPath Path of the file
+     * @param contentHash Expected hash of the file's contents, or 0 to skip
+     *                    this check
+     * @param result Receives the contents
+     * @return False if the file could not be opened, if its contents have
+     *         changed, or if the parameter does not support files
+     */
+    virtual bool openBackingFile(const ParameterString &inPath, unsigned long long contentHash,
+                                 BackingFile &result) const {
+        return false;
+    }
+
 #if PLUGINPARAMETERS_MULTITHREADED
     friend class Event;
     friend class DataEvent;
+    friend class ConcurrentParameterSet;
+
+protected:
+#endif
+
+#if PLUGINPARAMETERS_MULTITHREADED
+    /**
+     * Called by ConcurrentParameterSet once an event which will replace the
+     * parameter's data has been scheduled, so that hasSameContents() can
+     * compare against the newest contents.
+     *
+     * @param newData Data of the scheduled buffer, which must not be
+     *                dereferenced since it may be replaced at any time
+     */
+    virtual void onDataScheduled(const void *newData) {}
+#endif
+
+    virtual void setValue(const void *inData, const size_t inDataSize) {
+        DataBuffer *newBuffer = createBuffer(inData, inDataSize);
+        if(hasSameContents(newBuffer)) {
+            DataBuffer::destroy(newBuffer);
+            return;
+        }
+        DataBuffer::destroy(exchangeBuffer(newBuffer));
+    }
+
+    /**
+     * Set the parameter's data without copying it.
+     *
+     * @param inData Data to adopt, which is now owned by the parameter
+     * @param inDataSize Data size, in bytes
+     * @param inDeleter Function which frees the data once it is replaced
+     * @param inContext Passed to the deleter
+     */
+    virtual void adoptValue(void *inData, const size_t inDataSize,
+                            DataBufferDeleter inDeleter, void *inContext = NULL) {
+        DataBuffer::destroy(exchangeBuffer(DataBuffer::adopt(inData, inDataSize, inDeleter, inContext)));
+    }
 
 protected:
+    /**
+     * Copy constructor for clone(). Data parameters have no default value, so
+     * the copy holds the given buffer, which is usually a copy of the other
+     * parameter's contents.
+     */
+    DataParameter(const DataParameter &other, DataBuffer *inBuffer) :
+    Parameter(other), buffer(inBuffer) {}
+
+    /**
+     * @return A buffer with the same contents as the given parameter, created
+     *         with its createBuffer() method
+     */
+    static DataBuffer *copyBuffer(const DataParameter &other) {
+        const DataBuffer *current = other.getBuffer();
+        return current != NULL ? other.createBuffer(current->getData(), current->getSize()) : NULL;
+    }
+
+    /**
+     * Publish a new buffer and notify observers. This method does not allocate
+     * or free any memory, which is left to the caller.
+     *
+     * @param newBuffer Buffer to publish, which is now owned by the parameter
+     * @return The previous buffer, which must be destroyed by the caller once
+     *         no other thread may be reading from it
+     */
+    virtual DataBuffer *exchangeBuffer(DataBuffer *newBuffer) {
+#if PLUGINPARAMETERS_MULTITHREADED
+        DataBuffer *result = buffer.exchange(newBuffer);
+#else
+        DataBuffer *result = buffer;
+        buffer = newBuffer;
 #endif
+        notifyObservers();
+        return result;
+    }
 
-    virtual void setValue(const void *inData, const size_t inDataSize) = 0;
+private:
+#if PLUGINPARAMETERS_MULTITHREADED
+    std::atomic<DataBuffer *> buffer;
+#else
+    DataBuffer *buffer;
+#endif
 };
 
 } // namespace teragon
@@ -52,6 +52,10 @@ public:
 
     virtual ~DecibelParameter() {}
 
+    virtual Parameter *clone() const {
+        return new DecibelParameter(*this);
+    }
+
     virtual const ParameterString getDisplayText() const {
         std::stringstream numberFormatter;
         numberFormatter.precision(getDisplayPrecision());
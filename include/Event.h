@@ -36,7 +36,8 @@ class Event {
 public:
     Event(Parameter *p, const ParameterValue v,
           bool realtime = false, const ParameterObserver *s = NULL) :
-    parameter(p), value(v), isRealtime(realtime), sender(s) {}
+    parameter(p), value(v), isRealtime(realtime), sender(s), isDiscarded(false), next(NULL),
+    sequence(p != NULL ? p->state->nextSequence++ : 0) {}
 
     virtual ~Event() {}
 
@@ -44,10 +45,33 @@ public:
         parameter->setValue(value);
     }
 
+    /**
+     * @return True if this event changes the parameter relative to its current
+     *         value. Such events are never considered stale or superseded.
+     */
+    virtual bool isRelative() const {
+        return false;
+    }
+
+    /**
+     * @return True if this event only changes the parameter when some condition
+     *         holds at the time that it is applied. Such events never supersede
+     *         older events, since those may be needed for the condition.
+     */
+    virtual bool isConditional() const {
+        return false;
+    }
+
     Parameter *parameter;
     const ParameterValue value;
     bool isRealtime;
     const ParameterObserver *sender;
+    // Discarded events are neither applied nor sent to observers
+    bool isDiscarded;
+    // Used by the dispatcher's overflow list
+    Event *next;
+    // Order in which changes to the parameter were made
+    const unsigned long long sequence;
 
 private:
     // Disallow assignment operator
@@ -69,31 +93,112 @@ public:
     }
 };
 
+#if PLUGINPARAMETERS_MULTITHREADED
+class DeltaEvent : public Event {
+public:
+    DeltaEvent(Parameter *p, bool realtime = false, const ParameterObserver *s = NULL) :
+    Event(p, 0, realtime, s) {}
+
+    virtual ~DeltaEvent() {}
+
+    virtual void apply() {
+        // Clear the flag before taking the sum, so that any delta added after
+        // this point will schedule another event rather than being lost.
+        parameter->state->deltaScheduled.store(false);
+        ParameterValue result = parameter->getValue() + parameter->state->pendingDelta.exchange(0.0);
+        if(result < parameter->getMinValue()) {
+            result = parameter->getMinValue();
+        }
+        else if(result > parameter->getMaxValue()) {
+            result = parameter->getMaxValue();
+        }
+        parameter->setValue(result);
+    }
+
+    virtual bool isRelative() const {
+        return true;
+    }
+};
+
+class CompareAndSetEvent : public Event {
+public:
+    CompareAndSetEvent(Parameter *p, const ParameterValue expected, const ParameterValue v,
+                       bool realtime = false, const ParameterObserver *s = NULL) :
+    Event(p, v, realtime, s), expectedValue(expected) {}
+
+    virtual ~CompareAndSetEvent() {}
+
+    virtual void apply() {
+        if(parameter->getValue() == expectedValue) {
+            parameter->setValue(value);
+        }
+        else {
+            // Nothing has changed, so observers should not be notified
+            isDiscarded = true;
+        }
+    }
+
+    virtual bool isConditional() const {
+        return true;
+    }
+
+    const ParameterValue expectedValue;
+};
+
+/**
+ * Reports the progress of a BlobParameter upload to asynchronous observers.
+ * This event is never sent to the realtime thread, and does not change the
+ * parameter.
+ */
+class ProgressEvent : public Event {
+public:
+    ProgressEvent(Parameter *p, const ParameterObserver *s = NULL) :
+    Event(p, 0, false, s) {}
+
+    virtual ~ProgressEvent() {}
+
+    virtual void apply() {}
+};
+#endif
+
+/**
+ * Changes the data held by a DataParameter. The new buffer is allocated when
+ * the event is created, and apply() only swaps it with the parameter's current
+ * buffer. The retired buffer is then kept until the event is deleted, which
+ * happens on the asynchronous thread after all observers have been notified.
+ */
 class DataEvent : public Event {
 public:
     DataEvent(DataParameter *p, const void *inData, const size_t inDataSize,
               bool realtime = false, const ParameterObserver *s = NULL) :
     Event(dynamic_cast<Parameter *>(p), 0, realtime, s),
-    dataParameter(p), dataValue(NULL), dataSize(inDataSize) {
-        if(inDataSize > 0 && inData != NULL) {
-            dataValue = malloc(inDataSize);
-            memcpy(dataValue, inData, inDataSize);
-        }
-    }
+    dataParameter(p), dataBuffer(p->createBuffer(inData, inDataSize)), retiredBuffer(NULL) {}
+
+    /**
+     * @param p Parameter to change
+     * @param inBuffer New data, which is now owned by the event
+     */
+    DataEvent(DataParameter *p, DataBuffer *inBuffer,
+              bool realtime = false, const ParameterObserver *s = NULL) :
+    Event(dynamic_cast<Parameter *>(p), 0, realtime, s),
+    dataParameter(p), dataBuffer(inBuffer), retiredBuffer(NULL) {}
 
     virtual ~DataEvent() {
-        if(dataValue != NULL) {
-            free(dataValue);
-        }
+        DataBuffer::destroy(dataBuffer);
+        DataBuffer::destroy(retiredBuffer);
     }
 
     virtual void apply() {
-        dataParameter->setValue(dataValue, dataSize);
+        // The parameter takes ownership of the new buffer, and gives up the old one
+        retiredBuffer = dataParameter->exchangeBuffer(dataBuffer);
+        dataBuffer = NULL;
     }
 
     DataParameter *dataParameter;
-    void *dataValue;
-    const size_t dataSize;
+
+private:
+    DataBuffer *dataBuffer;
+    DataBuffer *retiredBuffer;
 };
 
 } // namespace teragon
@@ -28,8 +28,18 @@
 #define __PluginParameters_EventDispatcher_h__
 
 #if PLUGINPARAMETERS_MULTITHREADED
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include "readerwriterqueue/readerwriterqueue.h"
 #include "tinythread/source/tinythread.h"
+#if WIN32
+#include <windows.h>
+#elif MACOSX
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
 #endif
 
 #include "Event.h"
@@ -41,7 +51,143 @@ namespace teragon {
 typedef tthread::thread EventDispatcherThread;
 typedef tthread::lock_guard<tthread::mutex> EventDispatcherLockGuard;
 typedef tthread::mutex EventDispatcherMutex;
-typedef tthread::condition_variable EventDispatcherConditionVariable;
+// TinyThread++ has no timed waits, and this condition also works with its mutex
+typedef std::condition_variable_any EventDispatcherConditionVariable;
+
+/**
+ * Monotonic clock used for timing event processing.
+ */
+class EventClock {
+public:
+    /**
+     * @return Current time in nanoseconds, relative to an unspecified epoch
+     */
+    static unsigned long long now() {
+#if WIN32
+        LARGE_INTEGER counter, frequency;
+        QueryPerformanceCounter(&counter);
+        QueryPerformanceFrequency(&frequency);
+        return (unsigned long long)((double)counter.QuadPart * 1.0e9 / (double)frequency.QuadPart);
+#elif MACOSX
+        static mach_timebase_info_data_t timebase = {0, 0};
+        if(timebase.denom == 0) {
+            mach_timebase_info(&timebase);
+        }
+        return mach_absolute_time() * timebase.numer / timebase.denom;
+#else
+        struct timespec time;
+        clock_gettime(CLOCK_MONOTONIC, &time);
+        return (unsigned long long)time.tv_sec * 1000000000ull + (unsigned long long)time.tv_nsec;
+#endif
+    }
+};
+
+/**
+ * Wait on a condition until it is notified or the deadline has passed. The
+ * wakeup may also be spurious, so callers must check their state and the
+ * deadline again afterwards.
+ *
+ * @param condition Condition to wait on
+ * @param mutex Mutex which is locked by the calling thread
+ * @param deadline Time as returned by EventClock::now()
+ */
+static inline void waitForCondition(EventDispatcherConditionVariable &condition, EventDispatcherMutex &mutex,
+                                    unsigned long long deadline) {
+    const unsigned long long now = EventClock::now();
+    if(now < deadline) {
+        condition.wait_for(mutex, std::chrono::nanoseconds(deadline - now));
+    }
+}
+
+/**
+ * Snapshot of the statistics gathered by an EventDispatcher.
+ */
+class EventDispatcherStatistics {
+public:
+    EventDispatcherStatistics() : numWakeups(0), numBatches(0), numEvents(0),
+    maxBatchSize(0), numPriorityBoosts(0), numOverflows(0), numStaleEvents(0), elapsedSeconds(0.0) {}
+
+    /**
+     * @return Average number of times per second that the dispatcher was
+     *         asked to process events
+     */
+    double getWakeupsPerSecond() const {
+        return elapsedSeconds > 0.0 ? (double)numWakeups / elapsedSeconds : 0.0;
+    }
+
+    /**
+     * @return Average number of events processed in each non-empty batch
+     */
+    double getAverageBatchSize() const {
+        return numBatches > 0 ? (double)numEvents / (double)numBatches : 0.0;
+    }
+
+    /** Number of times that process() was called */
+    unsigned long numWakeups;
+    /** Number of process() calls which handled at least one event */
+    unsigned long numBatches;
+    /** Total number of events processed */
+    unsigned long numEvents;
+    /** Largest number of events handled by a single process() call */
+    unsigned long maxBatchSize;
+    /** Number of times the dispatching thread's priority was raised due to backlog */
+    unsigned long numPriorityBoosts;
+    /** Number of events which did not fit into the dispatcher's queue */
+    unsigned long numOverflows;
+    /** Number of events discarded because a newer change was already applied */
+    unsigned long numStaleEvents;
+    /** Time since the statistics were reset */
+    double elapsedSeconds;
+};
+
+/**
+ * Determines what happens when an event is added to a dispatcher whose queue
+ * is already full.
+ */
+typedef enum {
+    /**
+     * Keep the event on an overflow list, and when the list is processed, only
+     * deliver the newest event for each parameter.
+     */
+    kEventOverflowCoalesce,
+    /**
+     * Keep the event on an overflow list, and skip the notification of one of
+     * the oldest pending events instead. This policy only makes sense for
+     * asynchronous notifications, since skipping value changes would lose the
+     * parameter's state, so realtime dispatchers coalesce events instead.
+     */
+    kEventOverflowDropOldest,
+    /**
+     * Reject the event, so that ConcurrentParameterSet::set() returns false.
+     * Asynchronous dispatchers cannot reject events, since they are fed by the
+     * realtime thread, so they coalesce events instead.
+     */
+    kEventOverflowFail
+} EventOverflowPolicy;
+
+/**
+ * Queue configuration for the dispatchers of a ConcurrentParameterSet.
+ */
+class EventQueueOptions {
+public:
+    /**
+     * @param inCapacity Number of events which each dispatcher's queue can hold.
+     *                   Storage for these events is allocated up front, so
+     *                   adding events never allocates memory.
+     * @param inOverflowPolicy What to do with events when the queue is full
+     * @param inUrgentCapacity Number of events which each dispatcher's queue for
+     *                         parameters added with kParameterPriorityUrgent
+     *                         can hold
+     */
+    EventQueueOptions(size_t inCapacity = 1024,
+                      EventOverflowPolicy inOverflowPolicy = kEventOverflowCoalesce,
+                      size_t inUrgentCapacity = 64) :
+    capacity(inCapacity), overflowPolicy(inOverflowPolicy), urgentCapacity(inUrgentCapacity) {}
+
+    size_t capacity;
+    EventOverflowPolicy overflowPolicy;
+    size_t urgentCapacity;
+};
 #endif
 
 class EventScheduler {
@@ -49,53 +195,165 @@ public:
     EventScheduler() {}
     virtual ~EventScheduler() {}
 
-    virtual void scheduleEvent(Event *event) = 0;
+    /**
+     * @return True if the event was scheduled, false if it was rejected. In
+     *         the latter case, the caller still owns the event.
+     */
+    virtual bool scheduleEvent(Event *event) = 0;
 };
 
 class EventDispatcher {
 #if PLUGINPARAMETERS_MULTITHREADED
+    friend class EventDispatcherService;
+
 public:
-    EventDispatcher(EventScheduler *s, bool realtime) :
-    eventQueue(), scheduler(s), isRealtime(realtime), started(false), killed(false) {}
+    EventDispatcher(EventScheduler *s, bool realtime,
+                    const EventQueueOptions &options = EventQueueOptions()) :
+    urgentLane(options.urgentCapacity), normalLane(options.capacity), coalesceGeneration(0),
+    overflowPolicy(getEffectivePolicy(options.overflowPolicy, realtime)),
+    scheduler(s), isRealtime(realtime), started(false), killed(false),
+    numPendingEvents(0), numWakeups(0), numBatches(0), numEvents(0), maxBatchSize(0),
+    numPriorityBoosts(0), numOverflows(0), numStaleEvents(0), statisticsStartTime(EventClock::now()),
+    serviceShard(0), serviceNext(NULL), serviceScheduled(false), serviceProcessing(false) {}
+
+    virtual ~EventDispatcher() {
+        Event *event = NULL;
+        while((event = takeEvent(urgentLane)) != NULL) {
+            delete event;
+        }
+        while((event = takeEvent(normalLane)) != NULL) {
+            delete event;
+        }
+    }
+
+    /**
+     * Add an event to the dispatcher. This method never allocates memory, so it
+     * is safe to call from the realtime thread. Events for parameters which were
+     * added with kParameterPriorityUrgent are placed in a separate queue, which
+     * is always drained before the queue for all other events.
+     *
+     * @param event Event to add
+     * @param mayReject If false, then the event is placed on the overflow list
+     *                  even if the overflow policy would reject it
+     * @return False if the queue was full and the event was rejected, in which
+     *         case the caller still owns the event
+     */
+    bool add(Event *event, bool mayReject = true) {
+        EventLane &lane = getLane(event);
 
-    virtual ~EventDispatcher() {}
+        // The counter must be incremented before the event is published, since
+        // the consumer may otherwise take the event and decrement it first.
+        numPendingEvents++;
 
-    void add(Event *event) {
-        eventQueue.enqueue(event);
+        // Once events have overflowed, all newer events must also go to the
+        // overflow list until it has been processed, or they would overtake the
+        // older events.
+        if(lane.overflowHead.load() == NULL && lane.queue.try_enqueue(event)) {
+            return true;
+        }
+
+        numOverflows++;
+        if(overflowPolicy == kEventOverflowFail && mayReject) {
+            numPendingEvents--;
+            return false;
+        }
+        else if(overflowPolicy == kEventOverflowDropOldest) {
+            lane.numEventsToDrop++;
+        }
+
+        Event *head = lane.overflowHead.load();
+        do {
+            event->next = head;
+        } while(!lane.overflowHead.compare_exchange_weak(head, event));
+        return true;
     }
 
-    void process() {
-        Event *event = NULL;
-        while(eventQueue.try_dequeue(event)) {
-            if(event != NULL) {
-                // Only execute parameter changes on the realtime thread
-                if(isRealtime) {
-                    event->apply();
-                }
+    /**
+     * @return Approximate number of events waiting to be processed
+     */
+    size_t getNumPendingEvents() const {
+        return numPendingEvents.load();
+    }
 
-                // Notify all observers of the same type
-                for(size_t i = 0; i < event->parameter->getNumObservers(); ++i) {
-                    ParameterObserver *observer = event->parameter->getObserver(i);
-                    if(observer != NULL &&
-                        observer->isRealtimePriority() == isRealtime &&
-                        observer != event->sender) {
-                        observer->onParameterUpdated(event->parameter);
-                    }
-                }
+    /**
+     * Process pending events, optionally stopping early so that the cost of a
+     * single call can be bounded. Events which are not processed stay queued in
+     * order, and will be processed first during the next call. Urgent events
+     * are always processed before any others, including urgent events which
+     * arrive while this method is running.
+     *
+     * @param maxEvents Maximum number of events to process
+     * @param deadline If non-zero, stop processing once EventClock::now() has
+     *                 reached this time. At least one event is always processed,
+     *                 so that the dispatcher makes progress even for very short
+     *                 deadlines.
+     * @return Approximate number of events which are still pending
+     */
+    size_t process(size_t maxEvents = (size_t)-1, unsigned long long deadline = 0) {
+        unsigned long batchSize = 0;
+        while(batchSize < maxEvents) {
+            if(deadline > 0 && batchSize > 0 && EventClock::now() >= deadline) {
+                break;
+            }
 
-                if(isRealtime) {
-                    // Re-dispatch the event to the async thread
-                    event->isRealtime = false;
-                    scheduler->scheduleEvent(event);
-                }
-                else {
-                    // If this is the async thread, then all observers know about the
-                    // parameter change and this event can be deleted.
-                    delete event;
+            Event *event = takeEvent(urgentLane);
+            if(event == NULL) {
+                event = takeEvent(normalLane);
+                if(event == NULL) {
+                    break;
                 }
             }
-            event = NULL;
+
+            numPendingEvents--;
+            batchSize++;
+            dispatch(event);
         }
+
+        numWakeups++;
+        if(batchSize > 0) {
+            numBatches++;
+            numEvents += batchSize;
+            if(batchSize > maxBatchSize) {
+                maxBatchSize = batchSize;
+            }
+        }
+        return numPendingEvents.load();
+    }
+
+    /**
+     * Should be called by executors when they raise the priority of the thread
+     * processing this dispatcher's events.
+     */
+    void recordPriorityBoost() {
+        numPriorityBoosts++;
+    }
+
+    /**
+     * @return Statistics gathered since construction or the last call to
+     *         resetStatistics()
+     */
+    EventDispatcherStatistics getStatistics() const {
+        EventDispatcherStatistics result;
+        result.numWakeups = numWakeups.load();
+        result.numBatches = numBatches.load();
+        result.numEvents = numEvents.load();
+        result.maxBatchSize = maxBatchSize.load();
+        result.numPriorityBoosts = numPriorityBoosts.load();
+        result.numOverflows = numOverflows.load();
+        result.numStaleEvents = numStaleEvents.load();
+        result.elapsedSeconds = (double)(EventClock::now() - statisticsStartTime.load()) / 1.0e9;
+        return result;
+    }
+
+    void resetStatistics() {
+        numWakeups = 0;
+        numBatches = 0;
+        numEvents = 0;
+        maxBatchSize = 0;
+        numPriorityBoosts = 0;
+        numOverflows = 0;
+        numStaleEvents = 0;
+        statisticsStartTime = EventClock::now();
     }
 
     volatile bool isStarted() const {
@@ -112,27 +370,233 @@ public:
 
     void kill() {
         killed = true;
-        notify();
+        // Notify under the lock, so that the notification cannot get lost
+        // between the checks in wait() and the wait itself
+        EventDispatcherLockGuard guard(mutex);
+        waitLock.notify_all();
     }
 
+    /**
+     * Wake up the thread waiting for events. This may be called on the
+     * realtime thread, so it does not take the lock.
+     */
     void notify() {
         waitLock.notify_all();
     }
 
+    /**
+     * Wait until notified, unless events are pending or the dispatcher has
+     * been killed.
+     */
     void wait() {
-        waitLock.wait(mutex);
+        EventDispatcherLockGuard guard(mutex);
+        if(!killed && getNumPendingEvents() == 0) {
+            waitLock.wait(mutex);
+        }
+    }
+
+    /**
+     * Wait until at least the given number of events are pending, the
+     * dispatcher has been killed or the deadline has passed.
+     *
+     * @param batchSize Number of pending events to wait for
+     * @param deadline Time as returned by EventClock::now()
+     */
+    void waitForEvents(size_t batchSize, unsigned long long deadline) {
+        EventDispatcherLockGuard guard(mutex);
+        while(!killed && getNumPendingEvents() < batchSize && EventClock::now() < deadline) {
+            waitForCondition(waitLock, mutex, deadline);
+        }
     }
 
 private:
-    tthread::condition_variable waitLock;
+    /**
+     * Events for parameters of the same priority. Each lane has its own queue
+     * and overflow list, so events are only reordered relative to events for
+     * parameters with a different priority.
+     */
+    class EventLane {
+    public:
+        explicit EventLane(size_t capacity) :
+        queue(capacity), overflowHead(NULL), backlogHead(NULL), numEventsToDrop(0) {}
+
+        moodycamel::ReaderWriterQueue<Event *> queue;
+        std::atomic<Event *> overflowHead;
+        // Overflowed events which were not processed yet, oldest first. This
+        // list is only accessed by the thread processing events.
+        Event *backlogHead;
+        std::atomic<size_t> numEventsToDrop;
+    };
+
+    static EventOverflowPolicy getEffectivePolicy(EventOverflowPolicy policy, bool realtime) {
+        if(realtime && policy == kEventOverflowDropOldest) {
+            return kEventOverflowCoalesce;
+        }
+        else if(!realtime && policy == kEventOverflowFail) {
+            return kEventOverflowCoalesce;
+        }
+        return policy;
+    }
+
+    EventLane &getLane(const Event *event) {
+        return event->parameter->priority == kParameterPriorityUrgent ? urgentLane : normalLane;
+    }
+
+    /**
+     * Remove the oldest event from a lane. Events left over from the overflow
+     * list are the oldest, followed by the queue, and finally any events which
+     * have overflowed since.
+     *
+     * @return The event, or NULL if the lane is empty
+     */
+    Event *takeEvent(EventLane &lane) {
+        while(true) {
+            Event *event = lane.backlogHead;
+            if(event != NULL) {
+                lane.backlogHead = event->next;
+                event->next = NULL;
+                return event;
+            }
+            else if(lane.queue.try_dequeue(event)) {
+                return event;
+            }
+            else if(!takeOverflowedEvents(lane)) {
+                return NULL;
+            }
+        }
+    }
+
+    /**
+     * Move all events from a lane's overflow list to its backlog.
+     *
+     * @return False if there were no overflowed events
+     */
+    bool takeOverflowedEvents(EventLane &lane) {
+        if(lane.overflowHead.load() == NULL) {
+            return false;
+        }
+        Event *event = lane.overflowHead.exchange(NULL);
+
+        if(overflowPolicy == kEventOverflowCoalesce) {
+            markSupersededEvents(event);
+        }
+
+        // The list is ordered newest first, so reverse it before processing
+        Event *ordered = NULL;
+        while(event != NULL) {
+            Event *next = event->next;
+            event->next = ordered;
+            ordered = event;
+            event = next;
+        }
+        lane.backlogHead = ordered;
+        return true;
+    }
+
+    /**
+     * Mark all events in a newest-first list which are followed by a newer event
+     * for the same parameter, so that only the newest one is delivered.
+     */
+    void markSupersededEvents(Event *newest) {
+        const int markIndex = isRealtime ? 1 : 0;
+        coalesceGeneration++;
+        for(Event *event = newest; event != NULL; event = event->next) {
+            // Relative changes must all be applied, and do not replace older ones.
+            // Conditional changes may not take effect, so they cannot either.
+            if(event->isDiscarded || event->isRelative() || event->isConditional()) {
+                continue;
+            }
+            unsigned long &mark = event->parameter->state->coalesceMarks[markIndex];
+            if(mark == coalesceGeneration) {
+                event->isDiscarded = true;
+            }
+            else {
+                mark = coalesceGeneration;
+            }
+        }
+    }
+
+    void dispatch(Event *event) {
+        EventLane &lane = getLane(event);
+        if(lane.numEventsToDrop.load() > 0 && !event->isDiscarded) {
+            lane.numEventsToDrop--;
+            event->isDiscarded = true;
+        }
+
+        // Events from different threads may arrive out of order, in which case
+        // applying an older event would overwrite a newer value.
+        if(isRealtime && !event->isDiscarded) {
+            // Relative changes are applied to the current value regardless.
+            if(event->sequence >= event->parameter->state->appliedSequence) {
+                event->parameter->state->appliedSequence = event->sequence;
+            }
+            else if(!event->isRelative()) {
+                numStaleEvents++;
+                event->isDiscarded = true;
+            }
+        }
+
+        // Only execute parameter changes on the realtime thread. Applying an
+        // event may also discard it, for instance if a compare-and-set fails.
+        if(isRealtime && !event->isDiscarded) {
+            event->apply();
+        }
+
+        if(!event->isDiscarded) {
+            // Notify all observers of the same type
+            for(size_t i = 0; i < event->parameter->getNumObservers(); ++i) {
+                ParameterObserver *observer = event->parameter->getObserver(i);
+                if(observer != NULL &&
+                    observer->isRealtimePriority() == isRealtime &&
+                    observer != event->sender) {
+                    observer->onParameterUpdated(event->parameter);
+                }
+            }
+        }
+
+        if(isRealtime) {
+            // Re-dispatch the event to the async thread. Discarded events are also
+            // sent there, since they must not be deleted on the realtime thread.
+            event->isRealtime = false;
+            if(!scheduler->scheduleEvent(event)) {
+                delete event;
+            }
+        }
+        else {
+            // If this is the async thread, then all observers know about the
+            // parameter change and this event can be deleted.
+            delete event;
+        }
+    }
+
+    EventDispatcherConditionVariable waitLock;
     EventDispatcherMutex mutex;
-    moodycamel::ReaderWriterQueue<Event *> eventQueue;
+    EventLane urgentLane;
+    EventLane normalLane;
+    unsigned long coalesceGeneration;
+    const EventOverflowPolicy overflowPolicy;
 
     EventScheduler *scheduler;
     const bool isRealtime;
     volatile bool started;
     volatile bool killed;
 
+    std::atomic<size_t> numPendingEvents;
+    std::atomic<unsigned long> numWakeups;
+    std::atomic<unsigned long> numBatches;
+    std::atomic<unsigned long> numEvents;
+    std::atomic<unsigned long> maxBatchSize;
+    std::atomic<unsigned long> numPriorityBoosts;
+    std::atomic<unsigned long> numOverflows;
+    std::atomic<unsigned long> numStaleEvents;
+    std::atomic<unsigned long long> statisticsStartTime;
+
+    // Bookkeeping for dispatchers which are drained by an EventDispatcherService
+    size_t serviceShard;
+    EventDispatcher *serviceNext;
+    std::atomic<bool> serviceScheduled;
+    std::atomic<bool> serviceProcessing;
+
 #endif // PLUGINPARAMETERS_MULTITHREADED
 };
 
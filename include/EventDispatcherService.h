@@ -0,0 +1,305 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PluginParameters_EventDispatcherService_h__
+#define __PluginParameters_EventDispatcherService_h__
+
+#include <vector>
+#include "EventDispatcher.h"
+#include "EventExecutor.h"
+
+#if PLUGINPARAMETERS_MULTITHREADED
+#if WIN32
+#include <limits.h>
+#include <windows.h>
+#elif MACOSX
+#include <dispatch/dispatch.h>
+#else
+#include <errno.h>
+#include <semaphore.h>
+#endif
+#endif
+
+namespace teragon {
+
+#if PLUGINPARAMETERS_MULTITHREADED
+/**
+ * Counting semaphore used to wake the workers of an EventDispatcherService.
+ * Unlike signaling a condition variable, posting to the semaphore never takes
+ * a lock, so it is safe to do from the realtime thread.
+ */
+class EventSemaphore {
+public:
+    EventSemaphore() {
+#if WIN32
+        handle = CreateSemaphoreA(NULL, 0, LONG_MAX, NULL);
+#elif MACOSX
+        semaphore = dispatch_semaphore_create(0);
+#else
+        sem_init(&semaphore, 0, 0);
+#endif
+    }
+
+    virtual ~EventSemaphore() {
+#if WIN32
+        CloseHandle(handle);
+#elif MACOSX
+        dispatch_release(semaphore);
+#else
+        sem_destroy(&semaphore);
+#endif
+    }
+
+    void post() {
+#if WIN32
+        ReleaseSemaphore(handle, 1, NULL);
+#elif MACOSX
+        dispatch_semaphore_signal(semaphore);
+#else
+        sem_post(&semaphore);
+#endif
+    }
+
+    void wait() {
+#if WIN32
+        WaitForSingleObject(handle, INFINITE);
+#elif MACOSX
+        dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+#else
+        while(sem_wait(&semaphore) != 0 && errno == EINTR) {}
+#endif
+    }
+
+private:
+    // Disallow copy and assignment
+    EventSemaphore(const EventSemaphore &);
+    EventSemaphore &operator = (const EventSemaphore &);
+
+private:
+#if WIN32
+    HANDLE handle;
+#elif MACOSX
+    dispatch_semaphore_t semaphore;
+#else
+    sem_t semaphore;
+#endif
+};
+
+/**
+ * A small pool of worker threads which drains the asynchronous queues of many
+ * ConcurrentParameterSet instances. Without this service, each parameter set
+ * owns a dedicated dispatcher thread, so a host session with hundreds of
+ * plugin instances will also have hundreds of mostly idle threads.
+ *
+ * Each dispatcher which is attached to the service is assigned to exactly one
+ * worker (a "shard"), which guarantees that events for a given parameter set
+ * are always delivered in order and never concurrently. Dispatchers are
+ * spread across the shards so that the number of threads follows the number
+ * of cores rather than the number of plugin instances.
+ */
+class EventDispatcherService : public EventExecutor {
+public:
+    /**
+     * Create a new dispatcher service.
+     *
+     * @param numThreads Number of worker threads. If 0, then one worker per
+     *                   hardware thread will be created.
+     */
+    explicit EventDispatcherService(size_t numThreads = 0) : EventExecutor(), shards() {
+        if(numThreads == 0) {
+            numThreads = EventDispatcherThread::hardware_concurrency();
+        }
+        if(numThreads == 0) {
+            numThreads = 1;
+        }
+
+        for(size_t i = 0; i < numThreads; ++i) {
+            shards.push_back(new Shard());
+        }
+        for(size_t i = 0; i < shards.size(); ++i) {
+            Shard *shard = shards.at(i);
+            shard->thread = new EventDispatcherThread(shardCallback, shard);
+            shard->thread->set_name("PluginParametersDispatcherService");
+            shard->thread->set_low_priority();
+        }
+    }
+
+    virtual ~EventDispatcherService() {
+        for(size_t i = 0; i < shards.size(); ++i) {
+            Shard *shard = shards.at(i);
+            shard->killed.store(true);
+            shard->semaphore.post();
+            shard->thread->join();
+            delete shard->thread;
+            delete shard;
+        }
+        shards.clear();
+    }
+
+    /**
+     * Get the process-wide dispatcher service. It is created upon first use,
+     * and its threads are stopped when the process exits.
+     */
+    static EventDispatcherService &getDefault() {
+        static EventDispatcherService defaultService;
+        return defaultService;
+    }
+
+    /**
+     * @return Number of worker threads owned by this service
+     */
+    size_t getNumThreads() const {
+        return shards.size();
+    }
+
+    /**
+     * Attach a dispatcher to the service. The dispatcher will be assigned to
+     * the worker which currently has the fewest dispatchers.
+     *
+     * @param dispatcher Dispatcher to attach
+     */
+    virtual void attach(EventDispatcher *dispatcher) {
+        EventDispatcherLockGuard guard(assignmentMutex);
+        size_t shardIndex = 0;
+        for(size_t i = 1; i < shards.size(); ++i) {
+            if(shards.at(i)->numDispatchers < shards.at(shardIndex)->numDispatchers) {
+                shardIndex = i;
+            }
+        }
+        shards.at(shardIndex)->numDispatchers++;
+        dispatcher->serviceShard = shardIndex;
+        dispatcher->start();
+    }
+
+    /**
+     * Detach a dispatcher from the service. This method blocks until any
+     * pending work for the dispatcher has been finished, after which it is
+     * safe to destroy the dispatcher. No events may be scheduled on the
+     * dispatcher while this method is running.
+     *
+     * @param dispatcher Dispatcher to detach
+     */
+    virtual void detach(EventDispatcher *dispatcher) {
+        dispatcher->kill();
+        while(dispatcher->serviceScheduled.load() || dispatcher->serviceProcessing.load()) {
+            tthread::this_thread::sleep_for(tthread::chrono::milliseconds(1));
+        }
+
+        EventDispatcherLockGuard guard(assignmentMutex);
+        shards.at(dispatcher->serviceShard)->numDispatchers--;
+    }
+
+    /**
+     * Wake the worker which owns this dispatcher. If the dispatcher has already
+     * been scheduled and not yet processed, this call does nothing since the
+     * pending run will also see any newly added events. This method never
+     * blocks, since it is also called from the realtime thread when events are
+     * passed on to the asynchronous thread.
+     *
+     * @param dispatcher Dispatcher with pending events
+     */
+    virtual void notify(EventDispatcher *dispatcher) {
+        if(dispatcher->serviceScheduled.exchange(true)) {
+            return;
+        }
+
+        Shard *shard = shards.at(dispatcher->serviceShard);
+        EventDispatcher *head = shard->pending.load();
+        do {
+            dispatcher->serviceNext = head;
+        } while(!shard->pending.compare_exchange_weak(head, dispatcher));
+
+        // If the list was not empty, then the worker has not taken it yet and
+        // will also find this dispatcher, so only the first push must wake it.
+        if(head == NULL) {
+            shard->semaphore.post();
+        }
+    }
+
+private:
+    class Shard {
+    public:
+        Shard() : thread(NULL), pending(NULL), numDispatchers(0), killed(false) {}
+
+        EventDispatcherThread *thread;
+        EventSemaphore semaphore;
+        std::atomic<EventDispatcher *> pending;
+        size_t numDispatchers;
+        std::atomic<bool> killed;
+    };
+
+    static void shardCallback(void *arg) {
+        Shard *shard = reinterpret_cast<Shard *>(arg);
+
+        while(true) {
+            EventDispatcher *dispatcher = shard->pending.exchange(NULL);
+            if(dispatcher == NULL) {
+                if(shard->killed.load()) {
+                    return;
+                }
+                // Wakeups may be left over from dispatchers which were already
+                // processed, in which case the list is simply checked again.
+                shard->semaphore.wait();
+                continue;
+            }
+
+            // Dispatchers are pushed onto the front of the list, so reverse it
+            // to process them in the order in which they were notified.
+            EventDispatcher *ordered = NULL;
+            while(dispatcher != NULL) {
+                EventDispatcher *next = dispatcher->serviceNext;
+                dispatcher->serviceNext = ordered;
+                ordered = dispatcher;
+                dispatcher = next;
+            }
+
+            while(ordered != NULL) {
+                EventDispatcher *next = ordered->serviceNext;
+                ordered->serviceProcessing.store(true);
+                ordered->serviceScheduled.store(false);
+                if(!ordered->isKilled()) {
+                    ordered->process();
+                }
+                // The dispatcher may be destroyed as soon as this flag is cleared,
+                // so it must not be touched afterwards.
+                ordered->serviceProcessing.store(false);
+                ordered = next;
+            }
+        }
+    }
+
+    // Disallow copy and assignment
+    EventDispatcherService(const EventDispatcherService &);
+    EventDispatcherService &operator = (const EventDispatcherService &);
+
+private:
+    std::vector<Shard *> shards;
+    EventDispatcherMutex assignmentMutex;
+};
+#endif // PLUGINPARAMETERS_MULTITHREADED
+
+} // namespace teragon
+
+#endif // __PluginParameters_EventDispatcherService_h__
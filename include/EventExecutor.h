@@ -0,0 +1,451 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PluginParameters_EventExecutor_h__
+#define __PluginParameters_EventExecutor_h__
+
+#include <vector>
+#include "EventDispatcher.h"
+
+#if PLUGINPARAMETERS_MULTITHREADED
+#if WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sched.h>
+#include <unistd.h>
+#if LINUX
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+#endif
+#endif
+
+namespace teragon {
+
+#if PLUGINPARAMETERS_MULTITHREADED
+/**
+ * An executor decides where the asynchronous events of a ConcurrentParameterSet
+ * are delivered. The default is a dedicated low-priority thread per set (see
+ * ThreadEventExecutor), but events may also be delivered by a shared pool of
+ * threads (see EventDispatcherService), or pumped manually from the host's own
+ * runloop (see ManualEventExecutor).
+ */
+class EventExecutor {
+public:
+    EventExecutor() {}
+    virtual ~EventExecutor() {}
+
+    /**
+     * Start delivering events for a dispatcher. When this method returns, the
+     * dispatcher must be started and ready to accept events.
+     */
+    virtual void attach(EventDispatcher *dispatcher) = 0;
+
+    /**
+     * Stop delivering events for a dispatcher. When this method returns, the
+     * executor must not touch the dispatcher again.
+     */
+    virtual void detach(EventDispatcher *dispatcher) = 0;
+
+    /**
+     * Called after events have been added to a dispatcher.
+     */
+    virtual void notify(EventDispatcher *dispatcher) = 0;
+};
+
+typedef enum {
+    kExecutorPriorityLow,
+    kExecutorPriorityNormal,
+    kExecutorPriorityHigh
+} ExecutorPriority;
+
+/**
+ * Controls how a ThreadEventExecutor groups events into batches. Waking up
+ * the dispatcher thread for every single event causes a storm of context
+ * switches under dense automation, so instead the thread wakes up on the first
+ * event and then waits a bit for more events to arrive before processing them.
+ */
+class EventBatchingOptions {
+public:
+    /**
+     * @param inBatchWindowMicroseconds Maximum time to wait for more events
+     *                                  after waking up. Set to 0 to process
+     *                                  events immediately.
+     * @param inBatchDepth Stop waiting once this many events are pending
+     * @param inBacklogDepth When this many events are pending, the dispatcher
+     *                       thread temporarily runs at high priority until
+     *                       its queue has been drained. Set to 0 to disable.
+     */
+    EventBatchingOptions(unsigned long inBatchWindowMicroseconds = 1000,
+                         size_t inBatchDepth = 32,
+                         size_t inBacklogDepth = 256) :
+    batchWindowMicroseconds(inBatchWindowMicroseconds),
+    batchDepth(inBatchDepth), backlogDepth(inBacklogDepth) {}
+
+    unsigned long batchWindowMicroseconds;
+    size_t batchDepth;
+    size_t backlogDepth;
+};
+
+/**
+ * Delivers asynchronous events for each attached dispatcher on its own thread.
+ * This is the executor used by a ConcurrentParameterSet when none is given.
+ * Statistics about the batching behavior can be obtained from
+ * ConcurrentParameterSet::getAsyncStatistics().
+ */
+class ThreadEventExecutor : public EventExecutor {
+public:
+    /**
+     * @param inPriority Scheduling priority of the dispatcher threads
+     * @param inAffinityMask Bitmask of CPUs which the dispatcher threads may
+     *                       run on, or 0 to let the OS decide. This setting is
+     *                       ignored on platforms without affinity support.
+     * @param inBatching Event batching policy
+     */
+    explicit ThreadEventExecutor(ExecutorPriority inPriority = kExecutorPriorityLow,
+                                 unsigned long inAffinityMask = 0,
+                                 const EventBatchingOptions &inBatching = EventBatchingOptions()) :
+    EventExecutor(), priority(inPriority), affinityMask(inAffinityMask), batching(inBatching) {}
+
+    virtual ~ThreadEventExecutor() {}
+
+    virtual void attach(EventDispatcher *dispatcher) {
+        ThreadContext *context = new ThreadContext(this, dispatcher);
+        EventDispatcherThread *thread = new EventDispatcherThread(dispatcherCallback, context);
+        thread->set_name("PluginParametersAsyncDispatcher");
+        setThreadAffinity(thread, affinityMask);
+        context->thread.store(thread);
+
+        {
+            EventDispatcherLockGuard guard(mutex);
+            threads.push_back(context);
+        }
+
+        // Wait for the async dispatcher thread to be fully started.
+        while(!dispatcher->isStarted()) {
+            tthread::this_thread::sleep_for(tthread::chrono::milliseconds(10));
+        }
+    }
+
+    virtual void detach(EventDispatcher *dispatcher) {
+        ThreadContext *context = NULL;
+        {
+            EventDispatcherLockGuard guard(mutex);
+            for(ThreadList::iterator iterator = threads.begin(); iterator != threads.end(); ++iterator) {
+                if((*iterator)->dispatcher == dispatcher) {
+                    context = *iterator;
+                    threads.erase(iterator);
+                    break;
+                }
+            }
+        }
+
+        dispatcher->kill();
+        if(context != NULL) {
+            EventDispatcherThread *thread = context->thread.load();
+            thread->join();
+            delete thread;
+            delete context;
+        }
+    }
+
+    virtual void notify(EventDispatcher *dispatcher) {
+        dispatcher->notify();
+    }
+
+    /**
+     * Change the scheduling priority of a thread, which must be the calling
+     * thread. The thread always stays in the normal scheduling class, since it
+     * runs arbitrary observers which must not starve other threads as a
+     * realtime thread could. Raising the priority above normal may require
+     * special privileges, in which case this call has no effect.
+     *
+     * @param thread Thread to change
+     * @param priority New priority
+     */
+    static void setThreadPriority(EventDispatcherThread *thread, ExecutorPriority priority) {
+        if(priority == kExecutorPriorityLow) {
+            thread->set_low_priority();
+            return;
+        }
+#if WIN32
+        SetThreadPriority(thread->native_handle(), priority == kExecutorPriorityHigh ?
+                          THREAD_PRIORITY_ABOVE_NORMAL : THREAD_PRIORITY_NORMAL);
+#else
+        struct sched_param param;
+        const int minPriority = sched_get_priority_min(SCHED_OTHER);
+        const int maxPriority = sched_get_priority_max(SCHED_OTHER);
+        param.sched_priority = priority == kExecutorPriorityHigh ? maxPriority : (minPriority + maxPriority) / 2;
+        pthread_setschedparam(thread->native_handle(), SCHED_OTHER, &param);
+#if LINUX
+        // SCHED_OTHER has a single priority on Linux, where the nice value of
+        // each thread is used instead
+        setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), priority == kExecutorPriorityHigh ? -5 : 0);
+#endif
+#endif
+    }
+
+    /**
+     * Restrict a thread to a set of CPUs.
+     *
+     * @param thread Thread to change
+     * @param mask Bitmask of allowed CPUs, or 0 to leave the thread unchanged
+     */
+    static void setThreadAffinity(EventDispatcherThread *thread, unsigned long mask) {
+        if(mask == 0) {
+            return;
+        }
+#if WIN32
+        SetThreadAffinityMask(thread->native_handle(), (DWORD_PTR)mask);
+#elif LINUX
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for(size_t i = 0; i < sizeof(mask) * 8; ++i) {
+            if(mask & (1ul << i)) {
+                CPU_SET(i, &cpuSet);
+            }
+        }
+        pthread_setaffinity_np(thread->native_handle(), sizeof(cpuSet), &cpuSet);
+#endif
+    }
+
+private:
+    class ThreadContext {
+    public:
+        ThreadContext(ThreadEventExecutor *e, EventDispatcher *d) :
+        executor(e), dispatcher(d), thread(NULL) {}
+
+        ThreadEventExecutor *executor;
+        EventDispatcher *dispatcher;
+        std::atomic<EventDispatcherThread *> thread;
+    };
+
+    static void dispatcherCallback(void *arg) {
+        ThreadContext *context = reinterpret_cast<ThreadContext *>(arg);
+        EventDispatcher *dispatcher = context->dispatcher;
+        const EventBatchingOptions &batching = context->executor->batching;
+        bool boosted = false;
+
+        // The thread handle is needed to change priority, and is only stored in
+        // the context after the thread has been created.
+        while(context->thread.load() == NULL) {
+            tthread::this_thread::yield();
+        }
+        setThreadPriority(context->thread.load(), context->executor->priority);
+        dispatcher->start();
+
+        while(!dispatcher->isKilled()) {
+            // Events which arrived while the last batch was being processed may have
+            // sent their notification before this thread started waiting again, so
+            // wait() returns immediately when something is pending.
+            dispatcher->wait();
+            // This thread can be notified both in case of an event callback or when the
+            // thread should join and exit. In the second case, we should not attempt to
+            // run process(), as bad things may happen.
+            if(dispatcher->isKilled()) {
+                break;
+            }
+
+            // Give other events a chance to arrive, so that they can be handled in
+            // a single batch rather than waking this thread up for each of them.
+            if(batching.batchWindowMicroseconds > 0 && !boosted) {
+                // Each scheduled event notifies the dispatcher, so the wait ends
+                // as soon as the batch is full.
+                dispatcher->waitForEvents(batching.batchDepth, EventClock::now() +
+                    (unsigned long long)batching.batchWindowMicroseconds * 1000ull);
+            }
+
+            if(batching.backlogDepth > 0 && !boosted &&
+               dispatcher->getNumPendingEvents() >= batching.backlogDepth) {
+                setThreadPriority(context->thread.load(), kExecutorPriorityHigh);
+                dispatcher->recordPriorityBoost();
+                boosted = true;
+            }
+
+            if(!dispatcher->isKilled()) {
+                dispatcher->process();
+            }
+
+            if(boosted && dispatcher->getNumPendingEvents() == 0) {
+                setThreadPriority(context->thread.load(), context->executor->priority);
+                boosted = false;
+            }
+        }
+    }
+
+    typedef std::vector<ThreadContext *> ThreadList;
+
+    const ExecutorPriority priority;
+    const unsigned long affinityMask;
+    const EventBatchingOptions batching;
+    EventDispatcherMutex mutex;
+    ThreadList threads;
+};
+
+/**
+ * Executor which does not own any threads. Instead, the host must regularly
+ * call ConcurrentParameterSet::processAsyncEvents() from a single thread of
+ * its choice, typically from an idle or timer callback on the UI thread. This
+ * way asynchronous observers run directly on the UI thread, and GUI code does
+ * not need to marshal parameter changes back to it.
+ */
+class ManualEventExecutor : public EventExecutor {
+public:
+    ManualEventExecutor() : EventExecutor() {}
+    virtual ~ManualEventExecutor() {}
+
+    virtual void attach(EventDispatcher *dispatcher) {
+        dispatcher->start();
+    }
+
+    virtual void detach(EventDispatcher *dispatcher) {
+        dispatcher->kill();
+    }
+
+    virtual void notify(EventDispatcher *dispatcher) {}
+};
+
+#if !WIN32
+/**
+ * Manual executor which also exposes a file descriptor that becomes readable
+ * whenever asynchronous events are pending, so that parameter notifications
+ * can be folded into a GUI's existing poll(), epoll or X11 event loop without
+ * any extra threads or busy waiting. On Linux this is an eventfd, and on other
+ * POSIX systems it is the read end of a pipe.
+ *
+ * Unlike ManualEventExecutor, this executor keeps track of all attached sets,
+ * and processAsyncEvents() must be called on the executor itself. This allows
+ * many parameter sets to share a single file descriptor.
+ */
+class PollableEventExecutor : public ManualEventExecutor {
+public:
+    PollableEventExecutor() : ManualEventExecutor(), signaled(false) {
+#if LINUX
+        readDescriptor = writeDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+        int descriptors[2] = {-1, -1};
+        if(pipe(descriptors) == 0) {
+            for(int i = 0; i < 2; ++i) {
+                fcntl(descriptors[i], F_SETFL, fcntl(descriptors[i], F_GETFL) | O_NONBLOCK);
+                fcntl(descriptors[i], F_SETFD, FD_CLOEXEC);
+            }
+        }
+        readDescriptor = descriptors[0];
+        writeDescriptor = descriptors[1];
+#endif
+    }
+
+    virtual ~PollableEventExecutor() {
+        if(readDescriptor >= 0) {
+            close(readDescriptor);
+        }
+        if(writeDescriptor >= 0 && writeDescriptor != readDescriptor) {
+            close(writeDescriptor);
+        }
+    }
+
+    /**
+     * @return File descriptor which is readable while events are pending, or
+     *         -1 if it could not be created. Callers must not read from or
+     *         close this descriptor themselves.
+     */
+    int getFileDescriptor() const {
+        return readDescriptor;
+    }
+
+    virtual void attach(EventDispatcher *dispatcher) {
+        EventDispatcherLockGuard guard(mutex);
+        dispatchers.push_back(dispatcher);
+        dispatcher->start();
+    }
+
+    virtual void detach(EventDispatcher *dispatcher) {
+        EventDispatcherLockGuard guard(mutex);
+        dispatcher->kill();
+        for(DispatcherList::iterator iterator = dispatchers.begin(); iterator != dispatchers.end(); ++iterator) {
+            if(*iterator == dispatcher) {
+                dispatchers.erase(iterator);
+                break;
+            }
+        }
+    }
+
+    virtual void notify(EventDispatcher *dispatcher) {
+        // Only signal the descriptor for the first notification since the last
+        // time events were processed, which avoids a syscall for every event.
+        if(!signaled.exchange(true)) {
+#if LINUX
+            uint64_t value = 1;
+#else
+            char value = 1;
+#endif
+            ssize_t result = write(writeDescriptor, &value, sizeof(value));
+            (void)result;
+        }
+    }
+
+    /**
+     * Deliver all pending asynchronous events for the attached parameter sets.
+     * This method never blocks, and should always be called from the same
+     * thread, typically when the file descriptor has become readable.
+     */
+    void processAsyncEvents() {
+        // Drain the descriptor before resetting the flag, otherwise a notify()
+        // in between would be drained with the flag left set, and no later
+        // notification would signal the descriptor again. Events which arrive
+        // after the reset signal it again, and earlier ones are processed below.
+#if LINUX
+        uint64_t value;
+#else
+        char value[64];
+#endif
+        while(read(readDescriptor, &value, sizeof(value)) > 0) {}
+        signaled.store(false);
+
+        EventDispatcherLockGuard guard(mutex);
+        for(DispatcherList::iterator iterator = dispatchers.begin(); iterator != dispatchers.end(); ++iterator) {
+            (*iterator)->process();
+        }
+    }
+
+private:
+    typedef std::vector<EventDispatcher *> DispatcherList;
+
+    int readDescriptor;
+    int writeDescriptor;
+    std::atomic<bool> signaled;
+    EventDispatcherMutex mutex;
+    DispatcherList dispatchers;
+};
+#endif // !WIN32
+#endif // PLUGINPARAMETERS_MULTITHREADED
+
+} // namespace teragon
+
+#endif // __PluginParameters_EventExecutor_h__
@@ -43,6 +43,10 @@ public:
 
     virtual ~FloatParameter() {}
 
+    virtual Parameter *clone() const {
+        return new FloatParameter(*this);
+    }
+
     virtual const ParameterString getDisplayText() const {
         std::stringstream numberFormatter;
         numberFormatter.precision(getDisplayPrecision());
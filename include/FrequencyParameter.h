@@ -45,6 +45,10 @@ public:
 
     virtual ~FrequencyParameter() {}
 
+    virtual Parameter *clone() const {
+        return new FrequencyParameter(*this);
+    }
+
     static ParameterString getFormattedFrequency(const ParameterValue frequency,
                                                  const unsigned int displayPrecision) {
         if(frequency >= 1000.0) {
@@ -43,6 +43,10 @@ public:
 
     virtual ~IntegerParameter() {}
 
+    virtual Parameter *clone() const {
+        return new IntegerParameter(*this);
+    }
+
     virtual const ParameterString getDisplayText() const {
         std::stringstream numberFormatter;
         numberFormatter << (int)getValue();
@@ -0,0 +1,876 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __PluginParameters_JsonState_h__
+#define __PluginParameters_JsonState_h__
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "BlobParameter.h"
+#include "BooleanParameter.h"
+#include "ParameterSet.h"
+#include "StateStream.h"
+#include "VoidParameter.h"
+
+namespace teragon {
+
+// Size of the buffers used by the JSON writer and reader
+static const size_t kJsonStateBufferSize = 4096;
+
+static const char kJsonStateBase64Alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * Writes the state of a parameter set as a single JSON object, which is keyed
+ * by the parameters' safe names. The output is produced in one pass, without
+ * building a document tree, and passed to the StateOutput in large chunks.
+ *
+ * Numeric parameters are written as numbers, boolean parameters as true or
+ * false, and string parameters as strings. Blobs are written as base64
+ * strings, except for blobs which are backed by a memory-mapped file, which
+ * are written as an object holding the file's path and content hash. Void
+ * parameters have no state, and are skipped.
+ */
+class JsonStateWriter {
+public:
+    explicit JsonStateWriter(StateOutput &inOutput) :
+    output(inOutput), length(0), numBytesWritten(0), failed(false), isFirstValue(true) {}
+
+    virtual ~JsonStateWriter() {}
+
+    /**
+     * Write the state of all parameters in the set.
+     *
+     * @param parameters Parameter set to write
+     * @return True if all data was accepted by the output
+     */
+    bool write(const ParameterSet &parameters) {
+        begin();
+        for(size_t i = 0; i < parameters.size(); i++) {
+            const Parameter *parameter = parameters.get((int)i);
+            if(dynamic_cast<const VoidParameter *>(parameter) == NULL) {
+                writeParameter(parameter);
+            }
+        }
+        return end();
+    }
+
+    /**
+     * Start writing a state value by value, rather than from a parameter set,
+     * for instance from values which were copied earlier. Each value is
+     * written with one of the methods below, and the state must be completed
+     * with end().
+     */
+    void begin() {
+        failed = false;
+        isFirstValue = true;
+        put('{');
+    }
+
+    void writeNumber(const ParameterString &safeName, const ParameterValue value) {
+        putKey(safeName);
+        putNumber(value);
+    }
+
+    void writeBoolean(const ParameterString &safeName, const bool value) {
+        putKey(safeName);
+        put(value ? "true" : "false");
+    }
+
+    void writeString(const ParameterString &safeName, const char *data, size_t size) {
+        putKey(safeName);
+        putString(data, size);
+    }
+
+    /**
+     * Write a blob as base64, or null if the data is NULL.
+     */
+    void writeBlob(const ParameterString &safeName, const char *data, size_t size) {
+        putKey(safeName);
+        if(data != NULL) {
+            putBase64(data, size);
+        }
+        else {
+            put("null");
+        }
+    }
+
+    /**
+     * Write a reference to the file backing a DataParameter, see
+     * DataParameter::getBackingFile().
+     */
+    void writeMappedFile(const ParameterString &safeName, const ParameterString &path,
+                         unsigned long long contentHash) {
+        char hash[24];
+        snprintf(hash, sizeof(hash), "%016llx", contentHash);
+        putKey(safeName);
+        put("{\"path\":");
+        putString(path.data(), path.size());
+        put(",\"hash\":\"");
+        put(hash);
+        put("\"}");
+    }
+
+    /**
+     * Complete a state which was started with begin().
+     *
+     * @return True if all data was accepted by the output
+     */
+    bool end() {
+        put("}\n");
+        flush();
+        return !failed;
+    }
+
+    /**
+     * @return Total number of bytes passed to the output
+     */
+    size_t getNumBytesWritten() const {
+        return numBytesWritten;
+    }
+
+private:
+    void writeParameter(const Parameter *parameter) {
+        const ParameterString &safeName = parameter->getSafeName();
+        const DataParameter *dataParameter = dynamic_cast<const DataParameter *>(parameter);
+        ParameterString path;
+        unsigned long long contentHash = 0;
+        if(dataParameter != NULL && dataParameter->getBackingFile(path, contentHash)) {
+            writeMappedFile(safeName, path, contentHash);
+            return;
+        }
+
+        if(dataParameter != NULL) {
+            const DataBuffer *current = dataParameter->getBuffer();
+            if(dynamic_cast<const BlobParameter *>(parameter) != NULL) {
+                writeBlob(safeName, current != NULL ? current->getData() : NULL,
+                          current != NULL ? current->getSize() : 0);
+            }
+            else {
+                writeString(safeName, current != NULL ? current->getData() : "",
+                            current != NULL ? current->getSize() : 0);
+            }
+        }
+        else if(dynamic_cast<const BooleanParameter *>(parameter) != NULL) {
+            writeBoolean(safeName, parameter->getValue() > 0.5);
+        }
+        else {
+            writeNumber(safeName, parameter->getValue());
+        }
+    }
+
+    void putKey(const ParameterString &safeName) {
+        if(!isFirstValue) {
+            put(',');
+        }
+        isFirstValue = false;
+        put('"');
+        put(safeName);
+        put("\":");
+    }
+
+    void putNumber(const ParameterValue value) {
+        // JSON has no representation for NaN or infinity
+        if(!(value - value == 0.0)) {
+            put("null");
+            return;
+        }
+        char number[32];
+        // Enough digits so that the value is restored exactly
+        snprintf(number, sizeof(number), sizeof(ParameterValue) == sizeof(float) ? "%.9g" : "%.17g",
+                 (double)value);
+        put(number);
+    }
+
+    void putString(const char *data, size_t size) {
+        put('"');
+        for(size_t i = 0; i < size; i++) {
+            const unsigned char c = (unsigned char)data[i];
+            if(c == '"' || c == '\\') {
+                put('\\');
+                put((char)c);
+            }
+            else if(c < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned int)c);
+                put(escaped);
+            }
+            else {
+                put((char)c);
+            }
+        }
+        put('"');
+    }
+
+    void putBase64(const char *data, size_t size) {
+        const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+        put('"');
+        size_t i = 0;
+        for(; i + 3 <= size; i += 3) {
+            const unsigned long group = ((unsigned long)bytes[i] << 16) |
+                                        ((unsigned long)bytes[i + 1] << 8) | bytes[i + 2];
+            put(kJsonStateBase64Alphabet[(group >> 18) & 0x3f]);
+            put(kJsonStateBase64Alphabet[(group >> 12) & 0x3f]);
+            put(kJsonStateBase64Alphabet[(group >> 6) & 0x3f]);
+            put(kJsonStateBase64Alphabet[group & 0x3f]);
+        }
+        if(i < size) {
+            unsigned long group = (unsigned long)bytes[i] << 16;
+            if(i + 1 < size) {
+                group |= (unsigned long)bytes[i + 1] << 8;
+            }
+            put(kJsonStateBase64Alphabet[(group >> 18) & 0x3f]);
+            put(kJsonStateBase64Alphabet[(group >> 12) & 0x3f]);
+            put(i + 1 < size ? kJsonStateBase64Alphabet[(group >> 6) & 0x3f] : '=');
+            put('=');
+        }
+        put('"');
+    }
+
+    void put(char c) {
+        if(length == kJsonStateBufferSize) {
+            flush();
+        }
+        buffer[length++] = c;
+    }
+
+    void put(const char *string) {
+        put(string, strlen(string));
+    }
+
+    void put(const ParameterString &string) {
+        put(string.data(), string.size());
+    }
+
+    void put(const char *data, size_t size) {
+        while(size > 0) {
+            if(length == kJsonStateBufferSize) {
+                flush();
+            }
+            const size_t numBytes = size < kJsonStateBufferSize - length ? size : kJsonStateBufferSize - length;
+            memcpy(buffer + length, data, numBytes);
+            length += numBytes;
+            data += numBytes;
+            size -= numBytes;
+        }
+    }
+
+    void flush() {
+        if(length > 0) {
+            if(!output.write(buffer, length)) {
+                failed = true;
+            }
+            numBytesWritten += length;
+            length = 0;
+        }
+    }
+
+    // Disallow copy and assignment
+    JsonStateWriter(const JsonStateWriter &);
+    JsonStateWriter &operator = (const JsonStateWriter &);
+
+private:
+    StateOutput &output;
+    char buffer[kJsonStateBufferSize];
+    size_t length;
+    size_t numBytesWritten;
+    bool failed;
+    bool isFirstValue;
+};
+
+/**
+ * Reads a state written by JsonStateWriter, and applies it to a parameter set
+ * while it is being parsed. Keys are looked up directly in the set's name
+ * index, and values are applied without building a document tree first. Base64
+ * blobs are decoded as they are read, directly into the buffer which the
+ * parameter then adopts.
+ *
+ * Keys which do not match any parameter are skipped, so that states written by
+ * older or newer versions of a plugin can still be read. Numbers outside of a
+ * parameter's range are clamped. When PLUGINPARAMETERS_MULTITHREADED is set,
+ * the changes are scheduled like any other change made with the set.
+ */
+class JsonStateReader {
+public:
+    /**
+     * @param inInput Input to read the state from
+     * @param inAllowMappedFiles If true, then MappedBlobParameter values are
+     *                           restored by mapping the file at the path which
+     *                           is stored in the state. Since states may come
+     *                           from untrusted sources, such as presets which
+     *                           were downloaded by the user, these values are
+     *                           otherwise counted as invalid and skipped.
+     */
+    explicit JsonStateReader(StateInput &inInput, bool inAllowMappedFiles = false) :
+    input(inInput), allowMappedFiles(inAllowMappedFiles), length(0), position(0),
+    numValuesRead(0), numUnknownKeys(0), numInvalidValues(0),
+    key(), scratch() {}
+
+    virtual ~JsonStateReader() {}
+
+    /**
+     * Read a state and apply it to a parameter set.
+     *
+     * @param parameters Parameter set to apply the state to
+     * @param sender Sending object (can be NULL), which will not be notified
+     *               of the changes
+     * @return True if the input was a valid state. If parsing fails, then
+     *         the values which were read before the error have been applied.
+     */
+    bool read(StateParameterSet &parameters, ParameterObserver *sender = NULL) {
+        numValuesRead = 0;
+        numUnknownKeys = 0;
+        numInvalidValues = 0;
+
+        skipWhitespace();
+        if(next() != '{') {
+            return false;
+        }
+        skipWhitespace();
+        if(peek() == '}') {
+            next();
+            return true;
+        }
+        while(true) {
+            skipWhitespace();
+            if(next() != '"' || !readString(key)) {
+                return false;
+            }
+            skipWhitespace();
+            if(next() != ':') {
+                return false;
+            }
+            skipWhitespace();
+
+            Parameter *parameter = parameters.getBySafeName(key);
+            if(parameter == NULL) {
+                numUnknownKeys++;
+                if(!skipValue()) {
+                    return false;
+                }
+            }
+            else if(!readValue(parameters, parameter, sender)) {
+                return false;
+            }
+
+            skipWhitespace();
+            const int c = next();
+            if(c == '}') {
+                return true;
+            }
+            else if(c != ',') {
+                return false;
+            }
+        }
+    }
+
+    /**
+     * @return Number of values which were applied by the last call to read().
+     *         When PLUGINPARAMETERS_MULTITHREADED is set, changes which were
+     *         rejected by a full queue are not counted.
+     */
+    size_t getNumValuesRead() const {
+        return numValuesRead;
+    }
+
+    /**
+     * @return Number of keys which did not match any parameter
+     */
+    size_t getNumUnknownKeys() const {
+        return numUnknownKeys;
+    }
+
+    /**
+     * @return Number of values which had the wrong type or were out of range,
+     *         and number of mapped files which could not or may not be restored
+     */
+    size_t getNumInvalidValues() const {
+        return numInvalidValues;
+    }
+
+private:
+    bool readValue(StateParameterSet &parameters, Parameter *parameter, ParameterObserver *sender) {
+        const int c = peek();
+        if(c == 'n') {
+            // Null values leave the parameter unchanged
+            return skipValue();
+        }
+
+        DataParameter *dataParameter = dynamic_cast<DataParameter *>(parameter);
+        if(dataParameter != NULL && c == '{') {
+            return readMappedFile(parameters, dataParameter, sender);
+        }
+
+        if(dataParameter != NULL) {
+            if(c != '"') {
+                numInvalidValues++;
+                return skipValue();
+            }
+            next();
+            bool isApplied = true;
+            if(dynamic_cast<BlobParameter *>(parameter) != NULL) {
+                char *data = NULL;
+                size_t dataSize = 0;
+                if(!readBase64(data, dataSize)) {
+                    return false;
+                }
+#if PLUGINPARAMETERS_MULTITHREADED
+                isApplied = parameters.adoptData(dataParameter, data, dataSize,
+                                                 DataBuffer::freeDeleter, NULL, sender);
+#else
+                dataParameter->adoptValue(data, dataSize, DataBuffer::freeDeleter);
+#endif
+            }
+            else {
+                if(!readString(scratch)) {
+                    return false;
+                }
+#if PLUGINPARAMETERS_MULTITHREADED
+                isApplied = parameters.setData(dataParameter, scratch.data(), scratch.size(), sender);
+#else
+                dataParameter->setValue(scratch.data(), scratch.size());
+#endif
+            }
+            if(isApplied) {
+                numValuesRead++;
+            }
+            return true;
+        }
+
+        ParameterValue value = 0.0;
+        if(c == 't' || c == 'f') {
+            if(!readLiteral(scratch)) {
+                return false;
+            }
+            if(scratch != "true" && scratch != "false") {
+                return false;
+            }
+            value = scratch == "true" ? 1.0 : 0.0;
+        }
+        else if(c == '-' || (c >= '0' && c <= '9')) {
+            // strtod() also accepts hex numbers, "inf" and "nan"
+            if(!readLiteral(scratch) || !isNumber(scratch)) {
+                return false;
+            }
+            char *end = NULL;
+            value = (ParameterValue)strtod(scratch.c_str(), &end);
+            if(end == NULL || *end != '\0') {
+                return false;
+            }
+            // Numbers which are too large overflow to infinity, and NaN would
+            // pass the range checks below
+            if(!(value - value == 0.0)) {
+                numInvalidValues++;
+                return true;
+            }
+        }
+        else {
+            numInvalidValues++;
+            return skipValue();
+        }
+
+        if(value < parameter->getMinValue()) {
+            value = parameter->getMinValue();
+            numInvalidValues++;
+        }
+        else if(value > parameter->getMaxValue()) {
+            value = parameter->getMaxValue();
+            numInvalidValues++;
+        }
+#if PLUGINPARAMETERS_MULTITHREADED
+        if(!parameters.set(parameter, value, sender)) {
+            return true;
+        }
+#else
+        parameter->setValue(value);
+#endif
+        numValuesRead++;
+        return true;
+    }
+
+    bool readMappedFile(StateParameterSet &parameters, DataParameter *parameter,
+                        ParameterObserver *sender) {
+        ParameterString path;
+        ParameterString hash;
+        next();
+        skipWhitespace();
+        if(peek() == '}') {
+            next();
+        }
+        else {
+            while(true) {
+                skipWhitespace();
+                if(next() != '"' || !readString(key)) {
+                    return false;
+                }
+                skipWhitespace();
+                if(next() != ':') {
+                    return false;
+                }
+                skipWhitespace();
+                if(key == "path" || key == "hash") {
+                    if(next() != '"' || !readString(key == "path" ? path : hash)) {
+                        return false;
+                    }
+                }
+                else if(!skipValue()) {
+                    return false;
+                }
+                skipWhitespace();
+                const int c = next();
+                if(c == '}') {
+                    break;
+                }
+                else if(c != ',') {
+                    return false;
+                }
+            }
+        }
+
+        if(!allowMappedFiles) {
+            numInvalidValues++;
+            return true;
+        }
+
+        // The file may have been moved or changed since the state was written
+        BackingFile file;
+        if(!parameter->openBackingFile(path, hash.empty() ? 0 : strtoull(hash.c_str(), NULL, 16), file)) {
+            numInvalidValues++;
+            return true;
+        }
+#if PLUGINPARAMETERS_MULTITHREADED
+        if(!parameters.adoptData(parameter, file.data, file.size, file.deleter, file.context, sender)) {
+            return true;
+        }
+#else
+        parameter->adoptValue(file.data, file.size, file.deleter, file.context);
+#endif
+        numValuesRead++;
+        return true;
+    }
+
+    // Reads the rest of a string whose opening quote has been consumed
+    bool readString(std::string &result) {
+        result.clear();
+        while(true) {
+            int c = next();
+            if(c < 0) {
+                return false;
+            }
+            else if(c == '"') {
+                return true;
+            }
+            else if(c != '\\') {
+                result += (char)c;
+                continue;
+            }
+
+            c = next();
+            switch(c) {
+                case '"': result += '"'; break;
+                case '\\': result += '\\'; break;
+                case '/': result += '/'; break;
+                case 'b': result += '\b'; break;
+                case 'f': result += '\f'; break;
+                case 'n': result += '\n'; break;
+                case 'r': result += '\r'; break;
+                case 't': result += '\t'; break;
+                case 'u': {
+                    unsigned long codePoint = 0;
+                    if(!readHexDigits(codePoint)) {
+                        return false;
+                    }
+                    // Characters outside of the BMP are escaped as surrogate pairs,
+                    // and surrogates are not valid characters on their own
+                    if(codePoint >= 0xdc00 && codePoint < 0xe000) {
+                        return false;
+                    }
+                    else if(codePoint >= 0xd800 && codePoint < 0xdc00) {
+                        unsigned long low = 0;
+                        if(next() != '\\' || next() != 'u' || !readHexDigits(low) ||
+                           low < 0xdc00 || low >= 0xe000) {
+                            return false;
+                        }
+                        codePoint = 0x10000 + ((codePoint - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    appendUtf8(result, codePoint);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+    }
+
+    bool readHexDigits(unsigned long &result) {
+        for(int i = 0; i < 4; i++) {
+            const int c = next();
+            result <<= 4;
+            if(c >= '0' && c <= '9') {
+                result |= (unsigned long)(c - '0');
+            }
+            else if(c >= 'a' && c <= 'f') {
+                result |= (unsigned long)(c - 'a' + 10);
+            }
+            else if(c >= 'A' && c <= 'F') {
+                result |= (unsigned long)(c - 'A' + 10);
+            }
+            else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void appendUtf8(std::string &result, unsigned long codePoint) {
+        if(codePoint < 0x80) {
+            result += (char)codePoint;
+        }
+        else if(codePoint < 0x800) {
+            result += (char)(0xc0 | (codePoint >> 6));
+            result += (char)(0x80 | (codePoint & 0x3f));
+        }
+        else if(codePoint < 0x10000) {
+            result += (char)(0xe0 | (codePoint >> 12));
+            result += (char)(0x80 | ((codePoint >> 6) & 0x3f));
+            result += (char)(0x80 | (codePoint & 0x3f));
+        }
+        else {
+            result += (char)(0xf0 | (codePoint >> 18));
+            result += (char)(0x80 | ((codePoint >> 12) & 0x3f));
+            result += (char)(0x80 | ((codePoint >> 6) & 0x3f));
+            result += (char)(0x80 | (codePoint & 0x3f));
+        }
+    }
+
+    // Decodes the rest of a base64 string whose opening quote has been consumed
+    // into a buffer allocated with malloc(), which the caller must free. The
+    // buffer is NULL if the string is empty or cannot be decoded.
+    bool readBase64(char *&result, size_t &resultSize) {
+        result = NULL;
+        resultSize = 0;
+        size_t capacity = 0;
+        unsigned long group = 0;
+        int numBits = 0;
+        while(true) {
+            const int c = next();
+            int digit = -1;
+            if(c >= 'A' && c <= 'Z') {
+                digit = c - 'A';
+            }
+            else if(c >= 'a' && c <= 'z') {
+                digit = c - 'a' + 26;
+            }
+            else if(c >= '0' && c <= '9') {
+                digit = c - '0' + 52;
+            }
+            else if(c == '+') {
+                digit = 62;
+            }
+            else if(c == '/') {
+                digit = 63;
+            }
+            else if(c == '"') {
+                // Give back any unused memory, which shrinks the buffer in place
+                if(resultSize < capacity && resultSize > 0) {
+                    char *shrunk = reinterpret_cast<char *>(realloc(result, resultSize));
+                    if(shrunk != NULL) {
+                        result = shrunk;
+                    }
+                }
+                return true;
+            }
+            else if(c == '=') {
+                continue;
+            }
+            else {
+                break;
+            }
+
+            group = (group << 6) | (unsigned long)digit;
+            numBits += 6;
+            if(numBits >= 8) {
+                if(resultSize == capacity) {
+                    // The size is not known in advance, so grow the buffer geometrically
+                    capacity = capacity > 0 ? capacity * 2 : kJsonStateBufferSize;
+                    char *grown = reinterpret_cast<char *>(realloc(result, capacity));
+                    if(grown == NULL) {
+                        break;
+                    }
+                    result = grown;
+                }
+                numBits -= 8;
+                result[resultSize++] = (char)((group >> numBits) & 0xff);
+            }
+        }
+
+        free(result);
+        result = NULL;
+        resultSize = 0;
+        return false;
+    }
+
+    // Reads a number or a literal such as true, which ends at a delimiter
+    /**
+     * @return True if the literal is a number in the JSON grammar
+     */
+    static bool isNumber(const std::string &literal) {
+        size_t i = 0;
+        const size_t size = literal.size();
+        if(i < size && literal[i] == '-') {
+            i++;
+        }
+        if(i < size && literal[i] == '0') {
+            i++;
+        }
+        else if(i < size && literal[i] >= '1' && literal[i] <= '9') {
+            while(i < size && literal[i] >= '0' && literal[i] <= '9') {
+                i++;
+            }
+        }
+        else {
+            return false;
+        }
+        if(i < size && literal[i] == '.') {
+            const size_t start = ++i;
+            while(i < size && literal[i] >= '0' && literal[i] <= '9') {
+                i++;
+            }
+            if(i == start) {
+                return false;
+            }
+        }
+        if(i < size && (literal[i] == 'e' || literal[i] == 'E')) {
+            i++;
+            if(i < size && (literal[i] == '+' || literal[i] == '-')) {
+                i++;
+            }
+            const size_t start = i;
+            while(i < size && literal[i] >= '0' && literal[i] <= '9') {
+                i++;
+            }
+            if(i == start) {
+                return false;
+            }
+        }
+        return i == size;
+    }
+
+    bool readLiteral(std::string &result) {
+        result.clear();
+        while(true) {
+            const int c = peek();
+            if(c < 0 || c == ',' || c == '}' || c == ']' || isWhitespace(c)) {
+                return !result.empty();
+            }
+            result += (char)next();
+        }
+    }
+
+    bool skipValue() {
+        const int c = peek();
+        if(c == '"') {
+            next();
+            return readString(scratch);
+        }
+        else if(c == '{' || c == '[') {
+            // Skip nested containers by counting brackets outside of strings
+            int depth = 0;
+            while(true) {
+                const int d = next();
+                if(d < 0) {
+                    return false;
+                }
+                else if(d == '"') {
+                    if(!readString(scratch)) {
+                        return false;
+                    }
+                }
+                else if(d == '{' || d == '[') {
+                    depth++;
+                }
+                else if(d == '}' || d == ']') {
+                    if(--depth == 0) {
+                        return true;
+                    }
+                }
+            }
+        }
+        return readLiteral(scratch);
+    }
+
+    static bool isWhitespace(int c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    void skipWhitespace() {
+        while(isWhitespace(peek())) {
+            next();
+        }
+    }
+
+    // @return The next character without consuming it, or -1 at the end
+    int peek() {
+        if(position == length) {
+            length = input.read(buffer, kJsonStateBufferSize);
+            position = 0;
+            if(length == 0) {
+                return -1;
+            }
+        }
+        return (unsigned char)buffer[position];
+    }
+
+    int next() {
+        const int result = peek();
+        if(result >= 0) {
+            position++;
+        }
+        return result;
+    }
+
+    // Disallow copy and assignment
+    JsonStateReader(const JsonStateReader &);
+    JsonStateReader &operator = (const JsonStateReader &);
+
+private:
+    StateInput &input;
+    const bool allowMappedFiles;
+    char buffer[kJsonStateBufferSize];
+    size_t length;
+    size_t position;
+    size_t numValuesRead;
+    size_t numUnknownKeys;
+    size_t numInvalidValues;
+    // Reused between values, so that reading a state rarely allocates
+    std::string key;
+    std::string scratch;
+};
+
+} // namespace teragon
+
+#endif // __PluginParameters_JsonState_h__
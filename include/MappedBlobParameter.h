@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __PluginParameters_MappedBlobParameter_h__
+#define __PluginParameters_MappedBlobParameter_h__
+
+#include "BlobParameter.h"
+#include "MappedFile.h"
+
+#if PLUGINPARAMETERS_MULTITHREADED
+#include "ConcurrentParameterSet.h"
+#endif
+
+namespace teragon {
+
+/**
+ * Blob parameter whose contents are backed by a memory-mapped file rather than
+ * by a copy on the heap. This is intended for large sample data, which is then
+ * only paged in as it is played, and which is shared between all instances
+ * referencing the same file. A mapped file is identified by its path and by
+ * its content hash, which are all that needs to be stored when serializing
+ * the parameter.
+ *
+ * When PLUGINPARAMETERS_MULTITHREADED is set, files are mapped with the
+ * mapFile() function below, and the mapping is released on the asynchronous
+ * thread once it has been replaced.
+ */
+class MappedBlobParameter : public BlobParameter {
+public:
+    MappedBlobParameter(const ParameterString &inName) : BlobParameter(inName) {}
+
+    virtual ~MappedBlobParameter() {}
+
+    /**
+     * The clone maps the same file again, so that both share the same pages.
+     * Contents which were not mapped from a file are copied.
+     *
+     * @return The clone, or NULL if the file could not be mapped again
+     */
+    virtual Parameter *clone() const {
+        const MappedFile *file = getMappedFile();
+        if(file == NULL) {
+            return new MappedBlobParameter(*this, copyBuffer(*this));
+        }
+        MappedFile *copy = MappedFile::create(file->getPath());
+        if(copy == NULL) {
+            return NULL;
+        }
+        return new MappedBlobParameter(*this, DataBuffer::adopt(const_cast<void *>(copy->getData()), copy->getSize(),
+                                                                 MappedFile::unmapDeleter, copy));
+    }
+
+    virtual const ParameterString getDisplayText() const {
+        const MappedFile *file = getMappedFile();
+        return file != NULL ? file->getPath() : BlobParameter::getDisplayText();
+    }
+
+    /**
+     * @return The file which backs the parameter's current contents, or NULL
+     *         if the contents were not mapped from a file
+     */
+    const MappedFile *getMappedFile() const {
+        const DataBuffer *current = getBuffer();
+        if(current == NULL || current->getDeleter() != MappedFile::unmapDeleter) {
+            return NULL;
+        }
+        return reinterpret_cast<const MappedFile *>(current->getDeleterContext());
+    }
+
+    /**
+     * @return Path of the mapped file, or an empty string if none is mapped
+     */
+    const ParameterString getPath() const {
+        const MappedFile *file = getMappedFile();
+        return file != NULL ? file->getPath() : ParameterString();
+    }
+
+    /**
+     * @return Hash of the mapped file's contents, or 0 if none is mapped
+     */
+    unsigned long long getContentHash() const {
+        const MappedFile *file = getMappedFile();
+        return file != NULL ? file->getContentHash() : 0;
+    }
+
+    virtual bool getBackingFile(ParameterString &outPath, unsigned long long &outContentHash) const {
+        const MappedFile *file = getMappedFile();
+        if(file == NULL) {
+            return false;
+        }
+        outPath = file->getPath();
+        outContentHash = file->getContentHash();
+        return true;
+    }
+
+    virtual bool openBackingFile(const ParameterString &inPath, unsigned long long contentHash,
+                                 BackingFile &result) const {
+        MappedFile *file = MappedFile::create(inPath);
+        if(file == NULL) {
+            return false;
+        }
+        // The file may have been changed since the state was written
+        if(contentHash != 0 && file->getContentHash() != contentHash) {
+            delete file;
+            return false;
+        }
+        result.data = const_cast<void *>(file->getData());
+        result.size = file->getSize();
+        result.deleter = MappedFile::unmapDeleter;
+        result.context = file;
+        return true;
+    }
+
+#if PLUGINPARAMETERS_MULTITHREADED
+protected:
+#endif
+
+    /**
+     * Replace the parameter's contents with a mapping of a file.
+     *
+     * @param inPath Path of the file to map
+     * @param prefetch If true, start reading the whole file in the background
+     * @return True if the file was mapped
+     */
+    virtual bool mapFile(const ParameterString &inPath, bool prefetch = false) {
+        MappedFile *file = MappedFile::create(inPath, prefetch);
+        if(file == NULL) {
+            return false;
+        }
+        adoptValue(const_cast<void *>(file->getData()), file->getSize(), MappedFile::unmapDeleter, file);
+        return true;
+    }
+
+protected:
+    MappedBlobParameter(const MappedBlobParameter &other, DataBuffer *inBuffer) :
+    BlobParameter(other, inBuffer) {}
+};
+
+#if PLUGINPARAMETERS_MULTITHREADED
+/**
+ * Replace a blob parameter's contents with a read-only memory mapping of a
+ * file, see MappedBlobParameter. The file is mapped on the calling thread,
+ * and the mapping is released on the asynchronous thread once it has been
+ * replaced.
+ *
+ * @param parameters Set which holds the parameter
+ * @param parameter Parameter
+ * @param path Path of the file to map
+ * @param prefetch If true, start reading the whole file in the background
+ * @param sender Sending object (can be NULL). If non-NULL, then this object
+ *               will *not* receive notifications on the observer callback.
+ * @return True if the change was scheduled, false if the file could not be
+ *         mapped or the event was rejected by a full queue
+ */
+static inline bool mapFile(ConcurrentParameterSet &parameters, Parameter *parameter,
+                           const ParameterString &path, bool prefetch = false,
+                           ParameterObserver *sender = NULL) {
+    MappedFile *file = MappedFile::create(path, prefetch);
+    return file != NULL &&
+           parameters.adoptData(parameter, const_cast<void *>(file->getData()), file->getSize(),
+                                MappedFile::unmapDeleter, file, sender);
+}
+#endif
+
+} // namespace teragon
+
+#endif // __PluginParameters_MappedBlobParameter_h__
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __PluginParameters_MappedFile_h__
+#define __PluginParameters_MappedFile_h__
+
+#include "DataParameter.h"
+
+#if WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace teragon {
+
+/**
+ * Read-only memory mapping of a file. Pages are only read from disk when they
+ * are first accessed, and mappings of the same file share their pages, also
+ * across plugin instances and processes.
+ */
+class MappedFile {
+public:
+    /**
+     * Map a file into memory.
+     *
+     * @param inPath Path of the file to map
+     * @param prefetch If true, ask the operating system to start reading the
+     *                 whole file in the background
+     * @return New mapping, or NULL if the file could not be mapped
+     */
+    static MappedFile *create(const ParameterString &inPath, bool prefetch = false) {
+#if WIN32
+        HANDLE file = CreateFileA(inPath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if(file == INVALID_HANDLE_VALUE) {
+            return NULL;
+        }
+        LARGE_INTEGER fileSize;
+        if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0) {
+            CloseHandle(file);
+            return NULL;
+        }
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        CloseHandle(file);
+        if(mapping == NULL) {
+            return NULL;
+        }
+        // The view keeps the mapping alive after its handle is closed
+        void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if(data == NULL) {
+            return NULL;
+        }
+        MappedFile *result = new MappedFile(inPath, data, (size_t)fileSize.QuadPart);
+#else
+        int file = open(inPath.c_str(), O_RDONLY);
+        if(file < 0) {
+            return NULL;
+        }
+        struct stat info;
+        if(fstat(file, &info) != 0 || info.st_size <= 0) {
+            close(file);
+            return NULL;
+        }
+        void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, file, 0);
+        close(file);
+        if(data == MAP_FAILED) {
+            return NULL;
+        }
+        MappedFile *result = new MappedFile(inPath, data, (size_t)info.st_size);
+#endif
+        if(prefetch) {
+            result->prefetch(0, result->size);
+        }
+        return result;
+    }
+
+    /**
+     * DataBufferDeleter which unmaps a file, where the context is the
+     * MappedFile returned by create()
+     */
+    static void unmapDeleter(void *inData, void *inContext) {
+        delete reinterpret_cast<MappedFile *>(inContext);
+    }
+
+    virtual ~MappedFile() {
+#if WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(data, size);
+#endif
+    }
+
+    /**
+     * Ask the operating system to read part of the file in the background,
+     * for instance the beginning of each sample. This has no effect on
+     * Windows, where pages are always read on first access.
+     *
+     * @param offset Offset of the first byte to read
+     * @param length Number of bytes to read
+     */
+    void prefetch(size_t offset, size_t length) const {
+#if !WIN32
+        if(offset >= size) {
+            return;
+        }
+        if(length > size - offset) {
+            length = size - offset;
+        }
+        // madvise() requires a page-aligned address
+        const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+        const size_t start = (offset / pageSize) * pageSize;
+        madvise(reinterpret_cast<char *>(data) + start, length + offset - start, MADV_WILLNEED);
+#endif
+    }
+
+    const void *getData() const {
+        return data;
+    }
+
+    size_t getSize() const {
+        return size;
+    }
+
+    const ParameterString &getPath() const {
+        return path;
+    }
+
+    /**
+     * Get a hash of the file's contents, see DataBuffer::computeHash(). The
+     * hash is calculated upon first use, which reads the whole file.
+     */
+    unsigned long long getContentHash() const {
+        unsigned long long result = contentHash;
+        if(result == 0) {
+            result = DataBuffer::computeHash(data, size);
+            contentHash = result;
+        }
+        return result;
+    }
+
+private:
+    MappedFile(const ParameterString &inPath, void *inData, size_t inSize) :
+    path(inPath), data(inData), size(inSize), contentHash(0) {}
+
+    // Disallow copy and assignment
+    MappedFile(const MappedFile &);
+    MappedFile &operator = (const MappedFile &);
+
+private:
+    const ParameterString path;
+    void *const data;
+    const size_t size;
+    // Zero until calculated, which may happen on any thread
+#if PLUGINPARAMETERS_MULTITHREADED
+    mutable std::atomic<unsigned long long> contentHash;
+#else
+    mutable unsigned long long contentHash;
+#endif
+};
+
+} // namespace teragon
+
+#endif // __PluginParameters_MappedFile_h__
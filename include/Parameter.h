@@ -26,13 +26,26 @@
 #ifndef __PluginParameters_Parameter_h__
 #define __PluginParameters_Parameter_h__
 
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <set>
 #include <string>
 #include <vector>
+#include "AlignedMemory.h"
+#if PLUGINPARAMETERS_MULTITHREADED
+#include <atomic>
+#include "tinythread/source/tinythread.h"
+#endif
 
 namespace teragon {
 
 typedef std::string ParameterString;
+#if PLUGINPARAMETERS_FLOAT_VALUES
+typedef float ParameterValue;
+#else
 typedef double ParameterValue;
+#endif
 
 static const unsigned int kDefaultDisplayPrecision = 2;
 
@@ -55,6 +68,305 @@ public:
 
 typedef std::vector<ParameterObserver *> ParameterObserverMap;
 
+#if PLUGINPARAMETERS_MULTITHREADED
+/**
+ * Determines how quickly changes to a parameter are applied when many events
+ * are queued. See ConcurrentParameterSet::add().
+ */
+typedef enum {
+    /** Changes are applied in the order in which they were made */
+    kParameterPriorityNormal,
+    /**
+     * Changes are applied before those of any normal priority parameters, for
+     * example for bypass or mute controls which must respond within one block
+     * even during a preset load.
+     */
+    kParameterPriorityUrgent
+} ParameterPriority;
+#endif
+
+// Cache line size which is assumed for all supported platforms
+static const size_t kParameterStateAlignment = 64;
+
+/**
+ * Mutable state of a parameter, which is written by the realtime thread on
+ * every change. Parameters keep this state in a separate allocation which
+ * occupies whole cache lines, so that writing a value does not invalidate the
+ * cache line holding the name, observers and other metadata that a GUI reads
+ * constantly, nor the state of any other parameter. In multithreaded builds,
+ * the fields written when scheduling a change are kept on a separate line
+ * from those written when applying it.
+ */
+class ParameterState {
+public:
+    static ParameterState *create(const ParameterValue inValue) {
+        return new(AlignedMemory::allocate(getAllocationSize(), kParameterStateAlignment)) ParameterState(inValue);
+    }
+
+    static void destroy(ParameterState *state) {
+        if(state != NULL) {
+            state->~ParameterState();
+            AlignedMemory::deallocate(state);
+        }
+    }
+
+    ParameterValue value;
+
+#if PLUGINPARAMETERS_MULTITHREADED
+    // The following fields are written by the threads which process events
+    unsigned long long appliedSequence;
+    // Used by the async and realtime EventDispatcher to coalesce overflowed events
+    unsigned long coalesceMarks[2];
+
+    // Keeps the fields below, which are written by the thread that schedules
+    // changes, off the cache line which the realtime thread writes and the GUI
+    // reads. A whole line is skipped, since the fields above are smaller than
+    // one line but their exact size depends on the platform.
+    char padding[kParameterStateAlignment];
+
+    // Each scheduled change gets the next sequence number, so that the realtime
+    // EventDispatcher can discard changes which arrive after a newer one was
+    // already applied.
+    std::atomic<unsigned long long> nextSequence;
+    // Sum of relative changes which have not been applied yet, and whether an
+    // event which will apply them is already queued
+    std::atomic<ParameterValue> pendingDelta;
+    std::atomic<bool> deltaScheduled;
+#endif
+
+private:
+    explicit ParameterState(const ParameterValue inValue) : value(inValue) {
+#if PLUGINPARAMETERS_MULTITHREADED
+        appliedSequence = 0;
+        nextSequence = 1;
+        pendingDelta = 0.0;
+        deltaScheduled = false;
+        coalesceMarks[0] = coalesceMarks[1] = 0;
+#endif
+    }
+
+    ~ParameterState() {}
+
+    // Round up to whole cache lines, so that no other allocation can share them
+    static size_t getAllocationSize() {
+        return ((sizeof(ParameterState) + kParameterStateAlignment - 1) /
+                kParameterStateAlignment) * kParameterStateAlignment;
+    }
+
+    // Disallow copy and assignment
+    ParameterState(const ParameterState &);
+    ParameterState &operator = (const ParameterState &);
+};
+
+/**
+ * Immutable description of a parameter: its name, range, unit and so on.
+ * Descriptors are interned in a process-wide pool, so that identical
+ * parameters (for instance, those of many instances of the same plugin) share
+ * a single descriptor, and each Parameter only owns its mutable state. The
+ * pool is split into shards by name, so that parameters with different names
+ * can be created on different threads without contending for a lock.
+ */
+class ParameterDescriptor {
+public:
+    ParameterDescriptor(const ParameterString &inName,
+                        const ParameterString &inUnit,
+                        const ParameterString &inDescription,
+                        ParameterValue inMinValue,
+                        ParameterValue inMaxValue,
+                        ParameterValue inDefaultValue,
+                        unsigned int inPrecision) :
+    name(inName), safeName(makeSafeName(inName)), unit(inUnit), description(inDescription),
+    minValue(inMinValue), maxValue(inMaxValue), defaultValue(inDefaultValue),
+    precision(inPrecision), shard(hashName(inName) % kNumShards), numReferences(0), position() {}
+
+    /**
+     * Copy the contents of another descriptor. The copy is not in the pool.
+     */
+    ParameterDescriptor(const ParameterDescriptor &other) :
+    name(other.name), safeName(other.safeName), unit(other.unit), description(other.description),
+    minValue(other.minValue), maxValue(other.maxValue), defaultValue(other.defaultValue),
+    precision(other.precision), shard(other.shard), numReferences(0), position() {}
+
+    /**
+     * Get a shared descriptor which is equal to the given one, creating it if
+     * necessary. Each call must be balanced by a call to release().
+     *
+     * @param prototype Descriptor to look up
+     * @return Shared descriptor, which remains valid until it is released
+     */
+    static const ParameterDescriptor *acquire(const ParameterDescriptor &prototype) {
+        Shard &shard = getPool().shards[prototype.shard];
+#if PLUGINPARAMETERS_MULTITHREADED
+        tthread::lock_guard<tthread::mutex> guard(shard.mutex);
+#endif
+        DescriptorSet::iterator iterator = shard.descriptors.find(&prototype);
+        const ParameterDescriptor *descriptor = NULL;
+        if(iterator != shard.descriptors.end()) {
+            descriptor = *iterator;
+        }
+        else {
+            descriptor = new ParameterDescriptor(prototype);
+            descriptor->position = shard.descriptors.insert(descriptor).first;
+        }
+        descriptor->numReferences++;
+        return descriptor;
+    }
+
+    /**
+     * Add a reference to a descriptor which is already in use, which is much
+     * cheaper than looking it up again with acquire(). Each call must be
+     * balanced by a call to release().
+     */
+    static const ParameterDescriptor *retain(const ParameterDescriptor *descriptor) {
+        // The caller holds a reference, so the descriptor cannot be deleted
+        descriptor->numReferences++;
+        return descriptor;
+    }
+
+    /**
+     * Release a descriptor returned by acquire(), which is deleted once it is
+     * no longer used by any parameter.
+     */
+    static void release(const ParameterDescriptor *descriptor) {
+        if(descriptor == NULL) {
+            return;
+        }
+#if PLUGINPARAMETERS_MULTITHREADED
+        // Only the last reference is released under the lock, since acquire()
+        // may find the descriptor in the pool until it has been removed
+        size_t numReferences = descriptor->numReferences.load();
+        while(numReferences > 1) {
+            if(descriptor->numReferences.compare_exchange_weak(numReferences, numReferences - 1)) {
+                return;
+            }
+        }
+#endif
+        Shard &shard = getPool().shards[descriptor->shard];
+#if PLUGINPARAMETERS_MULTITHREADED
+        tthread::lock_guard<tthread::mutex> guard(shard.mutex);
+#endif
+        if(--descriptor->numReferences == 0) {
+            shard.descriptors.erase(descriptor->position);
+            delete descriptor;
+        }
+    }
+
+    /**
+     * @return Number of distinct descriptors which are currently in use
+     */
+    static size_t getNumDescriptors() {
+        Pool &pool = getPool();
+        size_t result = 0;
+        for(size_t i = 0; i < kNumShards; i++) {
+#if PLUGINPARAMETERS_MULTITHREADED
+            tthread::lock_guard<tthread::mutex> guard(pool.shards[i].mutex);
+#endif
+            result += pool.shards[i].descriptors.size();
+        }
+        return result;
+    }
+
+    /**
+     * Get the serialized version of a string
+     *
+     * @param string The string to convert
+     * @return A string safe for serialization operations
+     */
+    static const ParameterString makeSafeName(const ParameterString &string) {
+        ParameterString result;
+        for(size_t i = 0; i < string.length(); ++i) {
+            if(((string[i] >= 'a' && string[i] <= 'z') ||
+                (string[i] >= '0' && string[i] <= '9') ||
+                (string[i] >= 'A' && string[i] <= 'Z'))) {
+                result += string[i];
+            }
+        }
+        return result;
+    }
+
+    const ParameterString name;
+    const ParameterString safeName;
+    const ParameterString unit;
+    const ParameterString description;
+    const ParameterValue minValue;
+    const ParameterValue maxValue;
+    const ParameterValue defaultValue;
+    const unsigned int precision;
+
+private:
+    static const size_t kNumShards = 16;
+
+    static size_t hashName(const ParameterString &name) {
+        size_t result = 5381;
+        for(size_t i = 0; i < name.size(); i++) {
+            result = result * 33 + (unsigned char)name[i];
+        }
+        return result;
+    }
+
+    class Compare {
+    public:
+        bool operator ()(const ParameterDescriptor *a, const ParameterDescriptor *b) const {
+            // Values are compared by their bits, which also orders NaN
+            int result = memcmp(&a->minValue, &b->minValue, sizeof(ParameterValue));
+            if(result == 0) {
+                result = memcmp(&a->maxValue, &b->maxValue, sizeof(ParameterValue));
+            }
+            if(result == 0) {
+                result = memcmp(&a->defaultValue, &b->defaultValue, sizeof(ParameterValue));
+            }
+            if(result == 0 && a->precision != b->precision) {
+                return a->precision < b->precision;
+            }
+            if(result == 0) {
+                result = a->name.compare(b->name);
+            }
+            if(result == 0) {
+                result = a->unit.compare(b->unit);
+            }
+            if(result == 0) {
+                result = a->description.compare(b->description);
+            }
+            return result < 0;
+        }
+    };
+
+    typedef std::set<const ParameterDescriptor *, Compare> DescriptorSet;
+
+    class Shard {
+    public:
+        DescriptorSet descriptors;
+#if PLUGINPARAMETERS_MULTITHREADED
+        tthread::mutex mutex;
+#endif
+    };
+
+    class Pool {
+    public:
+        Shard shards[kNumShards];
+    };
+
+    static Pool &getPool() {
+        // Never deleted, since parameters in other static objects may still
+        // release their descriptors while the process exits
+        static Pool *pool = new Pool();
+        return *pool;
+    }
+
+    // Disallow assignment operator
+    ParameterDescriptor &operator = (const ParameterDescriptor &);
+
+private:
+    const size_t shard;
+#if PLUGINPARAMETERS_MULTITHREADED
+    mutable std::atomic<size_t> numReferences;
+#else
+    mutable size_t numReferences;
+#endif
+    // Only accessed while holding the shard's mutex
+    mutable DescriptorSet::iterator position;
+};
+
 class Parameter {
 public:
     /**
@@ -63,8 +375,13 @@ public:
      * @param inName The parameter name
      */
     Parameter(const ParameterString &inName) :
-    name(inName), unit(""), minValue(0.0), maxValue(1.0), defaultValue(0.0), value(0.0),
-    precision(kDefaultDisplayPrecision), description("") {}
+    descriptor(ParameterDescriptor::acquire(ParameterDescriptor(inName, "", "", 0.0, 1.0, 0.0,
+                                                                kDefaultDisplayPrecision))),
+    state(ParameterState::create(0.0)) {
+#if PLUGINPARAMETERS_MULTITHREADED
+        priority = kParameterPriorityNormal;
+#endif
+    }
 
     /**
       * Create a new floating point parameter. This is probably the most common
@@ -88,27 +405,50 @@ public:
               ParameterValue inMinValue,
               ParameterValue inMaxValue,
               ParameterValue inDefaultValue) :
-    name(inName), unit(""), minValue(inMinValue), maxValue(inMaxValue), defaultValue(inDefaultValue),
-    value(inDefaultValue), precision(kDefaultDisplayPrecision), description("") {}
+    descriptor(ParameterDescriptor::acquire(ParameterDescriptor(inName, "", "", inMinValue, inMaxValue,
+                                                                inDefaultValue, kDefaultDisplayPrecision))),
+    state(ParameterState::create(inDefaultValue)) {
+#if PLUGINPARAMETERS_MULTITHREADED
+        priority = kParameterPriorityNormal;
+#endif
+    }
 
-    virtual ~Parameter() {}
+    /**
+     * Create a copy of this parameter, with the same name, range and other
+     * metadata, and a value which is reset to the default value. Observers are
+     * not copied. This is used to build new parameter sets from a prototype,
+     * see ParameterSet::cloneFrom().
+     *
+     * @return New parameter, or NULL if this parameter type cannot be cloned
+     */
+    virtual Parameter *clone() const {
+        return NULL;
+    }
+
+    virtual ~Parameter() {
+        ParameterState::destroy(state);
+        ParameterDescriptor::release(descriptor);
+    }
 
     /**
-     * @return The parameter's display name
+     * @return The parameter's display name. The reference is only valid until
+     *         the parameter's unit, description or precision is changed,
+     *         since those replace the descriptor holding the name.
      */
     const ParameterString &getName() const {
-        return name;
+        return descriptor->name;
     }
 
     /**
      * Get the parameter's name for serialization operations. All characters which
      * are not in the A-Z, a-z, 0-9 range are simply removed.
      *
-     * @return A the parameter's name, safe for serialization operations
+     * @return A the parameter's name, safe for serialization operations. As
+     *         with getName(), the reference is only valid until the unit,
+     *         description or precision is changed.
      */
-
-    const ParameterString getSafeName() const {
-        return makeSafeName(name);
+    const ParameterString &getSafeName() const {
+        return descriptor->safeName;
     }
 
     /**
@@ -118,15 +458,7 @@ public:
      * @return A string safe for serialization operations
      */
     static const ParameterString makeSafeName(const ParameterString &string) {
-        ParameterString result;
-        for(size_t i = 0; i < string.length(); ++i) {
-            if(((string[i] >= 'a' && string[i] <= 'z') ||
-                (string[i] >= '0' && string[i] <= '9') ||
-                (string[i] >= 'A' && string[i] <= 'Z'))) {
-                result += string[i];
-            }
-        }
-        return result;
+        return ParameterDescriptor::makeSafeName(string);
     }
 
     /**
@@ -144,12 +476,24 @@ public:
      * and maximum values set in the constructor.
      */
     virtual const ParameterValue getValue() const {
-        return value;
+        return state->value;
     }
 
 #if PLUGINPARAMETERS_MULTITHREADED
+    /**
+     * @return The priority which was given when adding this parameter to a
+     *         ConcurrentParameterSet
+     */
+    ParameterPriority getPriority() const {
+        return priority;
+    }
+
     friend class Event;
     friend class ScaledEvent;
+    friend class DeltaEvent;
+    friend class CompareAndSetEvent;
+    friend class EventDispatcher;
+    friend class ConcurrentParameterSet;
 
     // The multi-threaded version shouldn't allow parameters to have their value
     // be directly set in this manner. Instead, all parameter setting must be
@@ -167,9 +511,8 @@ protected:
      * @param value Value, which must be between the minimum and maximum values
      */
     virtual void setValue(const ParameterValue inValue) {
-        // TODO: Possible ABA problem here
-        if(value != inValue) {
-            value = inValue;
+        if(state->value != inValue) {
+            state->value = inValue;
             notifyObservers();
         }
     }
@@ -189,28 +532,28 @@ public:
      * @return Get the parameter's minimum value
      */
     virtual const ParameterValue getMinValue() const {
-        return minValue;
+        return descriptor->minValue;
     }
 
     /**
      * @return Get the parameter's maximum value
      */
     virtual const ParameterValue getMaxValue() const {
-        return maxValue;
+        return descriptor->maxValue;
     }
 
     /**
      * @return Get the parameter's initial default value. Useful for resetting parameters.
      */
     virtual const ParameterValue getDefaultValue() const {
-        return defaultValue;
+        return descriptor->defaultValue;
     }
 
     /**
      * Get the number of decimal places for displaying floating-point parameter values.
      */
     virtual const unsigned int getDisplayPrecision() const {
-        return precision;
+        return descriptor->precision;
     }
 
     /**
@@ -220,15 +563,18 @@ public:
      * @param inPrecision Number of decimal digits to display
      */
     virtual void setDisplayPrecision(unsigned int inPrecision) {
-        this->precision = inPrecision;
+        setDescriptor(ParameterDescriptor(descriptor->name, descriptor->unit, descriptor->description,
+                                          descriptor->minValue, descriptor->maxValue,
+                                          descriptor->defaultValue, inPrecision));
     }
 
     /**
      * Get the unit string for the parameter. This is generally used by getDisplayText(),
-     * and is by default an empty string.
+     * and is by default an empty string. The reference is only valid until the
+     * unit, description or precision is changed.
      */
     virtual const ParameterString &getUnit() const {
-        return unit;
+        return descriptor->unit;
     }
 
     /**
@@ -238,15 +584,19 @@ public:
      * @param inUnit Unit string to display
      */
     virtual void setUnit(const ParameterString &inUnit) {
-        this->unit = inUnit;
+        setDescriptor(ParameterDescriptor(descriptor->name, inUnit, descriptor->description,
+                                          descriptor->minValue, descriptor->maxValue,
+                                          descriptor->defaultValue, descriptor->precision));
     }
 
     /**
      * Get the parameter description, which is a string that describes what the function of
      * the parameter is. This can be used to provide user-facing help for parameters.
+     * The reference is only valid until the unit, description or precision is
+     * changed.
      */
     const ParameterString &getDescription() const {
-        return description;
+        return descriptor->description;
     }
 
     /**
@@ -255,7 +605,17 @@ public:
      * @param description Parameter description
      */
     void setDescription(const ParameterString &inDescription) {
-        this->description = inDescription;
+        setDescriptor(ParameterDescriptor(descriptor->name, descriptor->unit, inDescription,
+                                          descriptor->minValue, descriptor->maxValue,
+                                          descriptor->defaultValue, descriptor->precision));
+    }
+
+    /**
+     * @return The descriptor holding this parameter's name, range and other
+     *         metadata, which may be shared with other parameters
+     */
+    const ParameterDescriptor *getDescriptor() const {
+        return descriptor;
     }
 
     /**
@@ -319,6 +679,18 @@ protected:
 #endif
     }
 
+    /**
+     * Copy constructor for clone(). The copy shares the original's descriptor,
+     * but gets its own state, holding the default value.
+     */
+    Parameter(const Parameter &other) :
+    descriptor(ParameterDescriptor::retain(other.descriptor)), observers(),
+    state(ParameterState::create(other.descriptor->defaultValue)) {
+#if PLUGINPARAMETERS_MULTITHREADED
+        priority = other.priority;
+#endif
+    }
+
 private:
     // Disallow assignment operator. It doesn't really make sense to try
     // to assign one parameter to another, and if this is allowed then we
@@ -328,16 +700,26 @@ private:
     }
 
 private:
-    const ParameterString name;
-    ParameterString unit;
-    const ParameterValue minValue;
-    const ParameterValue maxValue;
-    const ParameterValue defaultValue;
-    ParameterValue value;
-    unsigned int precision;
-    ParameterString description;
+    /**
+     * Replace the descriptor with a shared one which is equal to the given
+     * descriptor. Since descriptors are immutable, this is how metadata such
+     * as the unit is changed.
+     */
+    void setDescriptor(const ParameterDescriptor &prototype) {
+        const ParameterDescriptor *previous = descriptor;
+        descriptor = ParameterDescriptor::acquire(prototype);
+        ParameterDescriptor::release(previous);
+    }
 
+private:
+    const ParameterDescriptor *descriptor;
     ParameterObserverMap observers;
+
+#if PLUGINPARAMETERS_MULTITHREADED
+    ParameterPriority priority;
+#endif
+
+    ParameterState *const state;
 };
 
 } // namespace teragon
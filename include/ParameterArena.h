@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PluginParameters_ParameterArena_h__
+#define __PluginParameters_ParameterArena_h__
+
+#include <stdlib.h>
+#include <algorithm>
+#include <new>
+#include <vector>
+
+namespace teragon {
+
+// Allocation sizes are rounded up to a multiple of this value, so that every
+// allocation is as well aligned as the chunks returned by malloc()
+static const size_t kParameterArenaAlignment = 16;
+static const size_t kParameterArenaDefaultChunkSize = 64 * 1024;
+
+/**
+ * Simple bump allocator which places parameters next to each other in large
+ * chunks of memory. Memory is never returned to the arena individually, and
+ * instead all chunks are freed at once by release(). Note that the arena does
+ * not call any destructors, this is the responsibility of the ParameterSet
+ * which owns it.
+ */
+class ParameterArena {
+public:
+    explicit ParameterArena(size_t inChunkSize = kParameterArenaDefaultChunkSize) :
+    chunkSize(inChunkSize), chunks(), current(NULL), remaining(0) {}
+
+    virtual ~ParameterArena() {
+        release();
+    }
+
+    /**
+     * Allocate memory from the current chunk, or from a new chunk if the
+     * current one is full.
+     *
+     * @param size Number of bytes to allocate
+     * @return Pointer to memory which is suitably aligned for any parameter
+     */
+    void *allocate(size_t size) {
+        size = ((size + kParameterArenaAlignment - 1) / kParameterArenaAlignment) * kParameterArenaAlignment;
+        if(size > remaining) {
+            addChunk(size > chunkSize ? size : chunkSize);
+        }
+        void *result = current;
+        current += size;
+        remaining -= size;
+        return result;
+    }
+
+    /**
+     * @return True if the pointer was returned by allocate()
+     */
+    bool owns(const void *pointer) const {
+        // Chunks are sorted by address, so find the last one starting at or
+        // before the pointer
+        const char *address = reinterpret_cast<const char *>(pointer);
+        ChunkList::const_iterator iterator = std::upper_bound(chunks.begin(), chunks.end(), address, isBefore);
+        if(iterator == chunks.begin()) {
+            return false;
+        }
+        --iterator;
+        return address < iterator->memory + iterator->size;
+    }
+
+    /**
+     * Free all chunks. Any objects which were constructed in the arena must
+     * have been destroyed beforehand.
+     */
+    void release() {
+        for(ChunkList::iterator iterator = chunks.begin(); iterator != chunks.end(); ++iterator) {
+            free(iterator->memory);
+        }
+        chunks.clear();
+        current = NULL;
+        remaining = 0;
+    }
+
+private:
+    class Chunk {
+    public:
+        Chunk(char *inMemory, size_t inSize) : memory(inMemory), size(inSize) {}
+
+        char *memory;
+        size_t size;
+    };
+
+    typedef std::vector<Chunk> ChunkList;
+
+    static bool isBefore(const char *address, const Chunk &chunk) {
+        return address < chunk.memory;
+    }
+
+    void addChunk(size_t size) {
+        char *memory = reinterpret_cast<char *>(malloc(size));
+        if(memory == NULL) {
+            throw std::bad_alloc();
+        }
+        chunks.insert(std::upper_bound(chunks.begin(), chunks.end(), memory, isBefore), Chunk(memory, size));
+        current = memory;
+        remaining = size;
+    }
+
+    // Disallow copy and assignment
+    ParameterArena(const ParameterArena &);
+    ParameterArena &operator = (const ParameterArena &);
+
+private:
+    const size_t chunkSize;
+    ChunkList chunks;
+    char *current;
+    size_t remaining;
+};
+
+} // namespace teragon
+
+#endif // __PluginParameters_ParameterArena_h__
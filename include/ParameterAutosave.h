@@ -0,0 +1,381 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __PluginParameters_ParameterAutosave_h__
+#define __PluginParameters_ParameterAutosave_h__
+
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "ConcurrentParameterSet.h"
+#include "JsonState.h"
+
+#if PLUGINPARAMETERS_MULTITHREADED
+#if WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#endif
+
+namespace teragon {
+
+#if PLUGINPARAMETERS_MULTITHREADED
+/**
+ * Saves the state of a ConcurrentParameterSet to a file in the background, so
+ * that the state can be recovered after a crash. The autosave observes every
+ * parameter in the set, and copies each change on the set's asynchronous
+ * thread. Its own low-priority thread then writes the copied values as JSON
+ * (see JsonStateWriter) at most once per interval, no matter how often the
+ * parameters change. Neither the GUI nor the realtime thread ever waits for
+ * the disk, and the asynchronous thread only waits while the changes which
+ * arrived since the last write are handed over.
+ *
+ * The file is replaced atomically by writing a temporary file and renaming it,
+ * so that a crash during the write leaves the previous state intact. The state
+ * can be restored with JsonStateReader.
+ *
+ * The autosave must be created after all parameters have been added to the
+ * set, and destroyed before the set.
+ */
+class ParameterAutosave : public ParameterObserver {
+public:
+    /**
+     * @param inParameters Parameter set to save
+     * @param inPath Path of the state file
+     * @param inIntervalMilliseconds Minimum time between two writes
+     */
+    ParameterAutosave(ConcurrentParameterSet &inParameters, const ParameterString &inPath,
+                      unsigned long inIntervalMilliseconds = 1000) :
+    ParameterObserver(), path(inPath),
+    intervalNanoseconds((unsigned long long)inIntervalMilliseconds * 1000000ull),
+    parameters(), indexes(), savedValues(), pendingValues(), isPending(), pendingIndexes(),
+    thread(NULL), numChanges(0), numWrites(0), numPendingChanges(0),
+    lastWriteTime(EventClock::now()), killed(false) {
+        for(size_t i = 0; i < inParameters.size(); i++) {
+            Parameter *parameter = inParameters.get((int)i);
+            // Void parameters have no state
+            if(dynamic_cast<VoidParameter *>(parameter) == NULL) {
+                indexes[parameter] = parameters.size();
+                parameters.push_back(parameter);
+            }
+        }
+        savedValues.resize(parameters.size());
+        pendingValues.resize(parameters.size());
+        isPending.resize(parameters.size(), false);
+        pendingIndexes.reserve(parameters.size());
+        for(size_t i = 0; i < parameters.size(); i++) {
+            copyValue(parameters.at(i), savedValues.at(i));
+            parameters.at(i)->addObserver(this);
+        }
+        thread = new EventDispatcherThread(autosaveCallback, this);
+        thread->set_name("PluginParametersAutosave");
+        thread->set_low_priority();
+    }
+
+    /**
+     * Stop the autosave thread, and write any changes which have not been
+     * saved yet.
+     */
+    virtual ~ParameterAutosave() {
+        for(size_t i = 0; i < parameters.size(); i++) {
+            parameters.at(i)->removeObserver(this);
+        }
+        {
+            EventDispatcherLockGuard guard(mutex);
+            killed = true;
+            condition.notify_all();
+        }
+        thread->join();
+        delete thread;
+        flush();
+    }
+
+    virtual bool isRealtimePriority() const {
+        return false;
+    }
+
+    /**
+     * Called on the set's asynchronous thread, where the data of a parameter
+     * cannot be replaced while it is being copied. The value is copied before
+     * the lock is taken, and then only swapped into place.
+     */
+    virtual void onParameterUpdated(const Parameter *parameter) {
+        ParameterIndexMap::const_iterator iterator = indexes.find(parameter);
+        if(iterator == indexes.end()) {
+            return;
+        }
+        const size_t index = iterator->second;
+        SavedValue value;
+        copyValue(parameter, value);
+
+        EventDispatcherLockGuard guard(mutex);
+        pendingValues.at(index).swap(value);
+        if(!isPending.at(index)) {
+            isPending.at(index) = true;
+            pendingIndexes.push_back(index);
+        }
+        numChanges++;
+        if(numPendingChanges++ == 0) {
+            condition.notify_one();
+        }
+    }
+
+    /**
+     * Write any changes which have not been saved yet on the calling thread,
+     * for instance when the plugin is closed.
+     *
+     * @return False if the state file could not be written
+     */
+    bool flush() {
+        EventDispatcherLockGuard guard(writeMutex);
+        {
+            // Only the changed values are handed over with the lock held, and
+            // the state is serialized after it has been released.
+            EventDispatcherLockGuard snapshotGuard(mutex);
+            if(numPendingChanges == 0) {
+                return true;
+            }
+            for(size_t i = 0; i < pendingIndexes.size(); i++) {
+                const size_t index = pendingIndexes.at(i);
+                savedValues.at(index).swap(pendingValues.at(index));
+                isPending.at(index) = false;
+            }
+            pendingIndexes.clear();
+            numPendingChanges = 0;
+        }
+
+        std::string contents;
+        StringStateOutput output(contents);
+        JsonStateWriter writer(output);
+        writer.begin();
+        for(size_t i = 0; i < parameters.size(); i++) {
+            writeValue(writer, parameters.at(i)->getSafeName(), savedValues.at(i));
+        }
+        writer.end();
+
+        const bool result = writeFile(path, contents);
+        EventDispatcherLockGuard snapshotGuard(mutex);
+        lastWriteTime = EventClock::now();
+        if(result) {
+            numWrites++;
+        }
+        return result;
+    }
+
+    /**
+     * @return Number of parameter changes which were observed
+     */
+    size_t getNumChanges() {
+        EventDispatcherLockGuard guard(mutex);
+        return numChanges;
+    }
+
+    /**
+     * @return Number of times that the state file was written
+     */
+    size_t getNumWrites() {
+        EventDispatcherLockGuard guard(mutex);
+        return numWrites;
+    }
+
+    const ParameterString &getPath() const {
+        return path;
+    }
+
+    /**
+     * Replace a file atomically, so that readers either see the old or the new
+     * contents, even if the process crashes during the write.
+     *
+     * @param inPath Path of the file to replace
+     * @param contents New file contents
+     * @return True if the file was replaced
+     */
+    static bool writeFile(const ParameterString &inPath, const std::string &contents) {
+        const ParameterString temporaryPath = inPath + ".tmp";
+        FILE *file = fopen(temporaryPath.c_str(), "wb");
+        if(file == NULL) {
+            return false;
+        }
+        bool result = fwrite(contents.data(), 1, contents.size(), file) == contents.size() &&
+                      fflush(file) == 0;
+        // Make sure that the data is on disk before the rename is
+#if WIN32
+        result = result && _commit(_fileno(file)) == 0;
+#else
+        result = result && fsync(fileno(file)) == 0;
+#endif
+        result = fclose(file) == 0 && result;
+#if WIN32
+        result = result && MoveFileExA(temporaryPath.c_str(), inPath.c_str(),
+                                       MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        result = result && rename(temporaryPath.c_str(), inPath.c_str()) == 0;
+#endif
+        if(!result) {
+            remove(temporaryPath.c_str());
+        }
+        return result;
+    }
+
+private:
+    static void autosaveCallback(void *arg) {
+        ParameterAutosave *autosave = reinterpret_cast<ParameterAutosave *>(arg);
+        while(true) {
+            unsigned long long deadline = 0;
+            {
+                EventDispatcherLockGuard guard(autosave->mutex);
+                while(autosave->numPendingChanges == 0 && !autosave->killed) {
+                    autosave->condition.wait(autosave->mutex);
+                }
+                if(autosave->killed) {
+                    return;
+                }
+                deadline = autosave->lastWriteTime + autosave->intervalNanoseconds;
+            }
+
+            // Changes which arrive until the deadline are written together. The
+            // destructor notifies the condition, so that it does not have to
+            // wait for the deadline.
+            {
+                EventDispatcherLockGuard guard(autosave->mutex);
+                while(!autosave->killed && EventClock::now() < deadline) {
+                    waitForCondition(autosave->condition, autosave->mutex, deadline);
+                }
+                if(autosave->killed) {
+                    return;
+                }
+            }
+            autosave->flush();
+        }
+    }
+
+    typedef enum {
+        kSavedNumber,
+        kSavedBoolean,
+        kSavedString,
+        kSavedBlob,
+        kSavedMappedFile
+    } SavedValueType;
+
+    // Copy of a parameter's value, in the form in which it is written
+    class SavedValue {
+    public:
+        SavedValue() : type(kSavedNumber), value(0.0), data(), hasData(false), contentHash(0) {}
+
+        void swap(SavedValue &other) {
+            std::swap(type, other.type);
+            std::swap(value, other.value);
+            data.swap(other.data);
+            std::swap(hasData, other.hasData);
+            std::swap(contentHash, other.contentHash);
+        }
+
+        SavedValueType type;
+        ParameterValue value;
+        // Contents of a string or blob, or the path of a mapped file
+        std::string data;
+        bool hasData;
+        unsigned long long contentHash;
+    };
+
+    static void copyValue(const Parameter *parameter, SavedValue &result) {
+        const DataParameter *dataParameter = dynamic_cast<const DataParameter *>(parameter);
+        if(dataParameter != NULL && dataParameter->getBackingFile(result.data, result.contentHash)) {
+            // Keep the reference to the file, rather than saving its contents
+            result.type = kSavedMappedFile;
+            return;
+        }
+
+        if(dataParameter != NULL) {
+            const DataBuffer *current = dataParameter->getBuffer();
+            result.type = dynamic_cast<const BlobParameter *>(parameter) != NULL ? kSavedBlob : kSavedString;
+            result.hasData = current != NULL;
+            result.data.assign(current != NULL ? current->getData() : "", current != NULL ? current->getSize() : 0);
+        }
+        else {
+            result.type = dynamic_cast<const BooleanParameter *>(parameter) != NULL ? kSavedBoolean : kSavedNumber;
+            result.value = parameter->getValue();
+        }
+    }
+
+    static void writeValue(JsonStateWriter &writer, const ParameterString &safeName, const SavedValue &value) {
+        switch(value.type) {
+            case kSavedNumber:
+                writer.writeNumber(safeName, value.value);
+                break;
+            case kSavedBoolean:
+                writer.writeBoolean(safeName, value.value > 0.5);
+                break;
+            case kSavedString:
+                writer.writeString(safeName, value.data.data(), value.data.size());
+                break;
+            case kSavedBlob:
+                writer.writeBlob(safeName, value.hasData ? value.data.data() : NULL, value.data.size());
+                break;
+            case kSavedMappedFile:
+                writer.writeMappedFile(safeName, value.data, value.contentHash);
+                break;
+        }
+    }
+
+    typedef std::map<const Parameter *, size_t> ParameterIndexMap;
+
+    // Disallow copy and assignment
+    ParameterAutosave(const ParameterAutosave &);
+    ParameterAutosave &operator = (const ParameterAutosave &);
+
+private:
+    const ParameterString path;
+    const unsigned long long intervalNanoseconds;
+    // Observed parameters, and their indexes in the lists of values
+    std::vector<Parameter *> parameters;
+    ParameterIndexMap indexes;
+    // Values which were last written, only accessed with writeMutex held
+    std::vector<SavedValue> savedValues;
+    // Values which changed since the last write, only accessed with the mutex held
+    std::vector<SavedValue> pendingValues;
+    std::vector<bool> isPending;
+    std::vector<size_t> pendingIndexes;
+    EventDispatcherThread *thread;
+    EventDispatcherMutex mutex;
+    EventDispatcherConditionVariable condition;
+    // Held while writing the file, so that writes happen in order
+    EventDispatcherMutex writeMutex;
+    size_t numChanges;
+    size_t numWrites;
+    size_t numPendingChanges;
+    unsigned long long lastWriteTime;
+    bool killed;
+};
+#endif // PLUGINPARAMETERS_MULTITHREADED
+
+} // namespace teragon
+
+#endif // __PluginParameters_ParameterAutosave_h__
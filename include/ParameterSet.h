@@ -26,9 +26,11 @@
 #ifndef __PluginParameters_PluginParameterSet_h__
 #define __PluginParameters_PluginParameterSet_h__
 
+#include <algorithm>
 #include <map>
 #include <vector>
 #include "Parameter.h"
+#include "ParameterArena.h"
 
 namespace teragon {
 
@@ -40,7 +42,7 @@ protected:
 #else
 public:
 #endif
-    explicit ParameterSet() {}
+    explicit ParameterSet() : arena() {}
 
 #if PLUGINPARAMETERS_MULTITHREADED
 public:
@@ -48,8 +50,9 @@ public:
     virtual ~ParameterSet() {
         // Delete all parameters added to the set
         for(size_t i = 0; i < size(); i++) {
-            delete parameterList.at(i);
+            destroy(parameterList.at(i));
         }
+        arena.release();
     }
 
     /**
@@ -63,12 +66,122 @@ public:
      *         adding a parameter to a set twice is considered failing behavior.
      */
     virtual Parameter *add(Parameter *parameter) {
-        if(parameter == NULL || get(parameter->getName()) != NULL) {
-            return NULL;
+        return insert(parameter) ? parameter : NULL;
+    }
+
+    /**
+     * Add many parameters to the set at once. This is faster than calling
+     * add() for each parameter, since memory for the whole list is reserved
+     * up front. As with add(), parameters which could not be added because
+     * their name is already used are *not* owned by the set.
+     *
+     * @param parameters Parameters to add
+     * @return Number of parameters which were added
+     */
+    virtual size_t addAll(const std::vector<Parameter *> &parameters) {
+        parameterList.reserve(parameterList.size() + parameters.size());
+        size_t result = 0;
+        for(std::vector<Parameter *>::const_iterator iterator = parameters.begin();
+            iterator != parameters.end(); ++iterator) {
+            if(insert(*iterator)) {
+                result++;
+            }
         }
-        parameterMap.insert(std::make_pair(parameter->getSafeName(), parameter));
-        parameterList.push_back(parameter);
-        return parameter;
+        return result;
+    }
+
+    /**
+     * Add a copy of each parameter in another set, see Parameter::clone().
+     * The copies have the same names, ranges and metadata as the prototype's
+     * parameters, but their values are reset to the defaults. This is the
+     * fastest way to create many instances of the same plugin, since the
+     * prototype's names have already been converted and sorted.
+     *
+     * @param prototype Set to copy the parameters from
+     * @return Number of parameters which were added. If any of the prototype's
+     *         parameters cannot be cloned, then nothing is added and this
+     *         method returns 0, since the indexes of the copies would otherwise
+     *         not match those in the prototype.
+     */
+    virtual size_t cloneFrom(const ParameterSet &prototype) {
+        ClonePairList clonePairs;
+        clonePairs.reserve(prototype.size());
+        for(size_t i = 0; i < prototype.size(); i++) {
+            Parameter *clone = prototype.parameterList[i]->clone();
+            if(clone == NULL) {
+                for(ClonePairList::iterator pair = clonePairs.begin(); pair != clonePairs.end(); ++pair) {
+                    delete pair->second;
+                }
+                return 0;
+            }
+            clonePairs.push_back(ClonePair(prototype.parameterList[i], clone));
+        }
+
+        if(!parameterList.empty()) {
+            // Names must be checked against the existing parameters
+            parameterList.reserve(parameterList.size() + clonePairs.size());
+            size_t result = 0;
+            for(ClonePairList::iterator pair = clonePairs.begin(); pair != clonePairs.end(); ++pair) {
+                if(insert(pair->second)) {
+                    result++;
+                }
+                else {
+                    delete pair->second;
+                }
+            }
+            return result;
+        }
+
+        // The set is empty, so the prototype's sorted map can be copied with
+        // only the values replaced, rather than inserting each name again.
+        parameterList.reserve(clonePairs.size());
+        for(ClonePairList::iterator pair = clonePairs.begin(); pair != clonePairs.end(); ++pair) {
+            parameterList.push_back(pair->second);
+        }
+        std::sort(clonePairs.begin(), clonePairs.end());
+        for(ParameterMap::const_iterator iterator = prototype.parameterMap.begin();
+            iterator != prototype.parameterMap.end(); ++iterator) {
+            ClonePairList::const_iterator pair = std::lower_bound(clonePairs.begin(), clonePairs.end(),
+                                                                  ClonePair(iterator->second, NULL));
+            if(pair != clonePairs.end() && pair->first == iterator->second) {
+                parameterMap.insert(parameterMap.end(), std::make_pair(iterator->first, pair->second));
+            }
+        }
+        return parameterList.size();
+    }
+
+    /**
+     * Construct a parameter in memory owned by this set and add it to the set.
+     * Parameters created in this way are placed next to each other in large
+     * chunks of memory, which makes constructing, iterating over and destroying
+     * large sets much faster than allocating each parameter on the heap. The
+     * memory is released at once when the set is cleared or destroyed.
+     *
+     * For example: parameters.emplace<FloatParameter>("Gain", 0.0, 1.0, 0.5)
+     *
+     * @param name The parameter's name, followed by the remaining arguments of
+     *             the parameter type's constructor
+     * @return The parameter which was added, or NULL if a parameter with the
+     *         same name already exists in the set
+     */
+    template<class T>
+    T *emplace(const ParameterString &name) {
+        return addEmplaced(new(arena.allocate(sizeof(T))) T(name));
+    }
+
+    template<class T, class A1>
+    T *emplace(const ParameterString &name, const A1 &a1) {
+        return addEmplaced(new(arena.allocate(sizeof(T))) T(name, a1));
+    }
+
+    template<class T, class A1, class A2>
+    T *emplace(const ParameterString &name, const A1 &a1, const A2 &a2) {
+        return addEmplaced(new(arena.allocate(sizeof(T))) T(name, a1, a2));
+    }
+
+    template<class T, class A1, class A2, class A3>
+    T *emplace(const ParameterString &name, const A1 &a1, const A2 &a2, const A3 &a3) {
+        return addEmplaced(new(arena.allocate(sizeof(T))) T(name, a1, a2, a3));
     }
 
     /**
@@ -81,10 +194,27 @@ public:
 
     virtual void clear() {
         for(ParameterList::iterator iterator = parameterList.begin(); iterator != parameterList.end(); ++iterator) {
-            delete *iterator;
+            destroy(*iterator);
         }
         parameterList.clear();
         parameterMap.clear();
+        arena.release();
+    }
+
+    /**
+     * Copy the values of all parameters into an array, for instance to pass
+     * them to DSP code or a ParameterSmoother in one go.
+     *
+     * @param values Array to receive the values
+     * @param maxValues Size of the array
+     * @return Number of values which were copied
+     */
+    virtual size_t getValues(ParameterValue *values, size_t maxValues) const {
+        const size_t numValues = maxValues < parameterList.size() ? maxValues : parameterList.size();
+        for(size_t i = 0; i < numValues; i++) {
+            values[i] = parameterList[i]->getValue();
+        }
+        return numValues;
     }
 
     /**
@@ -130,12 +260,62 @@ public:
         return (iterator != parameterMap.end()) ? iterator->second : NULL;
     }
 
+    /**
+     * Lookup a parameter by the name returned by Parameter::getSafeName(),
+     * which avoids converting the name again, for instance when reading
+     * serialized state.
+     *
+     * @param safeName The parameter's safe name
+     * @return Reference to parameter, or NULL if not found
+     */
+    virtual Parameter *getBySafeName(const ParameterString &safeName) const {
+        ParameterMap::const_iterator iterator = parameterMap.find(safeName);
+        return (iterator != parameterMap.end()) ? iterator->second : NULL;
+    }
+
 protected:
     typedef std::map<ParameterString, Parameter *> ParameterMap;
     typedef std::vector<Parameter *> ParameterList;
 
     ParameterMap parameterMap;
     ParameterList parameterList;
+
+private:
+    typedef std::pair<const Parameter *, Parameter *> ClonePair;
+    typedef std::vector<ClonePair> ClonePairList;
+
+    // Adds a parameter with a single lookup of its safe name
+    bool insert(Parameter *parameter) {
+        if(parameter == NULL) {
+            return false;
+        }
+        if(!parameterMap.insert(std::make_pair(parameter->getSafeName(), parameter)).second) {
+            return false;
+        }
+        parameterList.push_back(parameter);
+        return true;
+    }
+
+    template<class T>
+    T *addEmplaced(T *parameter) {
+        if(add(parameter) == NULL) {
+            // The memory itself is reclaimed when the arena is released
+            parameter->~T();
+            return NULL;
+        }
+        return parameter;
+    }
+
+    void destroy(Parameter *parameter) {
+        if(arena.owns(parameter)) {
+            parameter->~Parameter();
+        }
+        else {
+            delete parameter;
+        }
+    }
+
+    ParameterArena arena;
 };
 
 } // namespace teragon
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PluginParameters_ParameterSmoother_h__
+#define __PluginParameters_ParameterSmoother_h__
+
+#include <string.h>
+#include "AlignedMemory.h"
+#include "ParameterSet.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+// Only used within this header
+#define PLUGINPARAMETERS_SMOOTHER_SSE2 1
+#endif
+
+namespace teragon {
+
+// Values are padded to a multiple of the widest SIMD vector (8 floats for AVX),
+// and aligned accordingly, so that no scalar loop is needed for the remainder.
+static const size_t kParameterSmootherLanes = 8;
+static const size_t kParameterSmootherAlignment = 32;
+
+/**
+ * Smooths the values of many parameters at once, so that sudden changes do
+ * not cause zipper noise. Each call to process() moves all values a fixed
+ * fraction of the remaining distance towards their targets (a one-pole
+ * lowpass filter), using AVX or SSE2 instructions when the compiler targets
+ * them. With PLUGINPARAMETERS_FLOAT_VALUES, each AVX instruction processes
+ * eight parameters rather than four.
+ *
+ * This class does no locking or memory allocation after construction, and so
+ * it is safe to use from the realtime thread.
+ */
+class ParameterSmoother {
+public:
+    /**
+     * @param inNumValues Number of values to smooth, usually the size of the
+     *                    parameter set which provides the targets
+     * @param inCoefficient Fraction of the distance to the target which is
+     *                      covered by each step, between 0.0 and 1.0
+     */
+    ParameterSmoother(size_t inNumValues, ParameterValue inCoefficient) :
+    numValues(inNumValues), coefficient(inCoefficient),
+    numPaddedValues(((inNumValues + kParameterSmootherLanes - 1) / kParameterSmootherLanes) *
+                    kParameterSmootherLanes),
+    targets(allocateValues(numPaddedValues)), values(allocateValues(numPaddedValues)) {}
+
+    virtual ~ParameterSmoother() {
+        AlignedMemory::deallocate(targets);
+        AlignedMemory::deallocate(values);
+    }
+
+    /**
+     * @return Number of values which are smoothed
+     */
+    size_t getNumValues() const {
+        return numValues;
+    }
+
+    /**
+     * Set the target values from the current values of a parameter set. The
+     * first getNumValues() parameters of the set are used.
+     */
+    void setTargets(const ParameterSet &parameters) {
+        parameters.getValues(targets, numValues);
+    }
+
+    /**
+     * Set the target values from an array holding getNumValues() values.
+     */
+    void setTargets(const ParameterValue *inTargets) {
+        memcpy(targets, inTargets, numValues * sizeof(ParameterValue));
+    }
+
+    /**
+     * Jump directly to the target values, for instance when playback starts.
+     */
+    void reset() {
+        memcpy(values, targets, numPaddedValues * sizeof(ParameterValue));
+    }
+
+    /**
+     * Move all values one step towards their targets.
+     */
+    void process() {
+#if defined(__AVX__) && PLUGINPARAMETERS_FLOAT_VALUES
+        const __m256 step = _mm256_set1_ps(coefficient);
+        for(size_t i = 0; i < numPaddedValues; i += 8) {
+            const __m256 value = _mm256_load_ps(values + i);
+            const __m256 difference = _mm256_sub_ps(_mm256_load_ps(targets + i), value);
+            _mm256_store_ps(values + i, _mm256_add_ps(value, _mm256_mul_ps(step, difference)));
+        }
+#elif defined(__AVX__)
+        const __m256d step = _mm256_set1_pd(coefficient);
+        for(size_t i = 0; i < numPaddedValues; i += 4) {
+            const __m256d value = _mm256_load_pd(values + i);
+            const __m256d difference = _mm256_sub_pd(_mm256_load_pd(targets + i), value);
+            _mm256_store_pd(values + i, _mm256_add_pd(value, _mm256_mul_pd(step, difference)));
+        }
+#elif PLUGINPARAMETERS_SMOOTHER_SSE2 && PLUGINPARAMETERS_FLOAT_VALUES
+        const __m128 step = _mm_set1_ps(coefficient);
+        for(size_t i = 0; i < numPaddedValues; i += 4) {
+            const __m128 value = _mm_load_ps(values + i);
+            const __m128 difference = _mm_sub_ps(_mm_load_ps(targets + i), value);
+            _mm_store_ps(values + i, _mm_add_ps(value, _mm_mul_ps(step, difference)));
+        }
+#elif PLUGINPARAMETERS_SMOOTHER_SSE2
+        const __m128d step = _mm_set1_pd(coefficient);
+        for(size_t i = 0; i < numPaddedValues; i += 2) {
+            const __m128d value = _mm_load_pd(values + i);
+            const __m128d difference = _mm_sub_pd(_mm_load_pd(targets + i), value);
+            _mm_store_pd(values + i, _mm_add_pd(value, _mm_mul_pd(step, difference)));
+        }
+#else
+        for(size_t i = 0; i < numPaddedValues; i++) {
+            values[i] += coefficient * (targets[i] - values[i]);
+        }
+#endif
+    }
+
+    /**
+     * @return Array of getNumValues() smoothed values, aligned for SIMD access
+     */
+    const ParameterValue *getValues() const {
+        return values;
+    }
+
+private:
+    static ParameterValue *allocateValues(size_t size) {
+        ParameterValue *result = reinterpret_cast<ParameterValue *>(
+            AlignedMemory::allocate(size * sizeof(ParameterValue), kParameterSmootherAlignment));
+        memset(result, 0, size * sizeof(ParameterValue));
+        return result;
+    }
+
+    // Disallow copy and assignment
+    ParameterSmoother(const ParameterSmoother &);
+    ParameterSmoother &operator = (const ParameterSmoother &);
+
+private:
+    const size_t numValues;
+    const ParameterValue coefficient;
+    const size_t numPaddedValues;
+    ParameterValue *targets;
+    ParameterValue *values;
+};
+
+} // namespace teragon
+
+#undef PLUGINPARAMETERS_SMOOTHER_SSE2
+
+#endif // __PluginParameters_ParameterSmoother_h__
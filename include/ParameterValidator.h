@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __PluginParameters_ParameterValidator_h__
+#define __PluginParameters_ParameterValidator_h__
+
+#include <string.h>
+#include <vector>
+#include "AlignedMemory.h"
+#include "ParameterSet.h"
+// Uses the same padding and alignment as the smoother
+#include "ParameterSmoother.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+// Only used within this header
+#define PLUGINPARAMETERS_VALIDATOR_SSE2 1
+#endif
+
+namespace teragon {
+
+/**
+ * Checks a whole array of parameter values at once, for instance before the
+ * state of a preset is applied. Values which are out of range are clamped to
+ * the parameter's minimum or maximum, and values which are NaN or infinite are
+ * replaced with the parameter's default value. This uses AVX or SSE2
+ * instructions when the compiler targets them.
+ *
+ * The ranges of the parameters are copied when the validator is constructed,
+ * so it must be recreated if parameters are added to the set.
+ */
+class ParameterValidator {
+public:
+    /**
+     * @param parameters Parameter set which provides the ranges, in the same
+     *                   order as the values which will be validated
+     */
+    explicit ParameterValidator(const ParameterSet &parameters) :
+    numValues(parameters.size()),
+    numPaddedValues(((parameters.size() + kParameterSmootherLanes - 1) / kParameterSmootherLanes) *
+                    kParameterSmootherLanes),
+    minValues(allocateValues(numPaddedValues)), maxValues(allocateValues(numPaddedValues)),
+    defaultValues(allocateValues(numPaddedValues)) {
+        for(size_t i = 0; i < numValues; i++) {
+            const Parameter *parameter = parameters.get((int)i);
+            minValues[i] = parameter->getMinValue();
+            maxValues[i] = parameter->getMaxValue();
+            defaultValues[i] = parameter->getDefaultValue();
+        }
+    }
+
+    virtual ~ParameterValidator() {
+        AlignedMemory::deallocate(minValues);
+        AlignedMemory::deallocate(maxValues);
+        AlignedMemory::deallocate(defaultValues);
+    }
+
+    /**
+     * @return Number of parameters whose ranges are known
+     */
+    size_t getNumValues() const {
+        return numValues;
+    }
+
+    /**
+     * Clamp values to their parameter's range, and replace NaN or infinite
+     * values with the parameter's default value.
+     *
+     * @param values Values to validate in place, which need not be aligned
+     * @param inNumValues Number of values, any values beyond getNumValues()
+     *                    are left unchanged
+     * @param invalidIndices If not NULL, the index of each value which was
+     *                       changed is appended to this list
+     * @return Number of values which were changed
+     */
+    size_t validate(ParameterValue *values, size_t inNumValues,
+                    std::vector<size_t> *invalidIndices = NULL) const {
+        const size_t count = inNumValues < numValues ? inNumValues : numValues;
+        size_t result = 0;
+        size_t i = 0;
+#if defined(__AVX__) && PLUGINPARAMETERS_FLOAT_VALUES
+        const __m256 zero = _mm256_setzero_ps();
+        for(; i + 8 <= count; i += 8) {
+            const __m256 value = _mm256_loadu_ps(values + i);
+            // x - x is only zero for finite numbers
+            const __m256 isFinite = _mm256_cmp_ps(_mm256_sub_ps(value, value), zero, _CMP_EQ_OQ);
+            const __m256 clamped = _mm256_min_ps(_mm256_max_ps(value, _mm256_load_ps(minValues + i)),
+                                                 _mm256_load_ps(maxValues + i));
+            const __m256 valid = _mm256_blendv_ps(_mm256_load_ps(defaultValues + i), clamped, isFinite);
+            const int changed = _mm256_movemask_ps(_mm256_cmp_ps(valid, value, _CMP_NEQ_UQ));
+            if(changed != 0) {
+                _mm256_storeu_ps(values + i, valid);
+                result += reportChanges(changed, i, invalidIndices);
+            }
+        }
+#elif defined(__AVX__)
+        const __m256d zero = _mm256_setzero_pd();
+        for(; i + 4 <= count; i += 4) {
+            const __m256d value = _mm256_loadu_pd(values + i);
+            const __m256d isFinite = _mm256_cmp_pd(_mm256_sub_pd(value, value), zero, _CMP_EQ_OQ);
+            const __m256d clamped = _mm256_min_pd(_mm256_max_pd(value, _mm256_load_pd(minValues + i)),
+                                                  _mm256_load_pd(maxValues + i));
+            const __m256d valid = _mm256_blendv_pd(_mm256_load_pd(defaultValues + i), clamped, isFinite);
+            const int changed = _mm256_movemask_pd(_mm256_cmp_pd(valid, value, _CMP_NEQ_UQ));
+            if(changed != 0) {
+                _mm256_storeu_pd(values + i, valid);
+                result += reportChanges(changed, i, invalidIndices);
+            }
+        }
+#elif PLUGINPARAMETERS_VALIDATOR_SSE2 && PLUGINPARAMETERS_FLOAT_VALUES
+        const __m128 zero = _mm_setzero_ps();
+        for(; i + 4 <= count; i += 4) {
+            const __m128 value = _mm_loadu_ps(values + i);
+            const __m128 isFinite = _mm_cmpeq_ps(_mm_sub_ps(value, value), zero);
+            const __m128 clamped = _mm_min_ps(_mm_max_ps(value, _mm_load_ps(minValues + i)),
+                                              _mm_load_ps(maxValues + i));
+            const __m128 valid = _mm_or_ps(_mm_and_ps(isFinite, clamped),
+                                           _mm_andnot_ps(isFinite, _mm_load_ps(defaultValues + i)));
+            const int changed = _mm_movemask_ps(_mm_cmpneq_ps(valid, value));
+            if(changed != 0) {
+                _mm_storeu_ps(values + i, valid);
+                result += reportChanges(changed, i, invalidIndices);
+            }
+        }
+#elif PLUGINPARAMETERS_VALIDATOR_SSE2
+        const __m128d zero = _mm_setzero_pd();
+        for(; i + 2 <= count; i += 2) {
+            const __m128d value = _mm_loadu_pd(values + i);
+            const __m128d isFinite = _mm_cmpeq_pd(_mm_sub_pd(value, value), zero);
+            const __m128d clamped = _mm_min_pd(_mm_max_pd(value, _mm_load_pd(minValues + i)),
+                                               _mm_load_pd(maxValues + i));
+            const __m128d valid = _mm_or_pd(_mm_and_pd(isFinite, clamped),
+                                            _mm_andnot_pd(isFinite, _mm_load_pd(defaultValues + i)));
+            const int changed = _mm_movemask_pd(_mm_cmpneq_pd(valid, value));
+            if(changed != 0) {
+                _mm_storeu_pd(values + i, valid);
+                result += reportChanges(changed, i, invalidIndices);
+            }
+        }
+#endif
+        for(; i < count; i++) {
+            const ParameterValue value = values[i];
+            ParameterValue valid = value;
+            if(!(value - value == 0.0)) {
+                valid = defaultValues[i];
+            }
+            else if(value < minValues[i]) {
+                valid = minValues[i];
+            }
+            else if(value > maxValues[i]) {
+                valid = maxValues[i];
+            }
+            // NaN never compares equal, so it is always reported
+            if(!(valid == value)) {
+                values[i] = valid;
+                result += reportChanges(1, i, invalidIndices);
+            }
+        }
+        return result;
+    }
+
+private:
+    // @return Number of bits set in the mask, each of which is one changed value
+    static size_t reportChanges(int mask, size_t offset, std::vector<size_t> *invalidIndices) {
+        size_t result = 0;
+        for(size_t bit = 0; mask != 0; bit++, mask >>= 1) {
+            if(mask & 1) {
+                if(invalidIndices != NULL) {
+                    invalidIndices->push_back(offset + bit);
+                }
+                result++;
+            }
+        }
+        return result;
+    }
+
+    static ParameterValue *allocateValues(size_t size) {
+        ParameterValue *result = reinterpret_cast<ParameterValue *>(
+            AlignedMemory::allocate(size * sizeof(ParameterValue), kParameterSmootherAlignment));
+        memset(result, 0, size * sizeof(ParameterValue));
+        return result;
+    }
+
+    // Disallow copy and assignment
+    ParameterValidator(const ParameterValidator &);
+    ParameterValidator &operator = (const ParameterValidator &);
+
+private:
+    const size_t numValues;
+    const size_t numPaddedValues;
+    ParameterValue *minValues;
+    ParameterValue *maxValues;
+    ParameterValue *defaultValues;
+};
+
+} // namespace teragon
+
+#undef PLUGINPARAMETERS_VALIDATOR_SSE2
+
+#endif // __PluginParameters_ParameterValidator_h__
@@ -30,19 +30,33 @@
 #define PLUGINPARAMETERS_MULTITHREADED 1
 #endif
 
+// Define as 1 to store parameter values as single-precision floats, which
+// avoids conversions in DSP code which runs in float, and doubles the number
+// of values processed by each SIMD instruction in ParameterSmoother.
+#ifndef PLUGINPARAMETERS_FLOAT_VALUES
+#define PLUGINPARAMETERS_FLOAT_VALUES 0
+#endif
+
 #include "BlobParameter.h"
 #include "BooleanParameter.h"
 #include "DecibelParameter.h"
 #include "FloatParameter.h"
 #include "FrequencyParameter.h"
 #include "IntegerParameter.h"
+#include "JsonState.h"
+#include "StateStream.h"
 #include "StringParameter.h"
 #include "ParameterSet.h"
+#include "ParameterSmoother.h"
+#include "ParameterValidator.h"
 #include "VoidParameter.h"
 
 #if PLUGINPARAMETERS_MULTITHREADED
 #include "EventDispatcher.h"
+#include "EventExecutor.h"
+#include "EventDispatcherService.h"
 #include "ConcurrentParameterSet.h"
+#include "ParameterAutosave.h"
 #endif
 
 #endif // __PluginParameters_PluginParameters_h__
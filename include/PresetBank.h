@@ -0,0 +1,532 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __PluginParameters_PresetBank_h__
+#define __PluginParameters_PresetBank_h__
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "DataParameter.h"
+#include "MappedFile.h"
+#include "ParameterSet.h"
+#include "ParameterValidator.h"
+#include "StateStream.h"
+#include "VoidParameter.h"
+
+namespace teragon {
+
+static const char kPresetBankMagic[4] = {'P', 'P', 'B', 'K'};
+static const uint32_t kPresetBankVersion = 1;
+// Records start at multiples of this value, so that their values can be read in place
+static const size_t kPresetBankAlignment = 8;
+// Record flag which is set when the record's data may be run-length encoded
+static const uint32_t kPresetBankCompressed = 1;
+
+/**
+ * Header at the start of a preset bank file. The header is followed by the
+ * index (one PresetBankEntry per preset), then by the preset names, and then
+ * by the records. Numbers are stored in the byte order of the machine which
+ * wrote the bank.
+ */
+class PresetBankHeader {
+public:
+    char magic[4];
+    uint32_t version;
+    // Hash of the parameter names, see PresetBank::getSchemaHash()
+    uint64_t schemaHash;
+    uint32_t numValues;
+    // Size of ParameterValue when the bank was written
+    uint32_t valueSize;
+    uint32_t numPresets;
+    uint32_t reserved;
+    // Offset of the preset names, which are not NULL-terminated
+    uint64_t namesOffset;
+};
+
+/**
+ * Index entry for a single preset. Each record holds numValues values, followed
+ * by the contents of every DataParameter in the set. Each of these contents is
+ * stored as its size in the record, its actual size and then its bytes, which
+ * are run-length encoded when the two sizes differ.
+ */
+class PresetBankEntry {
+public:
+    uint64_t recordOffset;
+    uint32_t recordSize;
+    uint32_t flags;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+};
+
+/**
+ * Read-only bank of presets, which is memory-mapped so that a bank with many
+ * thousands of presets can be opened and listed without reading all of it.
+ * Listing the presets only touches the index and the names, and loading a
+ * preset applies its values straight from the mapping without any parsing.
+ *
+ * Banks are created with PresetBankWriter, and can only be loaded into sets
+ * with the same parameters as the set which they were written from.
+ */
+class PresetBank {
+public:
+    /**
+     * Open a preset bank. The index is checked, so that loading presets from a
+     * corrupted bank cannot read outside of the file.
+     *
+     * @param path Path of the bank file
+     * @return New bank, or NULL if the file could not be mapped or is invalid
+     */
+    static PresetBank *open(const ParameterString &path) {
+        MappedFile *file = MappedFile::create(path);
+        if(file == NULL) {
+            return NULL;
+        }
+        if(!isValid(file)) {
+            delete file;
+            return NULL;
+        }
+        return new PresetBank(file);
+    }
+
+    virtual ~PresetBank() {
+        delete file;
+    }
+
+    /**
+     * Get the hash which identifies the parameters of a set. Presets can only
+     * be loaded into a set with the same hash as the bank.
+     */
+    static unsigned long long getSchemaHash(const ParameterSet &parameters) {
+        ParameterString names;
+        for(size_t i = 0; i < parameters.size(); i++) {
+            names.append(parameters.get((int)i)->getSafeName());
+            names.append(1, '\n');
+        }
+        return DataBuffer::computeHash(names.data(), names.size());
+    }
+
+    unsigned long long getSchemaHash() const {
+        return getHeader()->schemaHash;
+    }
+
+    /**
+     * @return True if presets from this bank can be loaded into the set
+     */
+    bool isCompatible(const ParameterSet &parameters) const {
+        return parameters.size() == getHeader()->numValues && getSchemaHash(parameters) == getSchemaHash();
+    }
+
+    size_t getNumPresets() const {
+        return getHeader()->numPresets;
+    }
+
+    /**
+     * @param index Preset index, must be less than getNumPresets()
+     * @return Name of the preset
+     */
+    ParameterString getPresetName(size_t index) const {
+        const PresetBankEntry *entry = getEntry(index);
+        return ParameterString(getBytes() + getHeader()->namesOffset + entry->nameOffset, entry->nameLength);
+    }
+
+    /**
+     * Get the values of a preset without loading it, for instance to compare
+     * presets while browsing.
+     *
+     * @param index Preset index, must be less than getNumPresets()
+     * @return Array with one value per parameter, which points into the mapping
+     */
+    const ParameterValue *getValues(size_t index) const {
+        return reinterpret_cast<const ParameterValue *>(getBytes() + getEntry(index)->recordOffset);
+    }
+
+    /**
+     * Load a preset into a parameter set. Void parameters are not triggered.
+     * Since a bank may have been written by another program, values are first
+     * checked with a ParameterValidator, which clamps them to their parameter's
+     * range and replaces NaN or infinite values with the default value. The
+     * whole record is checked before anything is applied, so a corrupted
+     * record leaves the set unchanged.
+     *
+     * @param index Preset index, must be less than getNumPresets()
+     * @param parameters Parameter set, which must be compatible with the bank
+     * @param sender Sending object (can be NULL), which will not be notified
+     *               of the changes when PLUGINPARAMETERS_MULTITHREADED is set
+     * @param outNumValuesLoaded If not NULL, receives the number of values
+     *                           which were applied or, when
+     *                           PLUGINPARAMETERS_MULTITHREADED is set,
+     *                           accepted by the set
+     * @return False if the set is not compatible, a record is corrupted or the
+     *         set rejected a change, in which case only some values were loaded
+     */
+    bool load(size_t index, StateParameterSet &parameters, ParameterObserver *sender = NULL,
+              size_t *outNumValuesLoaded = NULL) const {
+        if(outNumValuesLoaded != NULL) {
+            *outNumValuesLoaded = 0;
+        }
+        if(index >= getNumPresets() || !isCompatible(parameters)) {
+            return false;
+        }
+
+        const PresetBankEntry *entry = getEntry(index);
+        const ParameterValue *storedValues = getValues(index);
+        const char *data = reinterpret_cast<const char *>(storedValues + getHeader()->numValues);
+        const char *end = getBytes() + entry->recordOffset + entry->recordSize;
+        // The mapping is read-only, so the values are validated in a copy
+        std::vector<ParameterValue> values(storedValues, storedValues + parameters.size());
+        if(!values.empty()) {
+            ParameterValidator(parameters).validate(&values[0], values.size());
+        }
+
+        // Contents of the data parameters, which either point into the mapping
+        // or into the decoded data
+        std::vector<DataContents> contents;
+        std::string decoded;
+        std::string scratch;
+        for(size_t i = 0; i < parameters.size(); i++) {
+            if(dynamic_cast<DataParameter *>(parameters.get((int)i)) == NULL) {
+                continue;
+            }
+            uint32_t sizes[2];
+            if((size_t)(end - data) < sizeof(sizes)) {
+                return false;
+            }
+            memcpy(sizes, data, sizeof(sizes));
+            data += sizeof(sizes);
+            if((size_t)(end - data) < sizes[0]) {
+                return false;
+            }
+            DataContents result;
+            result.mapped = data;
+            result.decodedOffset = 0;
+            result.size = sizes[1];
+            if(sizes[0] != sizes[1]) {
+                if((entry->flags & kPresetBankCompressed) == 0 || !decode(data, sizes[0], sizes[1], scratch)) {
+                    return false;
+                }
+                result.mapped = NULL;
+                result.decodedOffset = decoded.size();
+                decoded.append(scratch);
+            }
+            data += sizes[0];
+            contents.push_back(result);
+        }
+
+        size_t numChanges = 0;
+        size_t numValuesLoaded = 0;
+        size_t numContents = 0;
+        for(size_t i = 0; i < parameters.size(); i++) {
+            Parameter *parameter = parameters.get((int)i);
+            DataParameter *dataParameter = dynamic_cast<DataParameter *>(parameter);
+            bool isApplied = true;
+            if(dataParameter != NULL) {
+                const DataContents &current = contents[numContents++];
+                const char *bytes = current.mapped != NULL ? current.mapped : decoded.data() + current.decodedOffset;
+#if PLUGINPARAMETERS_MULTITHREADED
+                isApplied = parameters.setData(dataParameter, bytes, current.size, sender);
+#else
+                dataParameter->setValue(bytes, current.size);
+#endif
+            }
+            else if(dynamic_cast<VoidParameter *>(parameter) == NULL) {
+#if PLUGINPARAMETERS_MULTITHREADED
+                isApplied = parameters.set(parameter, values[i], sender);
+#else
+                parameter->setValue(values[i]);
+#endif
+            }
+            else {
+                continue;
+            }
+            numChanges++;
+            if(isApplied) {
+                numValuesLoaded++;
+            }
+        }
+        if(outNumValuesLoaded != NULL) {
+            *outNumValuesLoaded = numValuesLoaded;
+        }
+        return numValuesLoaded == numChanges;
+    }
+
+    /**
+     * Decode data which was compressed with encode().
+     *
+     * @return False if the data does not decode to exactly dataSize bytes
+     */
+    static bool decode(const char *storedData, size_t storedSize, size_t dataSize, std::string &result) {
+        const unsigned char *input = reinterpret_cast<const unsigned char *>(storedData);
+        result.clear();
+        result.reserve(dataSize);
+        size_t i = 0;
+        while(i < storedSize) {
+            const unsigned char control = input[i++];
+            if(control < 128) {
+                const size_t length = (size_t)control + 1;
+                if(storedSize - i < length) {
+                    return false;
+                }
+                result.append(storedData + i, length);
+                i += length;
+            }
+            else if(control > 128) {
+                if(i == storedSize) {
+                    return false;
+                }
+                result.append(257 - (size_t)control, (char)input[i++]);
+            }
+            if(result.size() > dataSize) {
+                return false;
+            }
+        }
+        return result.size() == dataSize;
+    }
+
+    /**
+     * Compress data with run-length encoding, in the same way as PackBits.
+     * This works well for blobs with long runs of the same byte, such as
+     * silence in a sample or an empty step sequence.
+     */
+    static void encode(const char *data, size_t dataSize, std::string &result) {
+        const unsigned char *input = reinterpret_cast<const unsigned char *>(data);
+        result.clear();
+        size_t i = 0;
+        while(i < dataSize) {
+            size_t run = 1;
+            while(i + run < dataSize && run < 128 && input[i + run] == input[i]) {
+                run++;
+            }
+            if(run >= 3) {
+                result.append(1, (char)(257 - run));
+                result.append(1, (char)input[i]);
+                i += run;
+                continue;
+            }
+
+            // Copy bytes literally up to the next run of at least three bytes
+            const size_t start = i;
+            while(i < dataSize && i - start < 128 &&
+                  !(i + 2 < dataSize && input[i] == input[i + 1] && input[i] == input[i + 2])) {
+                i++;
+            }
+            result.append(1, (char)(i - start - 1));
+            result.append(data + start, i - start);
+        }
+    }
+
+private:
+    explicit PresetBank(MappedFile *inFile) : file(inFile) {
+        // Listing presets only needs the index and the names
+        file->prefetch(0, (size_t)getHeader()->namesOffset);
+    }
+
+    static bool isValid(const MappedFile *inFile) {
+        const size_t size = inFile->getSize();
+        if(size < sizeof(PresetBankHeader)) {
+            return false;
+        }
+        const PresetBankHeader *header = reinterpret_cast<const PresetBankHeader *>(inFile->getData());
+        if(memcmp(header->magic, kPresetBankMagic, sizeof(kPresetBankMagic)) != 0 ||
+           header->version != kPresetBankVersion || header->valueSize != sizeof(ParameterValue) ||
+           (size - sizeof(PresetBankHeader)) / sizeof(PresetBankEntry) < header->numPresets ||
+           header->namesOffset != sizeof(PresetBankHeader) + header->numPresets * sizeof(PresetBankEntry) ||
+           header->namesOffset > size) {
+            return false;
+        }
+
+        // Checked separately, since the size of the values could overflow
+        if(header->numValues > size / sizeof(ParameterValue)) {
+            return false;
+        }
+        const PresetBankEntry *entries = reinterpret_cast<const PresetBankEntry *>(header + 1);
+        const size_t valuesSize = (size_t)header->numValues * sizeof(ParameterValue);
+        for(size_t i = 0; i < header->numPresets; i++) {
+            const PresetBankEntry &entry = entries[i];
+            if(entry.recordOffset % kPresetBankAlignment != 0 || entry.recordOffset > size ||
+               entry.recordSize > size - entry.recordOffset || entry.recordSize < valuesSize ||
+               entry.nameOffset > size - header->namesOffset ||
+               entry.nameLength > size - header->namesOffset - entry.nameOffset) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Location of the contents of a data parameter in a record
+    class DataContents {
+    public:
+        const char *mapped;
+        size_t decodedOffset;
+        size_t size;
+    };
+
+    const char *getBytes() const {
+        return reinterpret_cast<const char *>(file->getData());
+    }
+
+    const PresetBankHeader *getHeader() const {
+        return reinterpret_cast<const PresetBankHeader *>(getBytes());
+    }
+
+    const PresetBankEntry *getEntry(size_t index) const {
+        return reinterpret_cast<const PresetBankEntry *>(getHeader() + 1) + index;
+    }
+
+    // Disallow copy and assignment
+    PresetBank(const PresetBank &);
+    PresetBank &operator = (const PresetBank &);
+
+private:
+    MappedFile *file;
+};
+
+/**
+ * Collects presets from a parameter set, and writes them as a bank which can
+ * be opened with PresetBank.
+ */
+class PresetBankWriter {
+public:
+    /**
+     * @param schema Parameter set which defines the parameters of the bank
+     */
+    explicit PresetBankWriter(const ParameterSet &schema) :
+    schemaHash(PresetBank::getSchemaHash(schema)), numValues(schema.size()),
+    entries(), names(), records(), values(schema.size()), encoded() {}
+
+    virtual ~PresetBankWriter() {}
+
+    /**
+     * Add the current state of a parameter set as a preset.
+     *
+     * @param name Name of the preset
+     * @param parameters Parameter set, which must have the same parameters as
+     *                   the set passed to the constructor
+     * @param compress If true, then the contents of data parameters are run-
+     *                 length encoded where this makes them smaller
+     * @return False if the set does not match the bank
+     */
+    bool add(const ParameterString &name, const ParameterSet &parameters, bool compress = false) {
+        if(parameters.size() != numValues || PresetBank::getSchemaHash(parameters) != schemaHash) {
+            return false;
+        }
+
+        PresetBankEntry entry;
+        entry.recordOffset = records.size();
+        entry.flags = compress ? kPresetBankCompressed : 0;
+        entry.nameOffset = (uint32_t)names.size();
+        entry.nameLength = (uint32_t)name.size();
+        names.append(name);
+
+        if(numValues > 0) {
+            parameters.getValues(&values[0], numValues);
+            records.append(reinterpret_cast<const char *>(&values[0]), numValues * sizeof(ParameterValue));
+        }
+        for(size_t i = 0; i < numValues; i++) {
+            const DataParameter *dataParameter = dynamic_cast<const DataParameter *>(parameters.get((int)i));
+            if(dataParameter == NULL) {
+                continue;
+            }
+            const DataBuffer *current = dataParameter->getBuffer();
+            const char *data = current != NULL ? current->getData() : NULL;
+            uint32_t sizes[2];
+            sizes[0] = sizes[1] = current != NULL ? (uint32_t)current->getSize() : 0;
+            if(compress && sizes[1] > 0) {
+                PresetBank::encode(data, sizes[1], encoded);
+                if(encoded.size() < sizes[1]) {
+                    data = encoded.data();
+                    sizes[0] = (uint32_t)encoded.size();
+                }
+            }
+            records.append(reinterpret_cast<const char *>(sizes), sizeof(sizes));
+            if(sizes[0] > 0) {
+                records.append(data, sizes[0]);
+            }
+        }
+        entry.recordSize = (uint32_t)(records.size() - entry.recordOffset);
+        records.append((kPresetBankAlignment - records.size() % kPresetBankAlignment) % kPresetBankAlignment, '\0');
+        entries.push_back(entry);
+        return true;
+    }
+
+    size_t getNumPresets() const {
+        return entries.size();
+    }
+
+    /**
+     * Write the bank.
+     *
+     * @return True if all data was accepted by the output
+     */
+    bool write(StateOutput &output) const {
+        PresetBankHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, kPresetBankMagic, sizeof(kPresetBankMagic));
+        header.version = kPresetBankVersion;
+        header.schemaHash = schemaHash;
+        header.numValues = (uint32_t)numValues;
+        header.valueSize = sizeof(ParameterValue);
+        header.numPresets = (uint32_t)entries.size();
+        header.namesOffset = sizeof(PresetBankHeader) + entries.size() * sizeof(PresetBankEntry);
+
+        const size_t namesEnd = (size_t)header.namesOffset + names.size();
+        const size_t recordsOffset = ((namesEnd + kPresetBankAlignment - 1) / kPresetBankAlignment) *
+                                     kPresetBankAlignment;
+        std::vector<PresetBankEntry> index(entries);
+        for(size_t i = 0; i < index.size(); i++) {
+            index[i].recordOffset += recordsOffset;
+        }
+
+        const char padding[kPresetBankAlignment] = {0};
+        bool result = output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        if(!index.empty()) {
+            result = output.write(reinterpret_cast<const char *>(&index[0]),
+                                  index.size() * sizeof(PresetBankEntry)) && result;
+        }
+        result = output.write(names.data(), names.size()) && result;
+        result = output.write(padding, recordsOffset - namesEnd) && result;
+        return output.write(records.data(), records.size()) && result;
+    }
+
+private:
+    // Disallow copy and assignment
+    PresetBankWriter(const PresetBankWriter &);
+    PresetBankWriter &operator = (const PresetBankWriter &);
+
+private:
+    const unsigned long long schemaHash;
+    const size_t numValues;
+    std::vector<PresetBankEntry> entries;
+    std::string names;
+    std::string records;
+    // Reused between presets
+    std::vector<ParameterValue> values;
+    std::string encoded;
+};
+
+} // namespace teragon
+
+#endif // __PluginParameters_PresetBank_h__
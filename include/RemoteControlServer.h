@@ -0,0 +1,783 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __PluginParameters_RemoteControlServer_h__
+#define __PluginParameters_RemoteControlServer_h__
+
+#include <string.h>
+#include <map>
+#include <vector>
+#include "ConcurrentParameterSet.h"
+
+#if PLUGINPARAMETERS_MULTITHREADED && !WIN32
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace teragon {
+
+#if PLUGINPARAMETERS_MULTITHREADED && !WIN32
+// Requests, which are sent by the client
+static const uint8_t kRemoteControlSetMany = 1;
+static const uint8_t kRemoteControlGetValues = 2;
+static const uint8_t kRemoteControlSubscribe = 3;
+static const uint8_t kRemoteControlGetNames = 4;
+// Replies and notifications, which are sent by the server
+static const uint8_t kRemoteControlAcknowledge = 0x81;
+static const uint8_t kRemoteControlValues = 0x82;
+static const uint8_t kRemoteControlChanges = 0x83;
+static const uint8_t kRemoteControlNames = 0x84;
+// Connections which send larger frames are closed
+static const size_t kRemoteControlMaxFrameSize = 1024 * 1024;
+
+#if defined(MSG_NOSIGNAL)
+static const int kRemoteControlSendFlags = MSG_DONTWAIT | MSG_NOSIGNAL;
+#else
+// SO_NOSIGPIPE is set on the socket instead
+static const int kRemoteControlSendFlags = MSG_DONTWAIT;
+#endif
+
+/**
+ * Header of each frame in the remote control protocol, which is followed by
+ * size bytes of data. Numbers are sent in the byte order of the machine, since
+ * both ends always run on the same machine.
+ */
+class RemoteControlFrameHeader {
+public:
+    uint32_t size;
+    uint8_t type;
+    uint8_t reserved[3];
+};
+
+/**
+ * Value of a single parameter, as sent in the data of set many, values and
+ * changes frames.
+ */
+class RemoteControlValue {
+public:
+    uint32_t index;
+    uint32_t reserved;
+    double value;
+};
+
+/**
+ * Lets other processes on the same machine set and observe the parameters of a
+ * ConcurrentParameterSet through a Unix domain socket, for instance for
+ * automated tests or to bridge a hardware control surface.
+ *
+ * The protocol consists of frames, each made of a RemoteControlFrameHeader
+ * and its data. Clients may send these requests:
+ *
+ * - kRemoteControlSetMany, with an array of RemoteControlValue. The values are
+ *   scheduled like any other change, and the server replies with an
+ *   acknowledge frame holding the number of values which were accepted as a
+ *   uint32_t. Values which are not finite are rejected, and other values are
+ *   clamped to the parameter's range.
+ * - kRemoteControlGetValues, to which the server replies with a values frame
+ *   holding the current values of all parameters.
+ * - kRemoteControlSubscribe, to which the server also replies with a values
+ *   frame. Afterwards, the server sends a changes frame whenever parameters
+ *   have changed. Many changes of the same parameter are coalesced into one
+ *   value.
+ * - kRemoteControlGetNames, to which the server replies with a names frame
+ *   holding each parameter's safe name as a uint16_t length and the bytes.
+ *
+ * The socket file is only accessible by the user running the server, since
+ * clients are not authenticated otherwise.
+ *
+ * The server owns no threads. Instead, process() must be called regularly
+ * from the thread which otherwise changes the parameters (typically the GUI
+ * thread), since parameters may only be set from a single thread.
+ * RemoteControlClient implements the client side of the protocol.
+ */
+class RemoteControlServer : public ParameterObserver {
+public:
+    /**
+     * Start listening for connections. An existing socket file at the same
+     * path is replaced, but any other kind of file is left alone and the
+     * server is not valid. The server must be created after all parameters
+     * have been added to the set, and destroyed before the set.
+     *
+     * @param inParameters Parameter set to control
+     * @param inPath Path of the socket file
+     */
+    RemoteControlServer(ConcurrentParameterSet &inParameters, const ParameterString &inPath) :
+    ParameterObserver(), parameters(inParameters), path(inPath), listenDescriptor(-1),
+    clients(), indices(), dirty(inParameters.size(), false), dirtyIndices(), changedIndices(),
+    pollDescriptors(), signaled(false) {
+        wakeDescriptors[0] = wakeDescriptors[1] = -1;
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        if(path.empty() || path.size() >= sizeof(address.sun_path)) {
+            return;
+        }
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+        struct stat status;
+        if(lstat(path.c_str(), &status) == 0) {
+            if(!S_ISSOCK(status.st_mode)) {
+                return;
+            }
+            unlink(path.c_str());
+        }
+        listenDescriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(listenDescriptor < 0) {
+            return;
+        }
+        // Clients cannot connect before listen() is called, so restricting
+        // the permissions in between leaves no window for other users
+        if(bind(listenDescriptor, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0 ||
+           chmod(path.c_str(), S_IRUSR | S_IWUSR) != 0 ||
+           listen(listenDescriptor, 8) != 0 || pipe(wakeDescriptors) != 0) {
+            close(listenDescriptor);
+            listenDescriptor = -1;
+            unlink(path.c_str());
+            return;
+        }
+        setNonBlocking(listenDescriptor);
+        setNonBlocking(wakeDescriptors[0]);
+        setNonBlocking(wakeDescriptors[1]);
+
+        for(size_t i = 0; i < parameters.size(); i++) {
+            Parameter *parameter = parameters.get((int)i);
+            indices[parameter] = i;
+            parameter->addObserver(this);
+        }
+    }
+
+    virtual ~RemoteControlServer() {
+        for(IndexMap::iterator iterator = indices.begin(); iterator != indices.end(); ++iterator) {
+            iterator->first->removeObserver(this);
+        }
+        for(ClientList::iterator iterator = clients.begin(); iterator != clients.end(); ++iterator) {
+            close((*iterator)->descriptor);
+            delete *iterator;
+        }
+        if(listenDescriptor >= 0) {
+            close(listenDescriptor);
+            unlink(path.c_str());
+        }
+        for(int i = 0; i < 2; i++) {
+            if(wakeDescriptors[i] >= 0) {
+                close(wakeDescriptors[i]);
+            }
+        }
+    }
+
+    /**
+     * @return True if the server is listening for connections
+     */
+    bool isValid() const {
+        return listenDescriptor >= 0;
+    }
+
+    const ParameterString &getPath() const {
+        return path;
+    }
+
+    size_t getNumClients() const {
+        return clients.size();
+    }
+
+    /**
+     * Accept new connections, handle requests and send changes to subscribed
+     * clients. This method must always be called from the same thread.
+     *
+     * @param timeoutMilliseconds Maximum time to wait for a request or a
+     *                            change, or 0 to return immediately
+     * @return Number of requests which were handled
+     */
+    size_t process(int timeoutMilliseconds = 0) {
+        if(!isValid()) {
+            return 0;
+        }
+
+        pollDescriptors.clear();
+        addPollDescriptor(listenDescriptor, POLLIN);
+        addPollDescriptor(wakeDescriptors[0], POLLIN);
+        for(ClientList::iterator iterator = clients.begin(); iterator != clients.end(); ++iterator) {
+            addPollDescriptor((*iterator)->descriptor, (short)((*iterator)->output.empty() ? POLLIN : POLLIN | POLLOUT));
+        }
+        if(poll(&pollDescriptors[0], (nfds_t)pollDescriptors.size(), timeoutMilliseconds) <= 0) {
+            return 0;
+        }
+
+        if(pollDescriptors[1].revents & POLLIN) {
+            // Drain the pipe before resetting the flag, otherwise a change in
+            // between would be drained with the flag left set, and no later
+            // change would signal the pipe again. Changes which arrive after
+            // the reset signal it again, and earlier ones are sent below.
+            char buffer[64];
+            while(read(wakeDescriptors[0], buffer, sizeof(buffer)) > 0) {}
+            signaled.store(false);
+            sendChanges();
+        }
+
+        size_t numRequests = 0;
+        for(size_t i = 0; i < clients.size(); i++) {
+            Client *client = clients[i];
+            if(client->closed) {
+                continue;
+            }
+            const short events = pollDescriptors[i + 2].revents;
+            if((events & (POLLIN | POLLHUP | POLLERR)) && !readClient(client, numRequests)) {
+                client->closed = true;
+            }
+            if((events & POLLOUT) && !client->closed && !flushClient(client)) {
+                client->closed = true;
+            }
+        }
+        removeClosedClients();
+
+        if(pollDescriptors[0].revents & POLLIN) {
+            int descriptor = -1;
+            while((descriptor = accept(listenDescriptor, NULL, NULL)) >= 0) {
+                setNonBlocking(descriptor);
+#if defined(SO_NOSIGPIPE)
+                int value = 1;
+                setsockopt(descriptor, SOL_SOCKET, SO_NOSIGPIPE, &value, sizeof(value));
+#endif
+                clients.push_back(new Client(descriptor));
+            }
+        }
+        return numRequests;
+    }
+
+    virtual bool isRealtimePriority() const {
+        return false;
+    }
+
+    /**
+     * Called on the asynchronous thread, and only marks the parameter as
+     * changed. Its value is read when the changes are sent by process().
+     */
+    virtual void onParameterUpdated(const Parameter *parameter) {
+        IndexMap::const_iterator iterator = indices.find(const_cast<Parameter *>(parameter));
+        if(iterator == indices.end()) {
+            return;
+        }
+        {
+            EventDispatcherLockGuard guard(mutex);
+            if(dirty[iterator->second]) {
+                return;
+            }
+            dirty[iterator->second] = true;
+            dirtyIndices.push_back(iterator->second);
+        }
+        if(!signaled.exchange(true)) {
+            const char value = 1;
+            ssize_t result = write(wakeDescriptors[1], &value, sizeof(value));
+            (void)result;
+        }
+    }
+
+private:
+    class Client {
+    public:
+        explicit Client(int inDescriptor) :
+        descriptor(inDescriptor), input(), output(), subscribed(false), closed(false) {}
+
+        int descriptor;
+        std::vector<char> input;
+        std::vector<char> output;
+        bool subscribed;
+        bool closed;
+    };
+
+    typedef std::vector<Client *> ClientList;
+    typedef std::map<Parameter *, size_t> IndexMap;
+
+    static void setNonBlocking(int descriptor) {
+        fcntl(descriptor, F_SETFL, fcntl(descriptor, F_GETFL) | O_NONBLOCK);
+        fcntl(descriptor, F_SETFD, FD_CLOEXEC);
+    }
+
+    void addPollDescriptor(int descriptor, short events) {
+        struct pollfd result;
+        result.fd = descriptor;
+        result.events = events;
+        result.revents = 0;
+        pollDescriptors.push_back(result);
+    }
+
+    bool readClient(Client *client, size_t &numRequests) {
+        char buffer[16 * 1024];
+        const ssize_t numBytes = recv(client->descriptor, buffer, sizeof(buffer), 0);
+        if(numBytes == 0 || (numBytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            return false;
+        }
+        if(numBytes > 0) {
+            client->input.insert(client->input.end(), buffer, buffer + numBytes);
+        }
+
+        size_t offset = 0;
+        RemoteControlFrameHeader header;
+        while(client->input.size() - offset >= sizeof(header)) {
+            memcpy(&header, &client->input[offset], sizeof(header));
+            if(header.size > kRemoteControlMaxFrameSize) {
+                return false;
+            }
+            if(client->input.size() - offset - sizeof(header) < header.size) {
+                break;
+            }
+            if(!handleFrame(client, header.type, &client->input[offset] + sizeof(header), header.size)) {
+                return false;
+            }
+            offset += sizeof(header) + header.size;
+            numRequests++;
+        }
+        client->input.erase(client->input.begin(), client->input.begin() + offset);
+        return flushClient(client);
+    }
+
+    bool handleFrame(Client *client, uint8_t type, const char *data, size_t size) {
+        switch(type) {
+            case kRemoteControlSetMany: {
+                if(size % sizeof(RemoteControlValue) != 0) {
+                    return false;
+                }
+                uint32_t numApplied = 0;
+                RemoteControlValue value;
+                for(size_t offset = 0; offset < size; offset += sizeof(value)) {
+                    memcpy(&value, data + offset, sizeof(value));
+                    if(value.index < parameters.size() && scrubValue((size_t)value.index, value.value) &&
+                       parameters.set((size_t)value.index, (ParameterValue)value.value)) {
+                        numApplied++;
+                    }
+                }
+                queueFrame(client, kRemoteControlAcknowledge, reinterpret_cast<const char *>(&numApplied),
+                           sizeof(numApplied));
+                return true;
+            }
+            case kRemoteControlSubscribe:
+                client->subscribed = true;
+                // Fall through, subscribers start with the current values
+            case kRemoteControlGetValues: {
+                std::vector<size_t> allIndices(parameters.size());
+                for(size_t i = 0; i < allIndices.size(); i++) {
+                    allIndices[i] = i;
+                }
+                queueValues(client, kRemoteControlValues, allIndices);
+                return true;
+            }
+            case kRemoteControlGetNames: {
+                std::vector<char> names;
+                for(size_t i = 0; i < parameters.size(); i++) {
+                    const ParameterString &name = parameters.get((int)i)->getSafeName();
+                    const uint16_t length = (uint16_t)(name.size() < 0xffff ? name.size() : 0xffff);
+                    names.insert(names.end(), reinterpret_cast<const char *>(&length),
+                                 reinterpret_cast<const char *>(&length) + sizeof(length));
+                    names.insert(names.end(), name.data(), name.data() + length);
+                }
+                queueFrame(client, kRemoteControlNames, names.empty() ? NULL : &names[0], names.size());
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * Clamp a value received from a client to the parameter's range.
+     *
+     * @return False if the value is NaN or infinite
+     */
+    bool scrubValue(size_t index, double &value) const {
+        if(!(value - value == 0.0)) {
+            return false;
+        }
+        const Parameter *parameter = parameters.get((int)index);
+        const double minValue = (double)parameter->getMinValue();
+        const double maxValue = (double)parameter->getMaxValue();
+        if(value < minValue) {
+            value = minValue;
+        }
+        else if(value > maxValue) {
+            value = maxValue;
+        }
+        return true;
+    }
+
+    void sendChanges() {
+        changedIndices.clear();
+        {
+            EventDispatcherLockGuard guard(mutex);
+            changedIndices.swap(dirtyIndices);
+            for(size_t i = 0; i < changedIndices.size(); i++) {
+                dirty[changedIndices[i]] = false;
+            }
+        }
+        if(changedIndices.empty()) {
+            return;
+        }
+        for(ClientList::iterator iterator = clients.begin(); iterator != clients.end(); ++iterator) {
+            if((*iterator)->subscribed) {
+                queueValues(*iterator, kRemoteControlChanges, changedIndices);
+                if(!flushClient(*iterator)) {
+                    (*iterator)->closed = true;
+                }
+            }
+        }
+    }
+
+    void queueValues(Client *client, uint8_t type, const std::vector<size_t> &valueIndices) {
+        RemoteControlFrameHeader header;
+        memset(&header, 0, sizeof(header));
+        header.size = (uint32_t)(valueIndices.size() * sizeof(RemoteControlValue));
+        header.type = type;
+        const char *headerBytes = reinterpret_cast<const char *>(&header);
+        client->output.insert(client->output.end(), headerBytes, headerBytes + sizeof(header));
+
+        RemoteControlValue value;
+        memset(&value, 0, sizeof(value));
+        const char *valueBytes = reinterpret_cast<const char *>(&value);
+        for(size_t i = 0; i < valueIndices.size(); i++) {
+            value.index = (uint32_t)valueIndices[i];
+            value.value = (double)parameters.get((int)valueIndices[i])->getValue();
+            client->output.insert(client->output.end(), valueBytes, valueBytes + sizeof(value));
+        }
+    }
+
+    void queueFrame(Client *client, uint8_t type, const char *data, size_t size) {
+        RemoteControlFrameHeader header;
+        memset(&header, 0, sizeof(header));
+        header.size = (uint32_t)size;
+        header.type = type;
+        const char *headerBytes = reinterpret_cast<const char *>(&header);
+        client->output.insert(client->output.end(), headerBytes, headerBytes + sizeof(header));
+        if(size > 0) {
+            client->output.insert(client->output.end(), data, data + size);
+        }
+    }
+
+    // Sends as much of the queued output as the socket accepts without blocking
+    bool flushClient(Client *client) {
+        size_t offset = 0;
+        while(offset < client->output.size()) {
+            const ssize_t numBytes = send(client->descriptor, &client->output[offset],
+                                          client->output.size() - offset, kRemoteControlSendFlags);
+            if(numBytes > 0) {
+                offset += (size_t)numBytes;
+            }
+            else if(numBytes < 0 && errno == EINTR) {
+                continue;
+            }
+            else if(numBytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            else {
+                return false;
+            }
+        }
+        client->output.erase(client->output.begin(), client->output.begin() + offset);
+        // Clients which do not read their data are disconnected
+        return client->output.size() <= 4 * kRemoteControlMaxFrameSize;
+    }
+
+    void removeClosedClients() {
+        ClientList::iterator iterator = clients.begin();
+        while(iterator != clients.end()) {
+            if((*iterator)->closed) {
+                close((*iterator)->descriptor);
+                delete *iterator;
+                iterator = clients.erase(iterator);
+            }
+            else {
+                ++iterator;
+            }
+        }
+    }
+
+    // Disallow copy and assignment
+    RemoteControlServer(const RemoteControlServer &);
+    RemoteControlServer &operator = (const RemoteControlServer &);
+
+private:
+    ConcurrentParameterSet &parameters;
+    const ParameterString path;
+    int listenDescriptor;
+    int wakeDescriptors[2];
+    ClientList clients;
+    IndexMap indices;
+    // Changed parameters, which are written on the asynchronous thread
+    EventDispatcherMutex mutex;
+    std::vector<bool> dirty;
+    std::vector<size_t> dirtyIndices;
+    // Reused by process()
+    std::vector<size_t> changedIndices;
+    std::vector<struct pollfd> pollDescriptors;
+    std::atomic<bool> signaled;
+};
+
+/**
+ * Client for RemoteControlServer. All methods block until the server has
+ * replied, so the server's process() method must be called on another thread
+ * or in another process.
+ */
+class RemoteControlClient {
+public:
+    /**
+     * Connect to a server.
+     *
+     * @param path Path of the server's socket file
+     * @return New client, or NULL if the connection failed
+     */
+    static RemoteControlClient *connect(const ParameterString &path) {
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        if(path.empty() || path.size() >= sizeof(address.sun_path)) {
+            return NULL;
+        }
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+        int descriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(descriptor < 0) {
+            return NULL;
+        }
+        if(::connect(descriptor, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0) {
+            close(descriptor);
+            return NULL;
+        }
+#if defined(SO_NOSIGPIPE)
+        int value = 1;
+        setsockopt(descriptor, SOL_SOCKET, SO_NOSIGPIPE, &value, sizeof(value));
+#endif
+        return new RemoteControlClient(descriptor);
+    }
+
+    virtual ~RemoteControlClient() {
+        close(descriptor);
+    }
+
+    /**
+     * Set the values of many parameters in a single request.
+     *
+     * @param values Values to set
+     * @param numValues Number of values
+     * @param outNumApplied If not NULL, receives the number of values which
+     *                      were accepted by the server
+     * @return True if the server acknowledged the request
+     */
+    bool setMany(const RemoteControlValue *values, size_t numValues, size_t *outNumApplied = NULL) {
+        uint32_t numApplied = 0;
+        if(!request(kRemoteControlSetMany, reinterpret_cast<const char *>(values),
+                    numValues * sizeof(RemoteControlValue), kRemoteControlAcknowledge) ||
+           reply.size() != sizeof(numApplied)) {
+            return false;
+        }
+        memcpy(&numApplied, &reply[0], sizeof(numApplied));
+        if(outNumApplied != NULL) {
+            *outNumApplied = numApplied;
+        }
+        return true;
+    }
+
+    /**
+     * Get the current values of all parameters.
+     */
+    bool getValues(std::vector<RemoteControlValue> &values) {
+        return request(kRemoteControlGetValues, NULL, 0, kRemoteControlValues) && decodeValues(reply, values);
+    }
+
+    /**
+     * Get the safe names of all parameters, in the order of their indices.
+     */
+    bool getNames(std::vector<ParameterString> &names) {
+        if(!request(kRemoteControlGetNames, NULL, 0, kRemoteControlNames)) {
+            return false;
+        }
+        names.clear();
+        size_t offset = 0;
+        while(offset + sizeof(uint16_t) <= reply.size()) {
+            uint16_t length = 0;
+            memcpy(&length, &reply[offset], sizeof(length));
+            offset += sizeof(length);
+            if(reply.size() - offset < length) {
+                return false;
+            }
+            names.push_back(ParameterString(&reply[offset], length));
+            offset += length;
+        }
+        return offset == reply.size();
+    }
+
+    /**
+     * Subscribe to changes, which can then be received with waitForChanges().
+     *
+     * @param values Receives the current values of all parameters
+     */
+    bool subscribe(std::vector<RemoteControlValue> &values) {
+        return request(kRemoteControlSubscribe, NULL, 0, kRemoteControlValues) && decodeValues(reply, values);
+    }
+
+    /**
+     * Wait for the next changes frame after subscribe() has been called.
+     *
+     * @param changes Receives the latest values of the changed parameters
+     * @param timeoutMilliseconds Maximum time to wait, or -1 to wait forever
+     * @return False if no changes arrived before the timeout
+     */
+    bool waitForChanges(std::vector<RemoteControlValue> &changes, int timeoutMilliseconds) {
+        changes.clear();
+        if(!pendingChanges.empty()) {
+            changes.swap(pendingChanges);
+            return true;
+        }
+
+        const unsigned long long deadline = EventClock::now() +
+            (unsigned long long)(timeoutMilliseconds > 0 ? timeoutMilliseconds : 0) * 1000000ull;
+        while(true) {
+            int remaining = -1;
+            if(timeoutMilliseconds >= 0) {
+                const unsigned long long now = EventClock::now();
+                remaining = now < deadline ? (int)((deadline - now) / 1000000ull) : 0;
+            }
+            struct pollfd descriptors;
+            descriptors.fd = descriptor;
+            descriptors.events = POLLIN;
+            descriptors.revents = 0;
+            if(poll(&descriptors, 1, remaining) <= 0) {
+                return false;
+            }
+            uint8_t type = 0;
+            if(!readFrame(type)) {
+                return false;
+            }
+            if(type == kRemoteControlChanges) {
+                return decodeValues(reply, changes);
+            }
+        }
+    }
+
+private:
+    explicit RemoteControlClient(int inDescriptor) :
+    descriptor(inDescriptor), reply(), pendingChanges(), decoded() {}
+
+    bool request(uint8_t type, const char *data, size_t size, uint8_t replyType) {
+        RemoteControlFrameHeader header;
+        memset(&header, 0, sizeof(header));
+        header.size = (uint32_t)size;
+        header.type = type;
+        if(!writeFully(reinterpret_cast<const char *>(&header), sizeof(header)) ||
+           (size > 0 && !writeFully(data, size))) {
+            return false;
+        }
+
+        // Changes which arrive before the reply are kept for waitForChanges()
+        while(true) {
+            uint8_t receivedType = 0;
+            if(!readFrame(receivedType)) {
+                return false;
+            }
+            if(receivedType == replyType) {
+                return true;
+            }
+            if(receivedType == kRemoteControlChanges && decodeValues(reply, decoded)) {
+                pendingChanges.insert(pendingChanges.end(), decoded.begin(), decoded.end());
+            }
+        }
+    }
+
+    bool readFrame(uint8_t &type) {
+        RemoteControlFrameHeader header;
+        if(!readFully(reinterpret_cast<char *>(&header), sizeof(header)) ||
+           header.size > kRemoteControlMaxFrameSize) {
+            return false;
+        }
+        type = header.type;
+        reply.resize(header.size);
+        return header.size == 0 || readFully(&reply[0], header.size);
+    }
+
+    static bool decodeValues(const std::vector<char> &data, std::vector<RemoteControlValue> &values) {
+        if(data.size() % sizeof(RemoteControlValue) != 0) {
+            return false;
+        }
+        values.resize(data.size() / sizeof(RemoteControlValue));
+        if(!values.empty()) {
+            memcpy(&values[0], &data[0], data.size());
+        }
+        return true;
+    }
+
+    bool readFully(char *data, size_t size) {
+        while(size > 0) {
+            const ssize_t numBytes = recv(descriptor, data, size, 0);
+            if(numBytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if(numBytes <= 0) {
+                return false;
+            }
+            data += numBytes;
+            size -= (size_t)numBytes;
+        }
+        return true;
+    }
+
+    bool writeFully(const char *data, size_t size) {
+        while(size > 0) {
+#if defined(MSG_NOSIGNAL)
+            const ssize_t numBytes = send(descriptor, data, size, MSG_NOSIGNAL);
+#else
+            const ssize_t numBytes = send(descriptor, data, size, 0);
+#endif
+            if(numBytes < 0 && errno == EINTR) {
+                continue;
+            }
+            if(numBytes <= 0) {
+                return false;
+            }
+            data += numBytes;
+            size -= (size_t)numBytes;
+        }
+        return true;
+    }
+
+    // Disallow copy and assignment
+    RemoteControlClient(const RemoteControlClient &);
+    RemoteControlClient &operator = (const RemoteControlClient &);
+
+private:
+    int descriptor;
+    std::vector<char> reply;
+    std::vector<RemoteControlValue> pendingChanges;
+    std::vector<RemoteControlValue> decoded;
+};
+#endif // PLUGINPARAMETERS_MULTITHREADED && !WIN32
+
+} // namespace teragon
+
+#endif // __PluginParameters_RemoteControlServer_h__
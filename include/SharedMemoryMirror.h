@@ -0,0 +1,446 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __PluginParameters_SharedMemoryMirror_h__
+#define __PluginParameters_SharedMemoryMirror_h__
+
+#include <string.h>
+#include <map>
+#include <vector>
+#include "ConcurrentParameterSet.h"
+
+#if PLUGINPARAMETERS_MULTITHREADED
+#include <atomic>
+#include <stdint.h>
+#if WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#endif
+
+namespace teragon {
+
+#if PLUGINPARAMETERS_MULTITHREADED
+static const uint32_t kSharedMemoryMirrorMagic = 0x50504d52; // "PPMR"
+static const uint32_t kSharedMemoryMirrorVersion = 1;
+// Names longer than this are truncated in the mirror
+static const size_t kSharedMemoryMirrorMaxNameLength = 39;
+
+/**
+ * Header of a shared memory segment created by SharedMemoryMirror. It is
+ * followed by one SharedMemoryMirrorSlot per parameter.
+ */
+class SharedMemoryMirrorHeader {
+public:
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numParameters;
+    uint32_t slotSize;
+    // Incremented after every change, so that readers can skip scanning the
+    // slots when nothing has changed
+    std::atomic<uint64_t> sequence;
+    char reserved[40];
+};
+
+/**
+ * Mirrored state of a single parameter, which occupies its own cache line.
+ * The slot is protected by a sequence lock: the writer makes the sequence odd
+ * before changing the slot and even afterwards, and readers retry whenever
+ * the sequence was odd or changed while they were reading.
+ */
+class SharedMemoryMirrorSlot {
+public:
+    std::atomic<uint32_t> sequence;
+    uint32_t reserved;
+    std::atomic<uint64_t> changeCount;
+    // Value as a double, so that the layout does not depend on ParameterValue
+    std::atomic<uint64_t> valueBits;
+    char name[kSharedMemoryMirrorMaxNameLength + 1];
+};
+
+// The layout is shared with processes which may have been built differently
+static_assert(sizeof(SharedMemoryMirrorHeader) == 64, "Unexpected size of SharedMemoryMirrorHeader");
+static_assert(sizeof(SharedMemoryMirrorSlot) == 64, "Unexpected size of SharedMemoryMirrorSlot");
+static_assert(ATOMIC_INT_LOCK_FREE != 0 && ATOMIC_LLONG_LOCK_FREE != 0,
+              "SharedMemoryMirror requires lock-free 32 and 64 bit atomics");
+
+/**
+ * Atomics which are not lock-free are protected by a lock which is private to
+ * each process, so the sequence locks in the segment would not work between
+ * processes. Some targets, such as older 32-bit x86 CPUs, only decide this at
+ * runtime.
+ *
+ * @return True if the atomics used in the segment are lock-free
+ */
+static inline bool isSharedMemoryMirrorLockFree() {
+    const std::atomic<uint32_t> sequence(0);
+    const std::atomic<uint64_t> bits(0);
+    return sequence.is_lock_free() && bits.is_lock_free();
+}
+
+/**
+ * Publishes the values of a ConcurrentParameterSet in a named shared memory
+ * segment, so that a GUI which runs in another process can read them without
+ * any inter-process messages (see SharedMemoryMirrorReader). The mirror is an
+ * asynchronous observer of all parameters, so it is written by the set's
+ * asynchronous thread and never by the realtime thread.
+ *
+ * The mirror must be created after all parameters have been added to the set,
+ * and destroyed before the set. Data parameters are mirrored by their change
+ * counters only, since their contents may be of any size.
+ */
+class SharedMemoryMirror : public ParameterObserver {
+public:
+    /**
+     * Create the mirror and its shared memory segment. An existing segment
+     * with the same name is replaced.
+     *
+     * @param inParameters Parameter set to mirror
+     * @param inName Name of the segment, which should start with a slash and
+     *               be unique to the plugin instance, for example
+     *               "/myplugin-1234"
+     */
+    SharedMemoryMirror(ConcurrentParameterSet &inParameters, const ParameterString &inName) :
+    ParameterObserver(), name(inName), size(0), memory(NULL), header(NULL), slots(NULL), indices() {
+        if(!isSharedMemoryMirrorLockFree()) {
+            return;
+        }
+        size = sizeof(SharedMemoryMirrorHeader) + inParameters.size() * sizeof(SharedMemoryMirrorSlot);
+#if WIN32
+        HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                            0, (DWORD)size, getMappingName(name).c_str());
+        if(mapping != NULL) {
+            memory = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+            // The view keeps the mapping alive after its handle is closed
+            CloseHandle(mapping);
+        }
+#else
+        shm_unlink(name.c_str());
+        int file = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, S_IRUSR | S_IWUSR);
+        if(file >= 0) {
+            if(ftruncate(file, (off_t)size) == 0) {
+                memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+                if(memory == MAP_FAILED) {
+                    memory = NULL;
+                }
+            }
+            close(file);
+        }
+#endif
+        if(memory == NULL) {
+            return;
+        }
+
+        header = reinterpret_cast<SharedMemoryMirrorHeader *>(memory);
+        slots = reinterpret_cast<SharedMemoryMirrorSlot *>(header + 1);
+        memset(memory, 0, size);
+        for(size_t i = 0; i < inParameters.size(); i++) {
+            Parameter *parameter = inParameters.get((int)i);
+            SharedMemoryMirrorSlot &slot = slots[i];
+            strncpy(slot.name, parameter->getSafeName().c_str(), kSharedMemoryMirrorMaxNameLength);
+            slot.valueBits.store(toBits(parameter->getValue()));
+            indices[parameter] = i;
+            parameter->addObserver(this);
+        }
+        header->numParameters = (uint32_t)inParameters.size();
+        header->slotSize = sizeof(SharedMemoryMirrorSlot);
+        header->version = kSharedMemoryMirrorVersion;
+        // Readers check the magic last, so it is written once the header is complete
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = kSharedMemoryMirrorMagic;
+    }
+
+    /**
+     * Unmap the segment and remove its name. Readers which have already
+     * opened the segment can still read the last values.
+     */
+    virtual ~SharedMemoryMirror() {
+        for(IndexMap::iterator iterator = indices.begin(); iterator != indices.end(); ++iterator) {
+            iterator->first->removeObserver(this);
+        }
+        if(memory != NULL) {
+#if WIN32
+            UnmapViewOfFile(memory);
+#else
+            munmap(memory, size);
+            shm_unlink(name.c_str());
+#endif
+        }
+    }
+
+    /**
+     * @return True if the shared memory segment was created, which fails if
+     *         the platform's atomics are not lock-free
+     */
+    bool isValid() const {
+        return memory != NULL;
+    }
+
+    const ParameterString &getName() const {
+        return name;
+    }
+
+    virtual bool isRealtimePriority() const {
+        return false;
+    }
+
+    virtual void onParameterUpdated(const Parameter *parameter) {
+        IndexMap::const_iterator iterator = indices.find(const_cast<Parameter *>(parameter));
+        if(iterator == indices.end()) {
+            return;
+        }
+
+        SharedMemoryMirrorSlot &slot = slots[iterator->second];
+        const uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+        slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.valueBits.store(toBits(parameter->getValue()), std::memory_order_relaxed);
+        slot.changeCount.store(slot.changeCount.load(std::memory_order_relaxed) + 1,
+                               std::memory_order_relaxed);
+        slot.sequence.store(sequence + 2, std::memory_order_release);
+        header->sequence.fetch_add(1, std::memory_order_release);
+    }
+
+#if WIN32
+    static ParameterString getMappingName(const ParameterString &inName) {
+        // Slashes are not allowed in the names of Windows kernel objects
+        ParameterString result = "Local\\";
+        result.append(inName[0] == '/' ? inName.substr(1) : inName);
+        return result;
+    }
+#endif
+
+private:
+    static uint64_t toBits(const ParameterValue value) {
+        const double doubleValue = (double)value;
+        uint64_t result;
+        memcpy(&result, &doubleValue, sizeof(result));
+        return result;
+    }
+
+    typedef std::map<Parameter *, size_t> IndexMap;
+
+    // Disallow copy and assignment
+    SharedMemoryMirror(const SharedMemoryMirror &);
+    SharedMemoryMirror &operator = (const SharedMemoryMirror &);
+
+private:
+    const ParameterString name;
+    size_t size;
+    void *memory;
+    SharedMemoryMirrorHeader *header;
+    SharedMemoryMirrorSlot *slots;
+    IndexMap indices;
+};
+
+/**
+ * Reads the values published by a SharedMemoryMirror, typically in a GUI
+ * process. After the segment has been opened, reading values and polling for
+ * changes only reads memory, without any system calls or locks, so that it
+ * is cheap enough to do on every frame.
+ */
+class SharedMemoryMirrorReader {
+public:
+    /**
+     * Open a segment created by SharedMemoryMirror.
+     *
+     * @param inName Name which was given to the mirror
+     * @return New reader, or NULL if the segment does not exist or is invalid
+     */
+    static SharedMemoryMirrorReader *open(const ParameterString &inName) {
+        if(!isSharedMemoryMirrorLockFree()) {
+            return NULL;
+        }
+        void *memory = NULL;
+        size_t size = 0;
+#if WIN32
+        HANDLE mapping = OpenFileMappingA(FILE_MAP_READ, FALSE,
+                                          SharedMemoryMirror::getMappingName(inName).c_str());
+        if(mapping == NULL) {
+            return NULL;
+        }
+        memory = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        MEMORY_BASIC_INFORMATION info;
+        if(memory != NULL && VirtualQuery(memory, &info, sizeof(info)) != 0) {
+            size = info.RegionSize;
+        }
+#else
+        int file = shm_open(inName.c_str(), O_RDONLY, 0);
+        if(file < 0) {
+            return NULL;
+        }
+        struct stat info;
+        if(fstat(file, &info) == 0 && info.st_size > 0) {
+            size = (size_t)info.st_size;
+            memory = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+            if(memory == MAP_FAILED) {
+                memory = NULL;
+            }
+        }
+        close(file);
+#endif
+        if(memory == NULL) {
+            return NULL;
+        }
+
+        const SharedMemoryMirrorHeader *header = reinterpret_cast<const SharedMemoryMirrorHeader *>(memory);
+        // The count is only read once, since the header is writable by the
+        // other process and must not change after it has been checked
+        const size_t numParameters = size >= sizeof(SharedMemoryMirrorHeader) ? header->numParameters : 0;
+        const bool isValid = size >= sizeof(SharedMemoryMirrorHeader) &&
+                             header->magic == kSharedMemoryMirrorMagic &&
+                             header->version == kSharedMemoryMirrorVersion &&
+                             header->slotSize == sizeof(SharedMemoryMirrorSlot) &&
+                             (size - sizeof(SharedMemoryMirrorHeader)) / sizeof(SharedMemoryMirrorSlot) >=
+                             numParameters;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if(!isValid) {
+            unmap(memory, size);
+            return NULL;
+        }
+        return new SharedMemoryMirrorReader(memory, size, numParameters);
+    }
+
+    virtual ~SharedMemoryMirrorReader() {
+        unmap(memory, size);
+    }
+
+    size_t getNumParameters() const {
+        return numParameters;
+    }
+
+    /**
+     * @return Safe name of the parameter at the given index, or an empty
+     *         string if the index is out of range
+     */
+    ParameterString getName(size_t index) const {
+        if(index >= numParameters) {
+            return ParameterString();
+        }
+        const char *slotName = slots[index].name;
+        return ParameterString(slotName, strnlen(slotName, kSharedMemoryMirrorMaxNameLength + 1));
+    }
+
+    /**
+     * Read the value of a parameter. This method never blocks, but retries if
+     * the value is being written at the same time.
+     *
+     * @param index Parameter index
+     * @param outChangeCount If not NULL, receives the number of changes which
+     *                       were made to the parameter, consistent with the
+     *                       returned value
+     * @return The value, or 0 if the index is out of range
+     */
+    double getValue(size_t index, unsigned long long *outChangeCount = NULL) const {
+        if(index >= numParameters) {
+            if(outChangeCount != NULL) {
+                *outChangeCount = 0;
+            }
+            return 0.0;
+        }
+        const SharedMemoryMirrorSlot &slot = slots[index];
+        while(true) {
+            const uint32_t before = slot.sequence.load(std::memory_order_acquire);
+            if((before & 1) == 0) {
+                const uint64_t bits = slot.valueBits.load(std::memory_order_relaxed);
+                const uint64_t changeCount = slot.changeCount.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if(slot.sequence.load(std::memory_order_relaxed) == before) {
+                    if(outChangeCount != NULL) {
+                        *outChangeCount = changeCount;
+                    }
+                    double result;
+                    memcpy(&result, &bits, sizeof(result));
+                    return result;
+                }
+            }
+            tthread::this_thread::yield();
+        }
+    }
+
+    /**
+     * Find the parameters which have changed since the last call to this
+     * method. If nothing has changed, this only reads a single counter.
+     *
+     * @param changedIndices Receives the indices of the changed parameters
+     * @return Number of changed parameters
+     */
+    size_t poll(std::vector<size_t> &changedIndices) {
+        changedIndices.clear();
+        const uint64_t sequence = header->sequence.load(std::memory_order_acquire);
+        if(sequence == lastSequence) {
+            return 0;
+        }
+        lastSequence = sequence;
+        for(size_t i = 0; i < numParameters; i++) {
+            const uint64_t changeCount = slots[i].changeCount.load(std::memory_order_acquire);
+            if(changeCount != changeCounts[i]) {
+                changeCounts[i] = changeCount;
+                changedIndices.push_back(i);
+            }
+        }
+        return changedIndices.size();
+    }
+
+private:
+    SharedMemoryMirrorReader(void *inMemory, size_t inSize, size_t inNumParameters) :
+    memory(inMemory), size(inSize), numParameters(inNumParameters),
+    header(reinterpret_cast<const SharedMemoryMirrorHeader *>(inMemory)),
+    slots(reinterpret_cast<const SharedMemoryMirrorSlot *>(header + 1)),
+    lastSequence(0), changeCounts(inNumParameters, 0) {}
+
+    static void unmap(void *inMemory, size_t inSize) {
+#if WIN32
+        UnmapViewOfFile(inMemory);
+#else
+        munmap(inMemory, inSize);
+#endif
+    }
+
+    // Disallow copy and assignment
+    SharedMemoryMirrorReader(const SharedMemoryMirrorReader &);
+    SharedMemoryMirrorReader &operator = (const SharedMemoryMirrorReader &);
+
+private:
+    void *memory;
+    const size_t size;
+    // Number of slots which were checked to fit into the mapping
+    const size_t numParameters;
+    const SharedMemoryMirrorHeader *header;
+    const SharedMemoryMirrorSlot *slots;
+    uint64_t lastSequence;
+    std::vector<uint64_t> changeCounts;
+};
+#endif // PLUGINPARAMETERS_MULTITHREADED
+
+} // namespace teragon
+
+#endif // __PluginParameters_SharedMemoryMirror_h__
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __PluginParameters_StateStream_h__
+#define __PluginParameters_StateStream_h__
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "ParameterSet.h"
+#if PLUGINPARAMETERS_MULTITHREADED
+#include "ConcurrentParameterSet.h"
+#endif
+
+namespace teragon {
+
+#if PLUGINPARAMETERS_MULTITHREADED
+// State must be applied through the set so that changes reach the right thread
+typedef ConcurrentParameterSet StateParameterSet;
+#else
+typedef ParameterSet StateParameterSet;
+#endif
+
+/**
+ * Destination for serialized parameter state. Writers buffer their output and
+ * pass it on in large chunks, so implementations need not do any buffering.
+ */
+class StateOutput {
+public:
+    StateOutput() {}
+    virtual ~StateOutput() {}
+
+    /**
+     * @param data Data to write
+     * @param size Data size, in bytes
+     * @return True if all data was written
+     */
+    virtual bool write(const char *data, size_t size) = 0;
+};
+
+/**
+ * Source of serialized parameter state.
+ */
+class StateInput {
+public:
+    StateInput() {}
+    virtual ~StateInput() {}
+
+    /**
+     * @param data Buffer to receive the data
+     * @param size Size of the buffer, in bytes
+     * @return Number of bytes which were read, or 0 at the end of the input
+     */
+    virtual size_t read(char *data, size_t size) = 0;
+};
+
+/**
+ * Appends state to a string.
+ */
+class StringStateOutput : public StateOutput {
+public:
+    explicit StringStateOutput(std::string &inString) : StateOutput(), string(inString) {}
+    virtual ~StringStateOutput() {}
+
+    virtual bool write(const char *data, size_t size) {
+        string.append(data, size);
+        return true;
+    }
+
+private:
+    std::string &string;
+};
+
+/**
+ * Reads state from a block of memory, which must remain valid while reading.
+ */
+class MemoryStateInput : public StateInput {
+public:
+    MemoryStateInput(const char *inData, size_t inSize) : StateInput(),
+    data(inData), size(inSize), position(0) {}
+    virtual ~MemoryStateInput() {}
+
+    virtual size_t read(char *buffer, size_t bufferSize) {
+        const size_t numBytes = bufferSize < size - position ? bufferSize : size - position;
+        memcpy(buffer, data + position, numBytes);
+        position += numBytes;
+        return numBytes;
+    }
+
+private:
+    const char *data;
+    const size_t size;
+    size_t position;
+};
+
+/**
+ * Writes state to a file which was opened by the caller.
+ */
+class FileStateOutput : public StateOutput {
+public:
+    explicit FileStateOutput(FILE *inFile) : StateOutput(), file(inFile) {}
+    virtual ~FileStateOutput() {}
+
+    virtual bool write(const char *data, size_t size) {
+        return fwrite(data, 1, size, file) == size;
+    }
+
+private:
+    FILE *file;
+};
+
+/**
+ * Reads state from a file which was opened by the caller.
+ */
+class FileStateInput : public StateInput {
+public:
+    explicit FileStateInput(FILE *inFile) : StateInput(), file(inFile) {}
+    virtual ~FileStateInput() {}
+
+    virtual size_t read(char *data, size_t size) {
+        return fread(data, 1, size, file);
+    }
+
+private:
+    FILE *file;
+};
+
+} // namespace teragon
+
+#endif // __PluginParameters_StateStream_h__
@@ -34,25 +34,21 @@ class StringParameter : public DataParameter {
 public:
     StringParameter(const ParameterString &inName,
                     ParameterString inDefaultValue = "") :
-    DataParameter(inName), stringValue(inDefaultValue) {}
+    DataParameter(inName, DataBuffer::create(inDefaultValue.data(), inDefaultValue.size())) {}
 
     virtual ~StringParameter() {}
 
-    virtual const ParameterString getDisplayText() const {
-        return stringValue;
+    virtual Parameter *clone() const {
+        return new StringParameter(*this);
     }
 
-#if PLUGINPARAMETERS_MULTITHREADED
-protected:
-#endif
-
-    virtual void setValue(const void *inData, const size_t inDataSize) {
-        stringValue.assign((const char *)inData, inDataSize);
-        notifyObservers();
+    virtual const ParameterString getDisplayText() const {
+        const DataBuffer *current = getBuffer();
+        return current != NULL ? ParameterString(current->getData(), current->getSize()) : ParameterString();
     }
 
-private:
-    ParameterString stringValue;
+protected:
+    StringParameter(const StringParameter &other) : DataParameter(other, copyBuffer(other)) {}
 };
 
 } // namespace teragon
@@ -39,6 +39,10 @@ public:
 
     virtual ~VoidParameter() {}
 
+    virtual Parameter *clone() const {
+        return new VoidParameter(*this);
+    }
+
     virtual const ParameterString getDisplayText() const {
         return "Triggered";
     }
@@ -0,0 +1,477 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <limits>
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define HAVE_MALLINFO2 1
+#endif
+
+// Force multi-threaded build
+#define PLUGINPARAMETERS_MULTITHREADED 1
+#include "PluginParameters.h"
+#include "PresetBank.h"
+#include "RemoteControlHost.h"
+
+// Length of each timed benchmark run
+#define BENCHMARK_DURATION_MS 2000
+
+namespace teragon {
+
+////////////////////////////////////////////////////////////////////////////////
+// Helpers
+////////////////////////////////////////////////////////////////////////////////
+
+static void printResult(const char *name, double value, const char *unit) {
+    printf("%-48s %12.2f %s\n", name, value, unit);
+}
+
+static void fillParameterSet(ParameterSet &s, const int numParameters) {
+    for(int i = 0; i < numParameters; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "Parameter %d", i);
+        s.add(new FloatParameter(name, 0.0, 1.0, 0.5));
+    }
+}
+
+// @return Number of bytes currently allocated on the heap, or 0 if unknown
+static size_t getHeapSize() {
+#if HAVE_MALLINFO2
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+////////////////////////////////////////////////////////////////////////////////
+
+class _Benchmarks {
+public:
+    // Simulates a GUI which constantly polls all parameters, while the audio
+    // thread changes every parameter once per block.
+    class GuiPollingContext {
+    public:
+        GuiPollingContext(ConcurrentParameterSet &inParameters) :
+        parameters(inParameters), finished(false), numBlocks(0), numEvents(0) {}
+
+        ConcurrentParameterSet &parameters;
+        std::atomic<bool> finished;
+        unsigned long numBlocks;
+        unsigned long numEvents;
+    };
+
+    static void audioThreadCallback(void *arg) {
+        GuiPollingContext *context = reinterpret_cast<GuiPollingContext *>(arg);
+        ConcurrentParameterSet &s = context->parameters;
+        while(!context->finished.load()) {
+            const ParameterValue value = (context->numBlocks % 2) ? 0.25 : 0.75;
+            for(size_t i = 0; i < s.size(); i++) {
+                s.set(i, value);
+            }
+            s.processRealtimeEvents();
+            context->numBlocks++;
+            context->numEvents += s.size();
+        }
+    }
+
+    static void benchmarkGuiPollingDuringAudio() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        fillParameterSet(s, 1024);
+
+        GuiPollingContext context(s);
+        tthread::thread audioThread(audioThreadCallback, &context);
+
+        unsigned long numReads = 0;
+        size_t checksum = 0;
+        const unsigned long long start = EventClock::now();
+        const unsigned long long end = start + BENCHMARK_DURATION_MS * 1000000ull;
+        unsigned long long now = start;
+        while(now < end) {
+            for(size_t i = 0; i < s.size(); i++) {
+                const Parameter *p = s.get((int)i);
+                checksum += p->getName().size() + p->getUnit().size() + p->getDisplayPrecision();
+                checksum += p->getValue() > 0.5 ? 1 : 0;
+            }
+            numReads += s.size();
+            s.processAsyncEvents();
+            now = EventClock::now();
+        }
+        context.finished = true;
+        audioThread.join();
+        s.processAsyncEvents();
+
+        const double seconds = (double)(now - start) / 1.0e9;
+        printResult("GUI parameter reads during audio", (double)numReads / seconds / 1.0e6, "M/sec");
+        printResult("Audio events applied during GUI polling", (double)context.numEvents / seconds / 1.0e6, "M/sec");
+        if(checksum == 0) {
+            printf("(checksum %lu)\n", (unsigned long)checksum);
+        }
+    }
+
+    static double getElapsedMilliseconds(unsigned long long start) {
+        return (double)(EventClock::now() - start) / 1.0e6;
+    }
+
+    static void benchmarkParameterSetLifecycle(bool useArena) {
+        const int numParameters = 10000;
+        const int numIterations = 100;
+        char names[numParameters][32];
+        for(int i = 0; i < numParameters; i++) {
+            snprintf(names[i], sizeof(names[i]), "Parameter %d", i);
+        }
+
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        unsigned long long start = EventClock::now();
+        for(int i = 0; i < numParameters; i++) {
+            if(useArena) {
+                s.emplace<FloatParameter>(names[i], 0.0, 1.0, 0.5);
+            }
+            else {
+                s.add(new FloatParameter(names[i], 0.0, 1.0, 0.5));
+            }
+        }
+        const double constructTime = getElapsedMilliseconds(start);
+
+        start = EventClock::now();
+        double sum = 0.0;
+        for(int iteration = 0; iteration < numIterations; iteration++) {
+            for(size_t i = 0; i < s.size(); i++) {
+                sum += s.get((int)i)->getMaxValue() * s.get((int)i)->getScaledValue();
+            }
+        }
+        const double iterateTime = getElapsedMilliseconds(start) / numIterations;
+
+        start = EventClock::now();
+        s.clear();
+        const double destroyTime = getElapsedMilliseconds(start);
+
+        printResult(useArena ? "Construct 10k parameters (emplace)" : "Construct 10k parameters (new)",
+                    constructTime, "ms");
+        printResult(useArena ? "Iterate 10k parameters (emplace)" : "Iterate 10k parameters (new)",
+                    iterateTime, "ms");
+        printResult(useArena ? "Destroy 10k parameters (emplace)" : "Destroy 10k parameters (new)",
+                    destroyTime, "ms");
+        if(sum < 0.0) {
+            printf("(checksum %f)\n", sum);
+        }
+    }
+
+    static void benchmarkBulkConstruction() {
+        const int numParameters = 5000;
+        const int numIterations = 20;
+        std::vector<ParameterString> names;
+        for(int i = 0; i < numParameters; i++) {
+            char name[64];
+            snprintf(name, sizeof(name), "Channel %d Equalizer Band Gain", i);
+            names.push_back(name);
+        }
+
+        ManualEventExecutor executor;
+        double addTime = 0.0;
+        double addAllTime = 0.0;
+        double cloneTime = 0.0;
+        ConcurrentParameterSet prototype(&executor);
+        for(int i = 0; i < numParameters; i++) {
+            prototype.add(new FloatParameter(names[i], 0.0, 1.0, 0.5));
+        }
+        for(int iteration = 0; iteration < numIterations; iteration++) {
+            ConcurrentParameterSet s1(&executor);
+            unsigned long long start = EventClock::now();
+            for(int i = 0; i < numParameters; i++) {
+                s1.add(new FloatParameter(names[i], 0.0, 1.0, 0.5));
+            }
+            addTime += getElapsedMilliseconds(start);
+
+            ConcurrentParameterSet s2(&executor);
+            start = EventClock::now();
+            std::vector<Parameter *> parameters;
+            parameters.reserve(numParameters);
+            for(int i = 0; i < numParameters; i++) {
+                parameters.push_back(new FloatParameter(names[i], 0.0, 1.0, 0.5));
+            }
+            s2.addAll(parameters);
+            addAllTime += getElapsedMilliseconds(start);
+
+            ConcurrentParameterSet s3(&executor);
+            start = EventClock::now();
+            s3.cloneFrom(prototype);
+            cloneTime += getElapsedMilliseconds(start);
+        }
+
+        printResult("Build 5k parameters (add)", addTime / numIterations, "ms");
+        printResult("Build 5k parameters (addAll)", addAllTime / numIterations, "ms");
+        printResult("Build 5k parameters (cloneFrom)", cloneTime / numIterations, "ms");
+    }
+
+    static void benchmarkSmoothing() {
+        const size_t numValues = 1024;
+        const int numSteps = 100000;
+        std::vector<ParameterValue> targets(numValues, 1.0);
+        ParameterSmoother smoother(numValues, 0.001);
+        smoother.setTargets(&targets[0]);
+
+        const unsigned long long start = EventClock::now();
+        for(int i = 0; i < numSteps; i++) {
+            smoother.process();
+        }
+        const double seconds = (double)(EventClock::now() - start) / 1.0e9;
+        printResult(sizeof(ParameterValue) == sizeof(float) ?
+                    "Smoothed values (float)" : "Smoothed values (double)",
+                    (double)numValues * numSteps / seconds / 1.0e6, "M/sec");
+        if(smoother.getValues()[0] < 0.0) {
+            printf("(checksum %f)\n", (double)smoother.getValues()[0]);
+        }
+    }
+
+    static void benchmarkValidation() {
+        const int numParameters = 1024;
+        const int numPresets = 10000;
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        fillParameterSet(s, numParameters);
+        ParameterValidator validator(s);
+
+        // Every 16th value is out of range, and every 64th is NaN
+        std::vector<ParameterValue> values(numParameters);
+        size_t numInvalid = 0;
+        const unsigned long long start = EventClock::now();
+        for(int preset = 0; preset < numPresets; preset++) {
+            for(int i = 0; i < numParameters; i++) {
+                values[i] = (i % 64 == 0) ? std::numeric_limits<ParameterValue>::quiet_NaN() :
+                            (i % 16 == 0) ? 2.0 : 0.5;
+            }
+            numInvalid += validator.validate(&values[0], values.size());
+        }
+        const double seconds = (double)(EventClock::now() - start) / 1.0e9;
+        printResult("Validated preset values", (double)numParameters * numPresets / seconds / 1.0e6, "M/sec");
+        if(numInvalid == 0) {
+            printf("(checksum %lu)\n", (unsigned long)numInvalid);
+        }
+    }
+
+    // Builds the same parameters for many plugin instances, as a host would do
+    // when the plugin is loaded on many tracks.
+    static void addPluginParameters(ParameterSet &s) {
+        for(int i = 0; i < 25; i++) {
+            char name[64];
+            snprintf(name, sizeof(name), "Oscillator %d Filter Cutoff Frequency", i);
+            Parameter *p = s.add(new FrequencyParameter(name, 20.0, 20000.0, 1000.0));
+            p->setDescription("Cutoff frequency of the oscillator's low pass filter");
+            snprintf(name, sizeof(name), "Oscillator %d Output Level", i);
+            p = s.add(new DecibelParameter(name, -60.0, 6.0, 0.0));
+            p->setDescription("Output level of the oscillator before the mixer section");
+            snprintf(name, sizeof(name), "Oscillator %d Envelope Attack Time", i);
+            p = s.add(new FloatParameter(name, 0.0, 5000.0, 10.0));
+            p->setUnit("milliseconds");
+            p->setDescription("Attack time of the oscillator's amplitude envelope");
+            snprintf(name, sizeof(name), "Oscillator %d Enabled", i);
+            s.add(new BooleanParameter(name, true));
+        }
+    }
+
+    static void benchmarkJsonState() {
+        const int numIterations = 100;
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        addPluginParameters(s);
+        BlobParameter *blob = new BlobParameter("Wavetable");
+        s.add(blob);
+        std::vector<char> wavetable(256 * 1024);
+        for(size_t i = 0; i < wavetable.size(); i++) {
+            wavetable[i] = (char)(i * 7);
+        }
+        s.setData(blob, &wavetable[0], wavetable.size());
+        s.processRealtimeEvents();
+        s.processAsyncEvents();
+
+        std::string state;
+        unsigned long long start = EventClock::now();
+        for(int i = 0; i < numIterations; i++) {
+            state.clear();
+            StringStateOutput output(state);
+            JsonStateWriter writer(output);
+            writer.write(s);
+        }
+        double seconds = (double)(EventClock::now() - start) / 1.0e9;
+        printResult("Wrote JSON state", (double)state.size() * numIterations / seconds / 1.0e6, "MB/sec");
+
+        start = EventClock::now();
+        for(int i = 0; i < numIterations; i++) {
+            MemoryStateInput input(state.data(), state.size());
+            JsonStateReader reader(input);
+            reader.read(s);
+            s.processRealtimeEvents();
+            s.processAsyncEvents();
+        }
+        seconds = (double)(EventClock::now() - start) / 1.0e9;
+        printResult("Read JSON state", (double)state.size() * numIterations / seconds / 1.0e6, "MB/sec");
+    }
+
+    static void benchmarkPresetBank() {
+        const int numPresets = 10000;
+        const char *path = "PluginParametersBenchmarkBank.bin";
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        addPluginParameters(s);
+
+        PresetBankWriter writer(s);
+        for(int i = 0; i < numPresets; i++) {
+            char name[32];
+            snprintf(name, sizeof(name), "Preset %d", i);
+            s.set((size_t)(i % s.size()), 0.5);
+            s.processRealtimeEvents();
+            s.processAsyncEvents();
+            writer.add(name, s);
+        }
+        FILE *file = fopen(path, "wb");
+        if(file == NULL) {
+            return;
+        }
+        FileStateOutput output(file);
+        writer.write(output);
+        fclose(file);
+
+        unsigned long long start = EventClock::now();
+        PresetBank *bank = PresetBank::open(path);
+        size_t nameLength = 0;
+        for(size_t i = 0; bank != NULL && i < bank->getNumPresets(); i++) {
+            nameLength += bank->getPresetName(i).size();
+        }
+        double seconds = (double)(EventClock::now() - start) / 1.0e9;
+        printResult("Opened and listed preset bank", seconds * 1.0e3, "ms");
+
+        start = EventClock::now();
+        for(size_t i = 0; bank != NULL && i < bank->getNumPresets(); i++) {
+            bank->load(i, s);
+            s.processRealtimeEvents();
+            s.processAsyncEvents();
+        }
+        seconds = (double)(EventClock::now() - start) / 1.0e9;
+        printResult("Loaded presets from bank", (double)numPresets / seconds, "presets/sec");
+        if(nameLength == 0) {
+            printf("(checksum %lu)\n", (unsigned long)nameLength);
+        }
+        delete bank;
+        remove(path);
+    }
+
+#if !WIN32
+    static void benchmarkRemoteControl() {
+        const int numRoundTrips = 10000;
+        const int numBatches = 2000;
+        const size_t batchSize = 100;
+        const char *path = "PluginParametersBenchmarkRemote.sock";
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        addPluginParameters(s);
+        RemoteControlServer server(s, path);
+        RemoteControlHost host(&s, &server);
+        tthread::thread hostThread(remoteControlCallback, &host);
+        RemoteControlClient *client = RemoteControlClient::connect(path);
+        if(client != NULL) {
+            RemoteControlValue value;
+            memset(&value, 0, sizeof(value));
+            unsigned long long start = EventClock::now();
+            for(int i = 0; i < numRoundTrips; i++) {
+                value.value = (i % 2) ? 1000.0 : 2000.0;
+                client->setMany(&value, 1);
+            }
+            double seconds = (double)(EventClock::now() - start) / 1.0e9;
+            printResult("Remote control round trip", seconds * 1.0e6 / numRoundTrips, "usec");
+
+            std::vector<RemoteControlValue> values(batchSize);
+            for(size_t i = 0; i < batchSize; i++) {
+                memset(&values[i], 0, sizeof(RemoteControlValue));
+                values[i].index = (uint32_t)(i % s.size());
+            }
+            start = EventClock::now();
+            for(int i = 0; i < numBatches; i++) {
+                for(size_t j = 0; j < batchSize; j++) {
+                    values[j].value = s.get((int)values[j].index)->getMinValue() + (i % 2);
+                }
+                client->setMany(&values[0], batchSize);
+            }
+            seconds = (double)(EventClock::now() - start) / 1.0e9;
+            printResult("Remote control updates", (double)numBatches * batchSize / seconds / 1.0e6, "M/sec");
+            delete client;
+        }
+        host.done.store(true);
+        hostThread.join();
+    }
+#endif
+
+    static void benchmarkMemoryForManyInstances() {
+        const int numInstances = 500;
+        ManualEventExecutor executor;
+        std::vector<ConcurrentParameterSet *> instances;
+        size_t parameterBytes = 0;
+        const size_t initialHeapSize = getHeapSize();
+        for(int i = 0; i < numInstances; i++) {
+            ConcurrentParameterSet *s = new ConcurrentParameterSet(&executor);
+            const size_t heapSize = getHeapSize();
+            addPluginParameters(*s);
+            parameterBytes += getHeapSize() - heapSize;
+            instances.push_back(s);
+        }
+        const size_t totalBytes = getHeapSize() - initialHeapSize;
+
+        if(totalBytes == 0) {
+            printf("Heap usage is not available on this platform\n");
+        }
+        else {
+            printResult("Heap for 500 instances (total)", (double)totalBytes / 1048576.0, "MB");
+            printResult("Heap for 500 instances (parameters only)", (double)parameterBytes / 1048576.0, "MB");
+            printResult("Heap per parameter", (double)parameterBytes / (numInstances * instances.at(0)->size()), "bytes");
+        }
+        for(size_t i = 0; i < instances.size(); i++) {
+            delete instances.at(i);
+        }
+    }
+};
+
+} // namespace teragon
+
+using namespace teragon;
+
+int main(int argc, char *argv[]) {
+    _Benchmarks::benchmarkGuiPollingDuringAudio();
+    _Benchmarks::benchmarkParameterSetLifecycle(false);
+    _Benchmarks::benchmarkParameterSetLifecycle(true);
+    _Benchmarks::benchmarkBulkConstruction();
+    _Benchmarks::benchmarkSmoothing();
+    _Benchmarks::benchmarkValidation();
+    _Benchmarks::benchmarkJsonState();
+    _Benchmarks::benchmarkPresetBank();
+#if !WIN32
+    _Benchmarks::benchmarkRemoteControl();
+#endif
+    _Benchmarks::benchmarkMemoryForManyInstances();
+    return 0;
+}
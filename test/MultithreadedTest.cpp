@@ -24,10 +24,18 @@
  */
 
 #include <stdio.h>
+#include <limits>
+#if !WIN32
+#include <poll.h>
+#include <sys/stat.h>
+#endif
 
 // Force multi-threaded build
 #define PLUGINPARAMETERS_MULTITHREADED 1
 #include "PluginParameters.h"
+#include "MappedBlobParameter.h"
+#include "SharedMemoryMirror.h"
+#include "RemoteControlHost.h"
 #include "TestRunner.h"
 
 // Simulate a realtime audio system by sleeping a bit after processing events.
@@ -59,7 +67,7 @@ public:
         count++;
     }
 
-    const bool realtime;
+    bool realtime;
     int count;
 };
 
@@ -75,10 +83,28 @@ public:
     ParameterValue value;
 };
 
+// Allows tests to schedule events which were created out of order
+class TestEventSchedulingParameterSet : public ConcurrentParameterSet {
+public:
+    TestEventSchedulingParameterSet(EventExecutor *inExecutor) :
+    ConcurrentParameterSet(inExecutor) {}
+
+    bool schedule(Event *event) {
+        return scheduleOrDelete(event);
+    }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // Tests
 ////////////////////////////////////////////////////////////////////////////////
 
+static int numDeletedBuffers = 0;
+
+static void countingDeleter(void *data, void *context) {
+    numDeletedBuffers++;
+    free(data);
+}
+
 class _Tests {
 public:
     static bool testCreateConcurrentParameterSet() {
@@ -164,13 +190,13 @@ public:
         Parameter *p = s.add(new BooleanParameter("test"));
         ASSERT_NOT_NULL(p);
         ASSERT_FALSE(p->getValue());
-        s.set("invalid", true);
+        ASSERT_FALSE(s.set("invalid", true));
         int retries = TEST_NUM_BLOCKS_TO_PROCESS;
         while(!p->getValue() && retries-- > 0) {
             s.processRealtimeEvents();
             ConcurrentParameterSet::sleep(SLEEP_TIME_PER_BLOCK_MS);
         }
-        // Should silently fail (PluginParameters does not throw, and set returns void).
+        // Should silently fail (PluginParameters does not throw, and set returns false).
         ASSERT_FALSE(p->getValue());
         return true;
     }
@@ -230,13 +256,13 @@ public:
         ASSERT_NOT_NULL(p);
         ASSERT_STRING("", p->getDisplayText());
         const char *data = "hello";
-        s.setData("invalid", data, strlen(data));
+        ASSERT_FALSE(s.setData("invalid", data, strlen(data)));
         int retries = TEST_NUM_BLOCKS_TO_PROCESS;
         while(p->getDisplayText() == "" && retries-- > 0) {
             s.processRealtimeEvents();
             ConcurrentParameterSet::sleep(SLEEP_TIME_PER_BLOCK_MS);
         }
-        // Should silently fail (PluginParameters does not throw, and set returns void).
+        // Should silently fail (PluginParameters does not throw, and set returns false).
         ASSERT_STRING("", p->getDisplayText());
         return true;
     }
@@ -322,6 +348,978 @@ public:
         ASSERT_INT_EQUALS(0, asyncObserver.count);
         return true;
     }
+
+    static bool testCreateManyConcurrentParameterSetsWithService() {
+        EventDispatcherService service(2);
+        ASSERT_SIZE_EQUALS((size_t)2, service.getNumThreads());
+        for(int i = 0; i < 20; i++) {
+            // No sleep needed here, since the set does not start its own thread
+            ConcurrentParameterSet *s = new ConcurrentParameterSet(&service);
+            ASSERT_SIZE_EQUALS((size_t)0, s->size());
+            delete s;
+        }
+        return true;
+    }
+
+    static bool testThreadsafeSetParameterWithService() {
+        EventDispatcherService service(2);
+        const int numSets = 8;
+        ConcurrentParameterSet *sets[numSets];
+        TestCacheValueObserver asyncObservers[numSets];
+        for(int i = 0; i < numSets; i++) {
+            sets[i] = new ConcurrentParameterSet(&service);
+            Parameter *p = sets[i]->add(new FloatParameter("test", 0.0, 100.0, 0.0));
+            ASSERT_NOT_NULL(p);
+            asyncObservers[i].realtime = false;
+            p->addObserver(&asyncObservers[i]);
+        }
+
+        for(int i = 0; i < numSets; i++) {
+            sets[i]->set((size_t)0, (ParameterValue)(i + 1));
+        }
+        for(int i = 0; i < TEST_NUM_BLOCKS_TO_PROCESS; i++) {
+            for(int j = 0; j < numSets; j++) {
+                sets[j]->processRealtimeEvents();
+            }
+            ConcurrentParameterSet::sleep(SLEEP_TIME_PER_BLOCK_MS);
+        }
+
+        for(int i = 0; i < numSets; i++) {
+            ASSERT_INT_EQUALS(1, asyncObservers[i].count);
+            ASSERT_INT_EQUALS(i + 1, (int)asyncObservers[i].value);
+            delete sets[i];
+        }
+        return true;
+    }
+
+    static bool testThreadsafeSetParameterWithManualExecutor() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        TestCounterObserver realtimeObserver(true);
+        TestCacheValueObserver asyncObserver(false);
+        Parameter *p = s.add(new BooleanParameter("test"));
+        ASSERT_NOT_NULL(p);
+        p->addObserver(&realtimeObserver);
+        p->addObserver(&asyncObserver);
+        s.set(p, true);
+        s.processRealtimeEvents();
+        ASSERT(p->getValue());
+        ASSERT_INT_EQUALS(1, realtimeObserver.count);
+        // Nothing is delivered to async observers until the host pumps events
+        ASSERT_INT_EQUALS(0, asyncObserver.count);
+        s.processAsyncEvents();
+        ASSERT_INT_EQUALS(1, asyncObserver.count);
+        ASSERT_INT_EQUALS(1, (int)asyncObserver.value);
+        // Pumping again without any pending events should do nothing
+        s.processAsyncEvents();
+        ASSERT_INT_EQUALS(1, asyncObserver.count);
+        return true;
+    }
+
+    static bool testThreadsafeSetParameterWithThreadExecutor() {
+        ThreadEventExecutor executor(kExecutorPriorityNormal);
+        ConcurrentParameterSet s(&executor);
+        TestCounterObserver asyncObserver(false);
+        Parameter *p = s.add(new BooleanParameter("test"));
+        ASSERT_NOT_NULL(p);
+        p->addObserver(&asyncObserver);
+        s.set(p, true);
+        for(int i = 0; i < TEST_NUM_BLOCKS_TO_PROCESS; i++) {
+            s.processRealtimeEvents();
+            ConcurrentParameterSet::sleep(SLEEP_TIME_PER_BLOCK_MS);
+        }
+        ASSERT(p->getValue());
+        ASSERT_INT_EQUALS(1, asyncObserver.count);
+        return true;
+    }
+
+    static bool testAsyncEventsAreBatched() {
+        // Use a long batching window so that the result does not depend on timing
+        ThreadEventExecutor executor(kExecutorPriorityLow, 0, EventBatchingOptions(50000, 1000, 0));
+        ConcurrentParameterSet s(&executor);
+        TestCounterObserver asyncObserver(false);
+        const int numParameters = 10;
+        for(int i = 0; i < numParameters; i++) {
+            char name[16];
+            snprintf(name, sizeof(name), "test%d", i);
+            s.add(new BooleanParameter(name))->addObserver(&asyncObserver);
+        }
+
+        for(int i = 0; i < numParameters; i++) {
+            s.set((size_t)i, true);
+        }
+        s.processRealtimeEvents();
+        for(int i = 0; i < TEST_NUM_BLOCKS_TO_PROCESS && asyncObserver.count < numParameters; i++) {
+            ConcurrentParameterSet::sleep(SLEEP_TIME_PER_BLOCK_MS);
+        }
+        ASSERT_INT_EQUALS(numParameters, asyncObserver.count);
+
+        EventDispatcherStatistics statistics = s.getAsyncStatistics();
+        ASSERT_INT_EQUALS(numParameters, (int)statistics.numEvents);
+        ASSERT_INT_EQUALS(1, (int)statistics.numBatches);
+        ASSERT_INT_EQUALS(numParameters, (int)statistics.maxBatchSize);
+        ASSERT_EQUALS((double)numParameters, statistics.getAverageBatchSize());
+        return true;
+    }
+
+    static bool testSetFailsWhenRealtimeQueueIsFull() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor, EventQueueOptions(16, kEventOverflowFail));
+        TestCacheValueObserver realtimeObserver(true);
+        Parameter *p = s.add(new FloatParameter("test", 0.0, 1000.0, 0.0));
+        p->addObserver(&realtimeObserver);
+
+        // The queue may hold slightly more than the requested capacity
+        int numScheduled = 0;
+        while(numScheduled < 1000 && s.set(p, (ParameterValue)(numScheduled + 1))) {
+            numScheduled++;
+        }
+        ASSERT(numScheduled >= 16);
+        ASSERT(numScheduled < 1000);
+        ASSERT_INT_EQUALS(1, (int)s.getRealtimeStatistics().numOverflows);
+
+        s.processRealtimeEvents();
+        ASSERT_INT_EQUALS(numScheduled, realtimeObserver.count);
+        ASSERT_INT_EQUALS(numScheduled, (int)p->getValue());
+        ASSERT(s.set(p, 1000.0));
+        s.processRealtimeEvents();
+        ASSERT_EQUALS(1000.0, p->getValue());
+        s.processAsyncEvents();
+        return true;
+    }
+
+    static bool testCoalesceOverflowedRealtimeEvents() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor, EventQueueOptions(16, kEventOverflowCoalesce));
+        TestCacheValueObserver realtimeObserver(true);
+        TestCacheValueObserver asyncObserver(false);
+        Parameter *p = s.add(new FloatParameter("test", 0.0, 1000.0, 0.0));
+        p->addObserver(&realtimeObserver);
+        p->addObserver(&asyncObserver);
+
+        const int numEvents = 500;
+        for(int i = 1; i <= numEvents; i++) {
+            ASSERT(s.set(p, (ParameterValue)i));
+        }
+        ASSERT(s.getRealtimeStatistics().numOverflows > 0);
+        s.processRealtimeEvents();
+        // Overflowed events were coalesced, but the newest value must always win
+        ASSERT_EQUALS((double)numEvents, p->getValue());
+        ASSERT_EQUALS((double)numEvents, realtimeObserver.value);
+        ASSERT(realtimeObserver.count < numEvents);
+
+        s.processAsyncEvents();
+        ASSERT_EQUALS((double)numEvents, asyncObserver.value);
+        ASSERT_INT_EQUALS(realtimeObserver.count, asyncObserver.count);
+        return true;
+    }
+
+    static bool testDropOldestOverflowedAsyncEvents() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor, EventQueueOptions(16, kEventOverflowDropOldest));
+        TestCounterObserver realtimeObserver(true);
+        TestCacheValueObserver asyncObserver(false);
+        const int numParameters = 100;
+        for(int i = 0; i < numParameters; i++) {
+            char name[16];
+            snprintf(name, sizeof(name), "test%d", i);
+            Parameter *p = s.add(new FloatParameter(name, 0.0, 1000.0, 0.0));
+            p->addObserver(&realtimeObserver);
+            p->addObserver(&asyncObserver);
+        }
+
+        for(int i = 0; i < numParameters; i++) {
+            ASSERT(s.set((size_t)i, (ParameterValue)(i + 1)));
+        }
+        s.processRealtimeEvents();
+        // Realtime events are never dropped, since that would lose their values
+        ASSERT_INT_EQUALS(numParameters, realtimeObserver.count);
+        for(int i = 0; i < numParameters; i++) {
+            ASSERT_EQUALS((double)(i + 1), s.get(i)->getValue());
+        }
+
+        const int numOverflows = (int)s.getAsyncStatistics().numOverflows;
+        ASSERT(numOverflows > 0);
+        s.processAsyncEvents();
+        ASSERT_INT_EQUALS(numParameters - numOverflows, asyncObserver.count);
+        // The newest notification should have been delivered
+        ASSERT_EQUALS((double)numParameters, asyncObserver.value);
+        return true;
+    }
+
+    static bool testProcessRealtimeEventsWithLimit() {
+        ManualEventExecutor executor;
+        // Use a small queue so that some of the events are kept in the overflow list
+        ConcurrentParameterSet s(&executor, EventQueueOptions(16, kEventOverflowCoalesce));
+        const int numParameters = 100;
+        for(int i = 0; i < numParameters; i++) {
+            char name[16];
+            snprintf(name, sizeof(name), "test%d", i);
+            s.add(new BooleanParameter(name));
+        }
+        for(int i = 0; i < numParameters; i++) {
+            s.set((size_t)i, true);
+        }
+
+        int numProcessed = 0;
+        while(numProcessed < numParameters) {
+            size_t remaining = s.processRealtimeEvents(7);
+            numProcessed = numProcessed + 7 > numParameters ? numParameters : numProcessed + 7;
+            ASSERT_SIZE_EQUALS((size_t)(numParameters - numProcessed), remaining);
+            // Events must be applied in the order in which they were scheduled
+            for(int i = 0; i < numParameters; i++) {
+                if(i < numProcessed) {
+                    ASSERT(s.get(i)->getValue());
+                }
+                else {
+                    ASSERT_FALSE(s.get(i)->getValue());
+                }
+            }
+        }
+        s.processAsyncEvents();
+        return true;
+    }
+
+    static bool testProcessRealtimeEventsWithTimeBudget() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        s.add(new BooleanParameter("test1"));
+        s.add(new BooleanParameter("test2"));
+        s.set((size_t)0, true);
+        s.set((size_t)1, true);
+        // Even with an impossibly small budget, one event should be processed
+        ASSERT_SIZE_EQUALS((size_t)1, s.processRealtimeEvents((size_t)-1, 1));
+        ASSERT(s.get(0)->getValue());
+        ASSERT_FALSE(s.get(1)->getValue());
+        ASSERT_SIZE_EQUALS((size_t)0, s.processRealtimeEvents((size_t)-1, 1000000000ull));
+        ASSERT(s.get(1)->getValue());
+        s.processAsyncEvents();
+        return true;
+    }
+
+    static bool testUrgentEventsAreProcessedFirst() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        const int numParameters = 500;
+        for(int i = 0; i < numParameters; i++) {
+            char name[16];
+            snprintf(name, sizeof(name), "test%d", i);
+            s.add(new BooleanParameter(name));
+        }
+        Parameter *bypass = s.add(new BooleanParameter("bypass"), kParameterPriorityUrgent);
+        ASSERT_NOT_NULL(bypass);
+        ASSERT_INT_EQUALS(kParameterPriorityUrgent, bypass->getPriority());
+        ASSERT_INT_EQUALS(kParameterPriorityNormal, s.get(0)->getPriority());
+
+        for(int i = 0; i < numParameters; i++) {
+            s.set((size_t)i, true);
+        }
+        s.set(bypass, true);
+        ASSERT_SIZE_EQUALS((size_t)numParameters, s.processRealtimeEvents(1));
+        ASSERT(bypass->getValue());
+        ASSERT_FALSE(s.get(0)->getValue());
+
+        // Urgent events which arrive during a partially processed load also
+        // overtake the remaining normal events
+        ASSERT_SIZE_EQUALS((size_t)(numParameters - 10), s.processRealtimeEvents(10));
+        s.set(bypass, false);
+        ASSERT_SIZE_EQUALS((size_t)(numParameters - 10), s.processRealtimeEvents(1));
+        ASSERT_FALSE(bypass->getValue());
+        ASSERT(s.get(9)->getValue());
+        ASSERT_FALSE(s.get(10)->getValue());
+
+        s.processRealtimeEvents();
+        ASSERT(s.get(numParameters - 1)->getValue());
+        s.processAsyncEvents();
+        return true;
+    }
+
+    static bool testStaleEventsAreDiscarded() {
+        ManualEventExecutor executor;
+        TestEventSchedulingParameterSet s(&executor);
+        Parameter *p = s.add(new FloatParameter("test", 0.0, 1.0, 0.0));
+        ASSERT_NOT_NULL(p);
+        TestCacheValueObserver realtimeObserver(true);
+        TestCounterObserver asyncObserver(false);
+        p->addObserver(&realtimeObserver);
+        p->addObserver(&asyncObserver);
+
+        Event *olderEvent = new Event(p, 0.25, true);
+        Event *newerEvent = new Event(p, 0.75, true);
+        ASSERT(s.schedule(newerEvent));
+        ASSERT(s.schedule(olderEvent));
+        s.processRealtimeEvents();
+        s.processAsyncEvents();
+
+        ASSERT_EQUALS(0.75, p->getValue());
+        ASSERT_EQUALS(0.75, realtimeObserver.value);
+        ASSERT_INT_EQUALS(1, realtimeObserver.count);
+        ASSERT_INT_EQUALS(1, asyncObserver.count);
+        ASSERT_INT_EQUALS(1, (int)s.getRealtimeStatistics().numStaleEvents);
+        return true;
+    }
+
+    static bool testNudgeSumsDeltas() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        Parameter *p = s.add(new FloatParameter("test", 0.0, 1.0, 0.5));
+        ASSERT_NOT_NULL(p);
+        TestCounterObserver observer(true);
+        p->addObserver(&observer);
+
+        ASSERT(s.nudge(p, 0.125));
+        ASSERT(s.nudge("test", 0.125));
+        ASSERT(s.nudge((size_t)0, -0.0625));
+        ASSERT_FALSE(s.nudge("invalid", 0.125));
+        // All deltas should have been summed into a single event
+        ASSERT_SIZE_EQUALS((size_t)0, s.processRealtimeEvents(1));
+        ASSERT_EQUALS(0.6875, p->getValue());
+        ASSERT_INT_EQUALS(1, observer.count);
+
+        // Deltas are applied after other changes, and clamped
+        s.set(p, 0.25);
+        s.nudge(p, 2.0);
+        s.processRealtimeEvents();
+        ASSERT_EQUALS(1.0, p->getValue());
+        s.nudge(p, -4.0);
+        s.processRealtimeEvents();
+        ASSERT_EQUALS(0.0, p->getValue());
+        s.processAsyncEvents();
+        return true;
+    }
+
+    static void nudgeCallback(void *arg) {
+        ConcurrentParameterSet *s = reinterpret_cast<ConcurrentParameterSet *>(arg);
+        for(int i = 0; i < 10000; i++) {
+            s->nudge((size_t)0, 1.0);
+        }
+    }
+
+    static bool testNudgeDoesNotLoseIncrements() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        Parameter *p = s.add(new IntegerParameter("test", 0, 100000, 0));
+        ASSERT_NOT_NULL(p);
+
+        tthread::thread producer(nudgeCallback, &s);
+        for(int i = 0; i < 1000; i++) {
+            s.processRealtimeEvents();
+            s.processAsyncEvents();
+        }
+        producer.join();
+        s.processRealtimeEvents();
+        s.processAsyncEvents();
+        ASSERT_INT_EQUALS(10000, (int)p->getValue());
+        return true;
+    }
+
+    static bool testRejectedNudgeIsNotApplied() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor, EventQueueOptions(1, kEventOverflowFail));
+        Parameter *filler = s.add(new FloatParameter("filler", 0.0, 1000.0, 0.0));
+        Parameter *p = s.add(new FloatParameter("test", 0.0, 1.0, 0.5));
+        ASSERT_NOT_NULL(p);
+
+        int numScheduled = 0;
+        while(numScheduled < 1000 && s.set(filler, (ParameterValue)(numScheduled + 1))) {
+            numScheduled++;
+        }
+        ASSERT(numScheduled < 1000);
+        ASSERT_FALSE(s.nudge(p, 0.25));
+        s.processRealtimeEvents();
+        ASSERT_EQUALS(0.5, p->getValue());
+
+        // Nothing should have been left over from the rejected delta
+        ASSERT(s.nudge(p, 0.125));
+        s.processRealtimeEvents();
+        ASSERT_EQUALS(0.625, p->getValue());
+        s.processAsyncEvents();
+        return true;
+    }
+
+    struct NudgeCounter {
+        NudgeCounter() : s(NULL), numAccepted(0) {}
+        ConcurrentParameterSet *s;
+        int numAccepted;
+    };
+
+    static void countedNudgeCallback(void *arg) {
+        NudgeCounter *counter = reinterpret_cast<NudgeCounter *>(arg);
+        for(int i = 0; i < 10000; i++) {
+            if(counter->s->nudge((size_t)1, 1.0)) {
+                counter->numAccepted++;
+            }
+        }
+    }
+
+    static bool testNudgeAppliesOnlyAcceptedDeltas() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor, EventQueueOptions(1, kEventOverflowFail));
+        Parameter *filler = s.add(new FloatParameter("filler", 0.0, 1000.0, 0.0));
+        Parameter *p = s.add(new IntegerParameter("test", 0, 100000, 0));
+        ASSERT_NOT_NULL(p);
+        // Keep the queue nearly full, so that many of the deltas are rejected
+        while(s.set(filler, 1.0)) {}
+
+        NudgeCounter counter;
+        counter.s = &s;
+        tthread::thread producer(countedNudgeCallback, &counter);
+        for(int i = 0; i < 1000; i++) {
+            s.processRealtimeEvents(1);
+            s.processAsyncEvents();
+        }
+        producer.join();
+        s.processRealtimeEvents();
+        s.processAsyncEvents();
+        ASSERT(counter.numAccepted > 0);
+        ASSERT_INT_EQUALS(counter.numAccepted, (int)p->getValue());
+        return true;
+    }
+
+    static bool testCompareAndSetIsNotCoalesced() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor, EventQueueOptions(1, kEventOverflowCoalesce));
+        Parameter *filler = s.add(new FloatParameter("filler", 0.0, 1000.0, 0.0));
+        Parameter *p = s.add(new FloatParameter("test", 0.0, 1.0, 0.0));
+        ASSERT_NOT_NULL(p);
+
+        // Fill the queue, so that the following events are kept in the overflow list
+        for(int i = 1; i < 1000 && s.getRealtimeStatistics().numOverflows == 0; i++) {
+            ASSERT(s.set(filler, (ParameterValue)i));
+        }
+        ASSERT(s.getRealtimeStatistics().numOverflows > 0);
+        ASSERT(s.set(p, 0.5));
+        ASSERT(s.compareAndSet(p, 0.5, 0.75));
+        s.processRealtimeEvents();
+        s.processAsyncEvents();
+        // The comparison needs the older value, so it must not have replaced it
+        ASSERT_EQUALS(0.75, p->getValue());
+        return true;
+    }
+
+    static bool testCompareAndSet() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        Parameter *p = s.add(new FloatParameter("test", 0.0, 1.0, 0.5));
+        ASSERT_NOT_NULL(p);
+        TestCounterObserver realtimeObserver(true);
+        TestCounterObserver asyncObserver(false);
+        p->addObserver(&realtimeObserver);
+        p->addObserver(&asyncObserver);
+
+        ASSERT(s.compareAndSet(p, 0.5, 0.75));
+        ASSERT(s.compareAndSet("test", 0.5, 0.25));
+        ASSERT_FALSE(s.compareAndSet("invalid", 0.5, 0.25));
+        s.processRealtimeEvents();
+        s.processAsyncEvents();
+        ASSERT_EQUALS(0.75, p->getValue());
+        // The failed comparison should not produce any notifications
+        ASSERT_INT_EQUALS(1, realtimeObserver.count);
+        ASSERT_INT_EQUALS(1, asyncObserver.count);
+        return true;
+    }
+
+    static bool testAdoptDataWithoutCopying() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        BlobParameter *p = new BlobParameter("test");
+        s.add(p);
+        numDeletedBuffers = 0;
+
+        void *first = malloc(1024);
+        ASSERT(s.adoptData(p, first, 1024, countingDeleter));
+        s.processRealtimeEvents();
+        ASSERT(first == p->getData());
+        ASSERT_SIZE_EQUALS((size_t)1024, p->getDataSize());
+
+        void *second = malloc(2048);
+        ASSERT(s.adoptData("test", second, 2048, countingDeleter));
+        s.processRealtimeEvents();
+        ASSERT(second == p->getData());
+        ASSERT_INT_EQUALS(0, numDeletedBuffers);
+        // The first buffer is freed on the async thread
+        s.processAsyncEvents();
+        ASSERT_INT_EQUALS(1, numDeletedBuffers);
+
+        // Data is also deleted when the change fails
+        ASSERT_FALSE(s.adoptData("invalid", malloc(16), 16, countingDeleter));
+        ASSERT_INT_EQUALS(2, numDeletedBuffers);
+        return true;
+    }
+
+    static bool testChunkedBlobUpload() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        BlobParameter *p = new BlobParameter("test");
+        s.add(p);
+        TestCounterObserver realtimeObserver(true);
+        TestCounterObserver asyncObserver(false);
+        p->addObserver(&realtimeObserver);
+        p->addObserver(&asyncObserver);
+
+        unsigned char chunk[100];
+        ASSERT(p->beginUpload(250));
+        ASSERT(p->isUploading());
+        for(int i = 0; i < 3; i++) {
+            memset(chunk, i + 1, sizeof(chunk));
+            s.writeUpload(p, chunk, sizeof(chunk));
+        }
+        ASSERT_EQUALS(1.0, p->getUploadProgress());
+        // Progress is only reported to async observers
+        s.processRealtimeEvents();
+        ASSERT_INT_EQUALS(0, realtimeObserver.count);
+        ASSERT_IS_NULL(p->getData());
+        s.processAsyncEvents();
+        ASSERT_INT_EQUALS(3, asyncObserver.count);
+
+        ASSERT(s.commitUpload(p));
+        ASSERT_FALSE(p->isUploading());
+        ASSERT_FALSE(s.commitUpload(p));
+        s.processRealtimeEvents();
+        ASSERT_INT_EQUALS(1, realtimeObserver.count);
+        ASSERT_SIZE_EQUALS((size_t)250, p->getDataSize());
+        const unsigned char *result = (const unsigned char *)p->getData();
+        ASSERT_INT_EQUALS(1, (int)result[0]);
+        ASSERT_INT_EQUALS(2, (int)result[100]);
+        ASSERT_INT_EQUALS(3, (int)result[249]);
+        s.processAsyncEvents();
+        ASSERT_INT_EQUALS(4, asyncObserver.count);
+        return true;
+    }
+
+    static bool testMapFileInManyInstances() {
+        const char *path = "MultithreadedTestMapped.bin";
+        const char *data = "mapped contents";
+        FILE *file = fopen(path, "wb");
+        ASSERT_NOT_NULL(file);
+        fwrite(data, 1, strlen(data), file);
+        fclose(file);
+
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s1(&executor);
+        ConcurrentParameterSet s2(&executor);
+        MappedBlobParameter *p1 = new MappedBlobParameter("test");
+        MappedBlobParameter *p2 = new MappedBlobParameter("test");
+        s1.add(p1);
+        s2.add(p2);
+        ASSERT(mapFile(s1, p1, path));
+        ASSERT(mapFile(s2, p2, path, true));
+        ASSERT_FALSE(mapFile(s1, p1, "invalid/path.bin"));
+        s1.processRealtimeEvents();
+        s2.processRealtimeEvents();
+        ASSERT(memcmp(data, p1->getData(), strlen(data)) == 0);
+        ASSERT(memcmp(data, p2->getData(), strlen(data)) == 0);
+        ASSERT_STRING(path, p1->getPath());
+        ASSERT(p1->getContentHash() == p2->getContentHash());
+
+        // Replacing the contents releases the mapping on the async thread
+        ASSERT(s1.setData(p1, data, 6));
+        s1.processRealtimeEvents();
+        s1.processAsyncEvents();
+        s2.processAsyncEvents();
+        ASSERT_IS_NULL(p1->getMappedFile());
+        ASSERT_STRING("(Data)", p1->getDisplayText());
+        ASSERT_INT_EQUALS(0, (int)p1->getContentHash());
+        remove(path);
+        return true;
+    }
+
+    static bool testSetIdenticalBlobDataIsIgnored() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        BlobParameter *p = new BlobParameter("test");
+        s.add(p);
+        TestCounterObserver observer(true);
+        p->addObserver(&observer);
+
+        const char *data = "wavetable";
+        ASSERT(s.setData(p, data, strlen(data)));
+        s.processRealtimeEvents();
+        ASSERT_INT_EQUALS(1, observer.count);
+        ASSERT(s.setData(p, data, strlen(data)));
+        s.processRealtimeEvents();
+        ASSERT_INT_EQUALS(1, observer.count);
+        s.processAsyncEvents();
+        return true;
+    }
+
+    static bool testRestoreBlobDataBeforeDispatch() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        BlobParameter *p = new BlobParameter("test");
+        s.add(p);
+
+        const char *first = "first";
+        const char *second = "second";
+        ASSERT(s.setData(p, first, strlen(first)));
+        s.processRealtimeEvents();
+        // Setting the current contents again before the other change has been
+        // applied must not be ignored, or that change would win
+        ASSERT(s.setData(p, second, strlen(second)));
+        ASSERT(s.setData(p, first, strlen(first)));
+        s.processRealtimeEvents();
+        ASSERT_SIZE_EQUALS(strlen(first), p->getDataSize());
+        ASSERT(memcmp(first, p->getData(), strlen(first)) == 0);
+        s.processAsyncEvents();
+        return true;
+    }
+
+    static bool testSetValuesFromValidatedState() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        s.add(new FloatParameter("first", 0.0, 1.0, 0.5));
+        s.add(new FloatParameter("second", 0.0, 10.0, 5.0));
+        s.add(new BooleanParameter("third"));
+
+        ParameterValue values[3] = {0.25, 20.0, 1.0};
+        ParameterValidator validator(s);
+        ASSERT_SIZE_EQUALS((size_t)1, validator.validate(values, 3));
+        ASSERT_SIZE_EQUALS((size_t)3, s.setValues(values, 3));
+        s.processRealtimeEvents();
+        s.processAsyncEvents();
+        ASSERT_EQUALS(0.25, s.get("first")->getValue());
+        ASSERT_EQUALS(10.0, s.get("second")->getValue());
+        ASSERT(s.get("third")->getValue() > 0.5);
+        return true;
+    }
+
+    static bool testReadJsonStateThroughSet() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        s.add(new FloatParameter("Gain", 0.0, 1.0, 0.5));
+        s.add(new StringParameter("Label"));
+        s.add(new BlobParameter("Table"));
+        TestCounterObserver observer(true);
+        s.get("Gain")->addObserver(&observer);
+
+        const char state[] = "{\"Gain\":0.75,\"Label\":\"name\",\"Table\":\"AQID\",\"Unknown\":null}";
+        MemoryStateInput input(state, strlen(state));
+        JsonStateReader reader(input);
+        ASSERT(reader.read(s));
+        ASSERT_SIZE_EQUALS((size_t)3, reader.getNumValuesRead());
+        ASSERT_SIZE_EQUALS((size_t)1, reader.getNumUnknownKeys());
+        // Changes are scheduled rather than applied directly
+        ASSERT_EQUALS(0.5, s.get("Gain")->getValue());
+        s.processRealtimeEvents();
+        s.processAsyncEvents();
+        ASSERT_INT_EQUALS(1, observer.count);
+        ASSERT_EQUALS(0.75, s.get("Gain")->getValue());
+        ASSERT_STRING("name", s.get("Label")->getDisplayText());
+        BlobParameter *blob = dynamic_cast<BlobParameter *>(s.get("Table"));
+        ASSERT_SIZE_EQUALS((size_t)3, blob->getDataSize());
+        ASSERT_INT_EQUALS(3, ((const char *)blob->getData())[2]);
+
+        std::string written;
+        StringStateOutput output(written);
+        JsonStateWriter writer(output);
+        ASSERT(writer.write(s));
+        ASSERT_STRING("{\"Gain\":0.75,\"Label\":\"name\",\"Table\":\"AQID\"}\n", written);
+        return true;
+    }
+
+    static bool testReadJsonStateCountsOnlyScheduledValues() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor, EventQueueOptions(1, kEventOverflowFail));
+        Parameter *filler = s.add(new FloatParameter("Filler", 0.0, 1000.0, 0.0));
+        s.add(new FloatParameter("Gain", 0.0, 1.0, 0.5));
+        s.add(new BlobParameter("Table"));
+        while(s.set(filler, 1.0)) {}
+
+        const char state[] = "{\"Gain\":0.75,\"Table\":\"AQID\"}";
+        MemoryStateInput input(state, strlen(state));
+        JsonStateReader reader(input);
+        ASSERT(reader.read(s));
+        // Both changes were rejected by the full queue
+        ASSERT_SIZE_EQUALS((size_t)0, reader.getNumValuesRead());
+        s.processRealtimeEvents();
+        s.processAsyncEvents();
+        ASSERT_EQUALS(0.5, s.get("Gain")->getValue());
+        return true;
+    }
+
+    static bool testAutosaveCoalescesWrites() {
+        const char *path = "PluginParametersTestAutosave.json";
+        const char *samplePath = "PluginParametersTestAutosave.bin";
+        const char *sample = "sample";
+        FILE *sampleFile = fopen(samplePath, "wb");
+        ASSERT_NOT_NULL(sampleFile);
+        fwrite(sample, 1, strlen(sample), sampleFile);
+        fclose(sampleFile);
+
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        s.add(new FloatParameter("Gain", 0.0, 1.0, 0.5));
+        s.add(new BlobParameter("Table"));
+        s.add(new MappedBlobParameter("Sample"));
+        ParameterAutosave *autosave = new ParameterAutosave(s, path, 20);
+        ASSERT_STRING(path, autosave->getPath());
+
+        for(int i = 1; i <= 100; i++) {
+            s.set("Gain", i / 200.0);
+        }
+        const char *data = "table";
+        s.setData("Table", data, strlen(data));
+        ASSERT(mapFile(s, s.get("Sample"), samplePath));
+        s.processRealtimeEvents();
+        s.processAsyncEvents();
+        ASSERT_SIZE_EQUALS((size_t)102, autosave->getNumChanges());
+        for(int i = 0; i < 200 && autosave->getNumWrites() == 0; i++) {
+            tthread::this_thread::sleep_for(tthread::chrono::milliseconds(10));
+        }
+        ASSERT_SIZE_EQUALS((size_t)1, autosave->getNumWrites());
+
+        // Pending changes are written when the autosave is destroyed
+        s.set("Gain", 0.75);
+        s.processRealtimeEvents();
+        s.processAsyncEvents();
+        delete autosave;
+
+        ConcurrentParameterSet t(&executor);
+        t.add(new FloatParameter("Gain", 0.0, 1.0, 0.5));
+        t.add(new BlobParameter("Table"));
+        t.add(new MappedBlobParameter("Sample"));
+        FILE *file = fopen(path, "rb");
+        ASSERT_NOT_NULL(file);
+        FileStateInput input(file);
+        // Mapped files are saved by path, rather than by their contents
+        JsonStateReader reader(input, true);
+        ASSERT(reader.read(t));
+        fclose(file);
+        t.processRealtimeEvents();
+        t.processAsyncEvents();
+        ASSERT_EQUALS(0.75, t.get("Gain")->getValue());
+        ASSERT_SIZE_EQUALS(strlen(data), dynamic_cast<BlobParameter *>(t.get("Table"))->getDataSize());
+        ASSERT_STRING(samplePath, dynamic_cast<MappedBlobParameter *>(t.get("Sample"))->getPath());
+        ASSERT_IS_NULL(fopen("PluginParametersTestAutosave.json.tmp", "rb"));
+        remove(path);
+        remove(samplePath);
+        return true;
+    }
+
+    static bool testReadValuesFromSharedMemoryMirror() {
+        const char *name = "/PluginParametersTestMirror";
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        s.add(new FloatParameter("Gain", 0.0, 1.0, 0.5));
+        s.add(new BooleanParameter("Bypass"));
+        SharedMemoryMirror *mirror = new SharedMemoryMirror(s, name);
+        ASSERT(mirror->isValid());
+        ASSERT_IS_NULL(SharedMemoryMirrorReader::open("/PluginParametersTestMissing"));
+
+        SharedMemoryMirrorReader *reader = SharedMemoryMirrorReader::open(name);
+        ASSERT_NOT_NULL(reader);
+        ASSERT_SIZE_EQUALS((size_t)2, reader->getNumParameters());
+        ASSERT_STRING("Bypass", reader->getName(1));
+        ASSERT_EQUALS(0.5, reader->getValue(0));
+        ASSERT_STRING("", reader->getName(2));
+        ASSERT_EQUALS(0.0, reader->getValue(2));
+        std::vector<size_t> changedIndices;
+        ASSERT_SIZE_EQUALS((size_t)0, reader->poll(changedIndices));
+
+        s.set("Gain", 0.25);
+        s.set("Gain", 0.75);
+        s.processRealtimeEvents();
+        // The mirror is written by the asynchronous thread
+        ASSERT_SIZE_EQUALS((size_t)0, reader->poll(changedIndices));
+        s.processAsyncEvents();
+        ASSERT_SIZE_EQUALS((size_t)1, reader->poll(changedIndices));
+        ASSERT_SIZE_EQUALS((size_t)0, changedIndices[0]);
+        unsigned long long changeCount = 0;
+        ASSERT_EQUALS(0.75, reader->getValue(0, &changeCount));
+        ASSERT_INT_EQUALS(2, (int)changeCount);
+        ASSERT_SIZE_EQUALS((size_t)0, reader->poll(changedIndices));
+
+        delete mirror;
+        // The segment stays readable until the reader is closed
+        ASSERT_EQUALS(0.75, reader->getValue(0));
+        ASSERT_IS_NULL(SharedMemoryMirrorReader::open(name));
+        delete reader;
+        return true;
+    }
+
+#if !WIN32
+    static bool testSetManyThroughRemoteControl() {
+        const char *path = "PluginParametersTestRemote.sock";
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        s.add(new FloatParameter("Gain", 0.0, 1.0, 0.5));
+        s.add(new BooleanParameter("Bypass"));
+        RemoteControlServer server(s, path);
+        ASSERT(server.isValid());
+        struct stat status;
+        ASSERT_INT_EQUALS(0, stat(path, &status));
+        ASSERT_INT_EQUALS(0, (int)(status.st_mode & (S_IRWXG | S_IRWXO)));
+        ASSERT_IS_NULL(RemoteControlClient::connect("invalid/path.sock"));
+
+        RemoteControlHost host(&s, &server);
+        tthread::thread hostThread(remoteControlCallback, &host);
+        RemoteControlClient *client = RemoteControlClient::connect(path);
+        ASSERT_NOT_NULL(client);
+
+        std::vector<ParameterString> names;
+        ASSERT(client->getNames(names));
+        ASSERT_SIZE_EQUALS((size_t)2, names.size());
+        ASSERT_STRING("Bypass", names[1]);
+        std::vector<RemoteControlValue> values;
+        ASSERT(client->subscribe(values));
+        ASSERT_SIZE_EQUALS((size_t)2, values.size());
+        ASSERT_EQUALS(0.5, values[0].value);
+
+        RemoteControlValue changes[4];
+        memset(changes, 0, sizeof(changes));
+        changes[0].index = 0;
+        changes[0].value = 0.25;
+        changes[1].index = 1;
+        changes[1].value = 1.0;
+        changes[2].index = 0;
+        changes[2].value = 0.75;
+        changes[3].index = 7;
+        size_t numApplied = 0;
+        ASSERT(client->setMany(changes, 4, &numApplied));
+        ASSERT_SIZE_EQUALS((size_t)3, numApplied);
+
+        // Wait until the last value has been sent, changes may be coalesced
+        double gain = 0.0;
+        std::vector<RemoteControlValue> received;
+        for(int i = 0; i < 100 && gain != 0.75; i++) {
+            if(client->waitForChanges(received, 10)) {
+                for(size_t j = 0; j < received.size(); j++) {
+                    if(received[j].index == 0) {
+                        gain = received[j].value;
+                    }
+                }
+            }
+        }
+        ASSERT_EQUALS(0.75, gain);
+        ASSERT(client->getValues(values));
+        ASSERT_EQUALS(1.0, values[1].value);
+
+        // Values which are not finite are rejected, others are clamped
+        changes[0].value = std::numeric_limits<double>::quiet_NaN();
+        changes[1].index = 0;
+        changes[1].value = std::numeric_limits<double>::infinity();
+        changes[2].value = 5.0;
+        ASSERT(client->setMany(changes, 3, &numApplied));
+        ASSERT_SIZE_EQUALS((size_t)1, numApplied);
+        delete client;
+
+        host.done.store(true);
+        hostThread.join();
+        ASSERT_EQUALS(1.0, s.get("Gain")->getValue());
+        return true;
+    }
+
+    static bool testRemoteControlKeepsOtherFiles() {
+        const char *path = "PluginParametersTestRemote.txt";
+        remove(path);
+        FILE *file = fopen(path, "wb");
+        ASSERT_NOT_NULL(file);
+        fclose(file);
+        ConcurrentParameterSet s;
+        s.add(new FloatParameter("Gain", 0.0, 1.0, 0.5));
+        RemoteControlServer *server = new RemoteControlServer(s, path);
+        ASSERT_FALSE(server->isValid());
+        delete server;
+        file = fopen(path, "rb");
+        ASSERT_NOT_NULL(file);
+        fclose(file);
+        remove(path);
+        return true;
+    }
+#endif
+
+    static bool testSetBlobDataSwapsBuffers() {
+        ManualEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        BlobParameter *p = new BlobParameter("test");
+        s.add(p);
+        TestCounterObserver observer(true);
+        p->addObserver(&observer);
+
+        const char *first = "first";
+        const char *second = "second value";
+        ASSERT(s.setData(p, first, strlen(first)));
+        ASSERT(s.setData(p, second, strlen(second)));
+        ASSERT_IS_NULL(p->getData());
+        s.processRealtimeEvents();
+        ASSERT_INT_EQUALS(2, observer.count);
+        ASSERT_SIZE_EQUALS(strlen(second), p->getDataSize());
+        ASSERT_STRING(second, ParameterString((const char *)p->getData()));
+
+        // Retired buffers are freed on the async thread, but the current one is kept
+        const void *data = p->getData();
+        s.processAsyncEvents();
+        ASSERT(data == p->getData());
+        ASSERT_STRING(second, ParameterString((const char *)p->getData()));
+
+        // Empty data has no effect on a blob
+        ASSERT(s.setData(p, NULL, 0));
+        s.processRealtimeEvents();
+        s.processAsyncEvents();
+        ASSERT_STRING(second, ParameterString((const char *)p->getData()));
+        return true;
+    }
+
+#if !WIN32
+    static bool isReadable(int fileDescriptor) {
+        struct pollfd descriptor;
+        descriptor.fd = fileDescriptor;
+        descriptor.events = POLLIN;
+        descriptor.revents = 0;
+        return poll(&descriptor, 1, 0) == 1 && (descriptor.revents & POLLIN);
+    }
+
+    static bool testThreadsafeSetParameterWithPollableExecutor() {
+        PollableEventExecutor executor;
+        ASSERT_FALSE(executor.getFileDescriptor() < 0);
+        ConcurrentParameterSet s1(&executor);
+        ConcurrentParameterSet s2(&executor);
+        TestCounterObserver asyncObserver1(false);
+        TestCounterObserver asyncObserver2(false);
+        Parameter *p1 = s1.add(new BooleanParameter("test"));
+        Parameter *p2 = s2.add(new BooleanParameter("test"));
+        p1->addObserver(&asyncObserver1);
+        p2->addObserver(&asyncObserver2);
+        ASSERT_FALSE(isReadable(executor.getFileDescriptor()));
+
+        s1.set(p1, true);
+        s2.set(p2, true);
+        s1.processRealtimeEvents();
+        s2.processRealtimeEvents();
+        ASSERT(isReadable(executor.getFileDescriptor()));
+        ASSERT_INT_EQUALS(0, asyncObserver1.count);
+
+        executor.processAsyncEvents();
+        ASSERT_FALSE(isReadable(executor.getFileDescriptor()));
+        ASSERT_INT_EQUALS(1, asyncObserver1.count);
+        ASSERT_INT_EQUALS(1, asyncObserver2.count);
+        return true;
+    }
+
+    static bool testPollableExecutorSignalsAgainAfterProcessing() {
+        PollableEventExecutor executor;
+        ConcurrentParameterSet s(&executor);
+        TestCounterObserver asyncObserver(false);
+        Parameter *p = s.add(new BooleanParameter("test"));
+        p->addObserver(&asyncObserver);
+
+        for(int i = 0; i < 3; i++) {
+            s.set(p, i % 2 == 0);
+            s.processRealtimeEvents();
+            ASSERT(isReadable(executor.getFileDescriptor()));
+            executor.processAsyncEvents();
+            ASSERT_FALSE(isReadable(executor.getFileDescriptor()));
+            ASSERT_INT_EQUALS(i + 1, asyncObserver.count);
+        }
+
+        // A notification without new events must also signal the descriptor
+        executor.notify(NULL);
+        ASSERT(isReadable(executor.getFileDescriptor()));
+        executor.processAsyncEvents();
+        ASSERT_FALSE(isReadable(executor.getFileDescriptor()));
+        return true;
+    }
+#endif
 };
 
 } // namespace teragon
@@ -357,6 +1355,41 @@ int main(int argc, char *argv[]) {
         ADD_TEST(_Tests::testThreadsafeSetParameterBothThreadsFromAsync());
         ADD_TEST(_Tests::testThreadsafeSetParameterBothThreadsFromRealtime());
         ADD_TEST(_Tests::testThreadsafeSetParameterWithSender());
+        ADD_TEST(_Tests::testCreateManyConcurrentParameterSetsWithService());
+        ADD_TEST(_Tests::testThreadsafeSetParameterWithService());
+        ADD_TEST(_Tests::testThreadsafeSetParameterWithManualExecutor());
+        ADD_TEST(_Tests::testThreadsafeSetParameterWithThreadExecutor());
+        ADD_TEST(_Tests::testAsyncEventsAreBatched());
+        ADD_TEST(_Tests::testSetFailsWhenRealtimeQueueIsFull());
+        ADD_TEST(_Tests::testCoalesceOverflowedRealtimeEvents());
+        ADD_TEST(_Tests::testDropOldestOverflowedAsyncEvents());
+        ADD_TEST(_Tests::testProcessRealtimeEventsWithLimit());
+        ADD_TEST(_Tests::testProcessRealtimeEventsWithTimeBudget());
+        ADD_TEST(_Tests::testUrgentEventsAreProcessedFirst());
+        ADD_TEST(_Tests::testStaleEventsAreDiscarded());
+        ADD_TEST(_Tests::testNudgeSumsDeltas());
+        ADD_TEST(_Tests::testNudgeDoesNotLoseIncrements());
+        ADD_TEST(_Tests::testRejectedNudgeIsNotApplied());
+        ADD_TEST(_Tests::testNudgeAppliesOnlyAcceptedDeltas());
+        ADD_TEST(_Tests::testCompareAndSetIsNotCoalesced());
+        ADD_TEST(_Tests::testCompareAndSet());
+        ADD_TEST(_Tests::testSetBlobDataSwapsBuffers());
+        ADD_TEST(_Tests::testAdoptDataWithoutCopying());
+        ADD_TEST(_Tests::testChunkedBlobUpload());
+        ADD_TEST(_Tests::testMapFileInManyInstances());
+        ADD_TEST(_Tests::testSetIdenticalBlobDataIsIgnored());
+        ADD_TEST(_Tests::testRestoreBlobDataBeforeDispatch());
+        ADD_TEST(_Tests::testSetValuesFromValidatedState());
+        ADD_TEST(_Tests::testReadJsonStateThroughSet());
+        ADD_TEST(_Tests::testReadJsonStateCountsOnlyScheduledValues());
+        ADD_TEST(_Tests::testAutosaveCoalescesWrites());
+        ADD_TEST(_Tests::testReadValuesFromSharedMemoryMirror());
+#if !WIN32
+        ADD_TEST(_Tests::testSetManyThroughRemoteControl());
+        ADD_TEST(_Tests::testRemoteControlKeepsOtherFiles());
+        ADD_TEST(_Tests::testThreadsafeSetParameterWithPollableExecutor());
+        ADD_TEST(_Tests::testPollableExecutorSignalsAgainAfterProcessing());
+#endif
     }
 
     if(gNumFailedTests > 0) {
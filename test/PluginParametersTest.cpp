@@ -24,12 +24,15 @@
  */
 
 #include <stdio.h>
+#include <limits>
 
 // Disable multi-threaded build, otherwise Parameter::setValue() is not directly
 // accessible without using a ConcurrentParameterSet. This symbol should be
 // defined before including PluginParameters.h.
 #define PLUGINPARAMETERS_MULTITHREADED 0
 #include "PluginParameters.h"
+#include "MappedBlobParameter.h"
+#include "PresetBank.h"
 #include "TestRunner.h"
 
 namespace teragon {
@@ -90,6 +93,17 @@ public:
     ParameterString value;
 };
 
+class UnclonableParameter : public BooleanParameter {
+public:
+    UnclonableParameter(const ParameterString &inName) : BooleanParameter(inName) {}
+
+    virtual ~UnclonableParameter() {}
+
+    virtual Parameter *clone() const {
+        return NULL;
+    }
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // Tests
 ////////////////////////////////////////////////////////////////////////////////
@@ -129,6 +143,78 @@ public:
         return true;
     }
 
+    static bool testUploadBlobParameterInChunks() {
+        BlobParameter p("test");
+        const char *data = "hello world";
+        ASSERT(p.beginUpload(strlen(data)));
+        ASSERT_SIZE_EQUALS((size_t)6, p.writeUpload(data, 6));
+        ASSERT_IS_NULL(p.getData());
+        ASSERT_SIZE_EQUALS((size_t)5, p.writeUpload(data + 6, 100));
+        ASSERT(p.commitUpload());
+        ASSERT_SIZE_EQUALS(strlen(data), p.getDataSize());
+        ASSERT(memcmp(data, p.getData(), strlen(data)) == 0);
+        ASSERT_FALSE(p.commitUpload());
+        return true;
+    }
+
+    static bool testIdenticalBlobsAreShared() {
+        unsigned char data[64];
+        memset(data, 0xab, sizeof(data));
+        const size_t numEntries = BlobStore::getNumEntries();
+        BlobParameter *p1 = new BlobParameter("first", data, sizeof(data));
+        BlobParameter *p2 = new BlobParameter("second");
+        p2->setValue(data, sizeof(data));
+        ASSERT(p1->getData() == p2->getData());
+        ASSERT_SIZE_EQUALS(numEntries + 1, BlobStore::getNumEntries());
+
+        // Setting the same contents again has no effect
+        TestCounterObserver l;
+        p1->addObserver(&l);
+        p1->setValue(data, sizeof(data));
+        ASSERT_INT_EQUALS(0, l.count);
+
+        // Changing one parameter does not affect the other
+        data[0] = 0;
+        p1->setValue(data, sizeof(data));
+        ASSERT_INT_EQUALS(1, l.count);
+        ASSERT_INT_EQUALS(0xab, (int)((unsigned char *)p2->getData())[0]);
+        ASSERT_SIZE_EQUALS(numEntries + 2, BlobStore::getNumEntries());
+
+        delete p1;
+        delete p2;
+        ASSERT_SIZE_EQUALS(numEntries, BlobStore::getNumEntries());
+        return true;
+    }
+
+    static bool testMapFileIntoBlobParameter() {
+        const char *path = "PluginParametersTestMapped.bin";
+        const char *data = "mapped contents";
+        FILE *file = fopen(path, "wb");
+        ASSERT_NOT_NULL(file);
+        fwrite(data, 1, strlen(data), file);
+        fclose(file);
+
+        MappedBlobParameter p("test");
+        ASSERT_STRING("(Null)", p.getDisplayText());
+        ASSERT_FALSE(p.mapFile("invalid/path.bin"));
+        ASSERT(p.mapFile(path, true));
+        ASSERT_SIZE_EQUALS(strlen(data), p.getDataSize());
+        ASSERT(memcmp(data, p.getData(), strlen(data)) == 0);
+        ASSERT_STRING(path, p.getDisplayText());
+        ASSERT(DataBuffer::computeHash(data, strlen(data)) == p.getContentHash());
+
+        MappedBlobParameter *clone = dynamic_cast<MappedBlobParameter *>(p.clone());
+        ASSERT_NOT_NULL(clone);
+        ASSERT(memcmp(data, clone->getData(), strlen(data)) == 0);
+        delete clone;
+        remove(path);
+#if !WIN32
+        // A clone must not silently lose the contents if the file is gone
+        ASSERT_IS_NULL(p.clone());
+#endif
+        return true;
+    }
+
     static bool testCreateBoolParameter() {
         BooleanParameter p("test");
         ASSERT_FALSE(p.getValue());
@@ -212,7 +298,12 @@ public:
         ASSERT_EQUALS(666.0, p.getValue());
         ASSERT_EQUALS(0.507481, p.getScaledValue());
         p.setScaledValue(0.75);
+#if PLUGINPARAMETERS_FLOAT_VALUES
+        // Single precision values are only accurate to about seven digits
+        ASSERT(fabs(3556.5588 - p.getValue()) < 0.005);
+#else
         ASSERT_EQUALS(3556.559, p.getValue());
+#endif
         ASSERT_EQUALS(0.75, p.getScaledValue());
         return true;
     }
@@ -262,6 +353,19 @@ public:
         return true;
     }
 
+    static bool testSmallDataBuffersAreRecycled() {
+        const char *data = "short string";
+        DataBuffer *buffer = DataBuffer::create(data, strlen(data));
+        ASSERT_STRING("short string", ParameterString(buffer->getData()));
+        const void *block = buffer;
+        DataBuffer::destroy(buffer);
+        ASSERT(DataBuffer::getNumPooledBlocks() > 0);
+        buffer = DataBuffer::create(data, strlen(data));
+        ASSERT(block == buffer);
+        DataBuffer::destroy(buffer);
+        return true;
+    }
+
     static bool testCreateVoidParameter() {
         VoidParameter *p = new VoidParameter("test");
         ASSERT_EQUALS(0.0, p->getValue());
@@ -346,6 +450,404 @@ public:
         return true;
     }
 
+    static bool testEmplaceParameterInSet() {
+        ParameterSet s;
+        ASSERT_NOT_NULL(s.add(new BooleanParameter("Parameter 1")));
+        FloatParameter *p = s.emplace<FloatParameter>("Parameter 2", 0.0, 50.0, 25.0);
+        ASSERT_NOT_NULL(p);
+        ASSERT_NOT_NULL(s.emplace<BooleanParameter>("Parameter 3", true));
+        ASSERT_NOT_NULL(s.emplace<VoidParameter>("Parameter 4"));
+        ASSERT_SIZE_EQUALS((size_t)4, s.size());
+        ASSERT(s.get(1) == p);
+        ASSERT_EQUALS(25.0, s.get("Parameter 2")->getValue());
+        ASSERT_EQUALS(50.0, p->getMaxValue());
+        ASSERT(s.get(2)->getValue());
+        return true;
+    }
+
+    static bool testEmplaceDuplicateParameterInSet() {
+        ParameterSet s;
+        ASSERT_NOT_NULL(s.emplace<BooleanParameter>("Parameter1"));
+        ASSERT_IS_NULL(s.emplace<BooleanParameter>("Parameter 1"));
+        ASSERT_SIZE_EQUALS(1ul, s.size());
+        return true;
+    }
+
+    static bool testClearEmplacedParameters() {
+        ParameterSet s;
+        // Enough parameters to require several chunks of memory
+        for(int i = 0; i < 2000; i++) {
+            char name[16];
+            snprintf(name, sizeof(name), "test%d", i);
+            ASSERT_NOT_NULL(s.emplace<FloatParameter>(name, 0.0, 1.0, 0.5));
+        }
+        ASSERT_SIZE_EQUALS((size_t)2000, s.size());
+        s.clear();
+        ASSERT_SIZE_EQUALS((size_t)0, s.size());
+        ASSERT_NOT_NULL(s.emplace<FloatParameter>("test0", 0.0, 1.0, 0.5));
+        ASSERT_SIZE_EQUALS((size_t)1, s.size());
+        return true;
+    }
+
+    static bool testGetValuesFromSet() {
+        ParameterSet s;
+        ASSERT_NOT_NULL(s.add(new FloatParameter("Parameter 1", 0.0, 10.0, 2.5)));
+        ASSERT_NOT_NULL(s.add(new BooleanParameter("Parameter 2", true)));
+        ASSERT_NOT_NULL(s.add(new IntegerParameter("Parameter 3", 0, 10, 7)));
+        ParameterValue values[3] = {0.0, 0.0, 0.0};
+        ASSERT_SIZE_EQUALS((size_t)2, s.getValues(values, 2));
+        ASSERT_EQUALS(2.5, values[0]);
+        ASSERT_EQUALS(1.0, values[1]);
+        ASSERT_EQUALS(0.0, values[2]);
+        ASSERT_SIZE_EQUALS((size_t)3, s.getValues(values, 3));
+        ASSERT_EQUALS(7.0, values[2]);
+        return true;
+    }
+
+    static bool testValidateParameterValues() {
+        ParameterSet s;
+        // Use enough parameters to require more than one SIMD vector
+        for(int i = 0; i < 11; i++) {
+            char name[16];
+            snprintf(name, sizeof(name), "test%d", i);
+            s.add(new FloatParameter(name, -1.0, 1.0, 0.5));
+        }
+        ParameterValidator validator(s);
+        ASSERT_SIZE_EQUALS((size_t)11, validator.getNumValues());
+
+        const ParameterValue infinity = std::numeric_limits<ParameterValue>::infinity();
+        ParameterValue values[12] = {0.25, 2.0, -3.0, std::numeric_limits<ParameterValue>::quiet_NaN(),
+                                     1.0, -1.0, infinity, 0.0, -infinity, 0.75, 100.0, 100.0};
+        std::vector<size_t> invalidIndices;
+        ASSERT_SIZE_EQUALS((size_t)6, validator.validate(values, 12, &invalidIndices));
+        ASSERT_SIZE_EQUALS((size_t)6, invalidIndices.size());
+        ASSERT_SIZE_EQUALS((size_t)1, invalidIndices[0]);
+        ASSERT_SIZE_EQUALS((size_t)10, invalidIndices[5]);
+        ASSERT_EQUALS(0.25, values[0]);
+        ASSERT_EQUALS(1.0, values[1]);
+        ASSERT_EQUALS(-1.0, values[2]);
+        ASSERT_EQUALS(0.5, values[3]);
+        ASSERT_EQUALS(1.0, values[4]);
+        ASSERT_EQUALS(0.5, values[6]);
+        ASSERT_EQUALS(0.5, values[8]);
+        ASSERT_EQUALS(1.0, values[10]);
+        // Values beyond the size of the set are not touched
+        ASSERT_EQUALS(100.0, values[11]);
+        ASSERT_SIZE_EQUALS((size_t)0, validator.validate(values, 12));
+        return true;
+    }
+
+    static bool testWriteAndReadJsonState() {
+        ParameterSet s;
+        s.add(new FloatParameter("Gain", -1.0, 1.0, 0.5));
+        s.add(new BooleanParameter("Bypass"));
+        s.add(new VoidParameter("Reset"));
+        s.add(new StringParameter("Label"));
+        s.add(new BlobParameter("Table"));
+        s.get("Gain")->setValue(-0.1);
+        s.get("Bypass")->setValue(true);
+        const char label[] = "say \"hi\"\n\\";
+        dynamic_cast<StringParameter *>(s.get("Label"))->setValue(label, strlen(label));
+        const char table[] = {'\0', '\xff', '\x7f', 'a', 'b'};
+        dynamic_cast<BlobParameter *>(s.get("Table"))->setValue(table, sizeof(table));
+
+        std::string state;
+        StringStateOutput output(state);
+        JsonStateWriter writer(output);
+        ASSERT(writer.write(s));
+        ASSERT_SIZE_EQUALS(state.size(), writer.getNumBytesWritten());
+        ASSERT(state.find("\"Bypass\":true") != std::string::npos);
+        ASSERT(state.find("Reset") == std::string::npos);
+        ASSERT(state.find("\"Table\":\"AP9/YWI=\"") != std::string::npos);
+
+        ParameterSet t;
+        t.add(new FloatParameter("Gain", -1.0, 1.0, 0.5));
+        t.add(new BooleanParameter("Bypass"));
+        t.add(new StringParameter("Label"));
+        t.add(new BlobParameter("Table"));
+        // Unknown keys and out of range values are tolerated
+        state.insert(1, "\"Removed\":{\"a\":[1,\"}\"]},");
+        MemoryStateInput input(state.data(), state.size());
+        JsonStateReader reader(input);
+        ASSERT(reader.read(t));
+        ASSERT_SIZE_EQUALS((size_t)4, reader.getNumValuesRead());
+        ASSERT_SIZE_EQUALS((size_t)1, reader.getNumUnknownKeys());
+        ASSERT_SIZE_EQUALS((size_t)0, reader.getNumInvalidValues());
+        ASSERT_EQUALS(-0.1, t.get("Gain")->getValue());
+        ASSERT(t.get("Bypass")->getValue());
+        ASSERT_STRING(label, t.get("Label")->getDisplayText());
+        BlobParameter *blob = dynamic_cast<BlobParameter *>(t.get("Table"));
+        ASSERT_SIZE_EQUALS(sizeof(table), blob->getDataSize());
+        ASSERT_INT_EQUALS(0, memcmp(table, blob->getData(), sizeof(table)));
+
+        const char clamped[] = "{ \"Gain\" : 3e2, \"Label\": \"\\u00e9\" }";
+        MemoryStateInput clampedInput(clamped, strlen(clamped));
+        JsonStateReader clampedReader(clampedInput);
+        ASSERT(clampedReader.read(t));
+        ASSERT_SIZE_EQUALS((size_t)1, clampedReader.getNumInvalidValues());
+        ASSERT_EQUALS(1.0, t.get("Gain")->getValue());
+        ASSERT_STRING("\xc3\xa9", t.get("Label")->getDisplayText());
+
+        const char truncated[] = "{\"Gain\":0.25,\"Bypass\"";
+        MemoryStateInput truncatedInput(truncated, strlen(truncated));
+        JsonStateReader truncatedReader(truncatedInput);
+        ASSERT_FALSE(truncatedReader.read(t));
+        ASSERT_EQUALS(0.25, t.get("Gain")->getValue());
+
+        const char surrogates[] = "{\"Label\":\"\\ud83d\\ude00\"}";
+        MemoryStateInput surrogatesInput(surrogates, strlen(surrogates));
+        JsonStateReader surrogatesReader(surrogatesInput);
+        ASSERT(surrogatesReader.read(t));
+        ASSERT_STRING("\xf0\x9f\x98\x80", t.get("Label")->getDisplayText());
+        // A high surrogate must be followed by a low surrogate
+        const char unpaired[] = "{\"Label\":\"\\ud800\\u0041\"}";
+        MemoryStateInput unpairedInput(unpaired, strlen(unpaired));
+        JsonStateReader unpairedReader(unpairedInput);
+        ASSERT_FALSE(unpairedReader.read(t));
+
+        // Numbers which are not finite are skipped, other spellings are invalid
+        const char overflow[] = "{\"Gain\":-1e999}";
+        MemoryStateInput overflowInput(overflow, strlen(overflow));
+        JsonStateReader overflowReader(overflowInput);
+        ASSERT(overflowReader.read(t));
+        ASSERT_SIZE_EQUALS((size_t)0, overflowReader.getNumValuesRead());
+        ASSERT_SIZE_EQUALS((size_t)1, overflowReader.getNumInvalidValues());
+        ASSERT_EQUALS(0.25, t.get("Gain")->getValue());
+        const char *invalidNumbers[] = {"-nan", "-inf", "0x1p-2", "-0x10", "01", "1.", "-.5", "1e", "-"};
+        for(size_t i = 0; i < sizeof(invalidNumbers) / sizeof(invalidNumbers[0]); i++) {
+            const std::string invalid = std::string("{\"Gain\":") + invalidNumbers[i] + "}";
+            MemoryStateInput invalidInput(invalid.data(), invalid.size());
+            JsonStateReader invalidReader(invalidInput);
+            ASSERT_FALSE(invalidReader.read(t));
+            ASSERT_EQUALS(0.25, t.get("Gain")->getValue());
+        }
+        return true;
+    }
+
+    static bool testReadMappedFileFromJsonState() {
+        const char *path = "PluginParametersTestState.bin";
+        const char *data = "mapped contents";
+        FILE *file = fopen(path, "wb");
+        ASSERT_NOT_NULL(file);
+        fwrite(data, 1, strlen(data), file);
+        fclose(file);
+
+        ParameterSet s;
+        MappedBlobParameter *p = new MappedBlobParameter("Sample");
+        s.add(p);
+        ASSERT(p->mapFile(path));
+        std::string state;
+        StringStateOutput output(state);
+        ASSERT(JsonStateWriter(output).write(s));
+
+        // Paths are only opened if the caller trusts the state
+        ParameterSet t;
+        MappedBlobParameter *q = new MappedBlobParameter("Sample");
+        t.add(q);
+        MemoryStateInput input(state.data(), state.size());
+        JsonStateReader reader(input);
+        ASSERT(reader.read(t));
+        ASSERT_SIZE_EQUALS((size_t)0, reader.getNumValuesRead());
+        ASSERT_SIZE_EQUALS((size_t)1, reader.getNumInvalidValues());
+        ASSERT_IS_NULL(q->getData());
+
+        MemoryStateInput trustedInput(state.data(), state.size());
+        JsonStateReader trustedReader(trustedInput, true);
+        ASSERT(trustedReader.read(t));
+        ASSERT_SIZE_EQUALS((size_t)1, trustedReader.getNumValuesRead());
+        ASSERT_SIZE_EQUALS(strlen(data), q->getDataSize());
+        ASSERT(memcmp(data, q->getData(), strlen(data)) == 0);
+        remove(path);
+        return true;
+    }
+
+    static bool testWriteAndLoadPresetBank() {
+        ParameterSet s;
+        s.add(new FloatParameter("Gain", 0.0, 1.0, 0.5));
+        s.add(new VoidParameter("Reset"));
+        s.add(new BlobParameter("Steps"));
+        PresetBankWriter writer(s);
+        ASSERT(writer.add("Default", s));
+        s.get("Gain")->setValue(0.25);
+        const std::string steps(1000, '\x01');
+        dynamic_cast<BlobParameter *>(s.get("Steps"))->setValue(steps.data(), steps.size());
+        ASSERT(writer.add("Quiet", s, true));
+        ParameterSet other;
+        other.add(new FloatParameter("Level", 0.0, 1.0, 0.5));
+        ASSERT_FALSE(writer.add("Other", other));
+        ASSERT_SIZE_EQUALS((size_t)2, writer.getNumPresets());
+
+        const char *path = "PluginParametersTestBank.bin";
+        FILE *file = fopen(path, "wb");
+        ASSERT_NOT_NULL(file);
+        FileStateOutput output(file);
+        ASSERT(writer.write(output));
+        fclose(file);
+        ASSERT_IS_NULL(PresetBank::open("invalid/path.bin"));
+
+        PresetBank *bank = PresetBank::open(path);
+        ASSERT_NOT_NULL(bank);
+        ASSERT_SIZE_EQUALS((size_t)2, bank->getNumPresets());
+        ASSERT_STRING("Default", bank->getPresetName(0));
+        ASSERT_STRING("Quiet", bank->getPresetName(1));
+        ASSERT_EQUALS(0.25, bank->getValues(1)[0]);
+        ASSERT(bank->isCompatible(s));
+        ASSERT_FALSE(bank->isCompatible(other));
+        ASSERT_FALSE(bank->load(0, other));
+
+        ASSERT(bank->load(0, s));
+        ASSERT_EQUALS(0.5, s.get("Gain")->getValue());
+        size_t numValuesLoaded = 0;
+        ASSERT(bank->load(1, s, NULL, &numValuesLoaded));
+        ASSERT_SIZE_EQUALS((size_t)2, numValuesLoaded);
+        ASSERT_EQUALS(0.25, s.get("Gain")->getValue());
+        BlobParameter *blob = dynamic_cast<BlobParameter *>(s.get("Steps"));
+        ASSERT_SIZE_EQUALS(steps.size(), blob->getDataSize());
+        ASSERT_INT_EQUALS(0, memcmp(steps.data(), blob->getData(), steps.size()));
+        delete bank;
+
+        // Values in a bank written by another program are validated when loaded
+        file = fopen(path, "r+b");
+        ASSERT_NOT_NULL(file);
+        std::string contents(4096, '\0');
+        contents.resize(fread(&contents[0], 1, contents.size(), file));
+        const ParameterValue quiet = 0.25;
+        const ParameterValue invalid = (ParameterValue)sqrt(-1.0);
+        const size_t offset = contents.find(std::string(reinterpret_cast<const char *>(&quiet), sizeof(quiet)));
+        ASSERT(offset != std::string::npos);
+        fseek(file, (long)offset, SEEK_SET);
+        fwrite(&invalid, sizeof(invalid), 1, file);
+        fclose(file);
+        bank = PresetBank::open(path);
+        ASSERT_NOT_NULL(bank);
+        s.get("Gain")->setValue(0.75);
+        ASSERT(bank->load(1, s));
+        // NaN would also pass ASSERT_EQUALS
+        ASSERT(s.get("Gain")->getValue() == 0.5);
+        delete bank;
+
+        // A corrupted record must not be applied partially
+        const uint32_t stepsSizes[2] = {16, (uint32_t)steps.size()};
+        const uint32_t corruptedSize = (uint32_t)steps.size() + 1;
+        const size_t sizesOffset = contents.find(std::string(reinterpret_cast<const char *>(stepsSizes),
+                                                             sizeof(stepsSizes)));
+        ASSERT(sizesOffset != std::string::npos);
+        file = fopen(path, "r+b");
+        ASSERT_NOT_NULL(file);
+        fseek(file, (long)(sizesOffset + sizeof(uint32_t)), SEEK_SET);
+        fwrite(&corruptedSize, sizeof(corruptedSize), 1, file);
+        fclose(file);
+        bank = PresetBank::open(path);
+        ASSERT_NOT_NULL(bank);
+        s.get("Gain")->setValue(0.75);
+        ASSERT_FALSE(bank->load(1, s, NULL, &numValuesLoaded));
+        ASSERT_SIZE_EQUALS((size_t)0, numValuesLoaded);
+        ASSERT_EQUALS(0.75, s.get("Gain")->getValue());
+        delete bank;
+
+        std::string encoded;
+        std::string decoded;
+        const char data[] = "abcccccccd";
+        PresetBank::encode(data, strlen(data), encoded);
+        ASSERT_SIZE_EQUALS((size_t)7, encoded.size());
+        ASSERT(PresetBank::decode(encoded.data(), encoded.size(), strlen(data), decoded));
+        ASSERT_STRING(data, decoded);
+        ASSERT_FALSE(PresetBank::decode(encoded.data(), encoded.size() - 1, strlen(data), decoded));
+        remove(path);
+        return true;
+    }
+
+    static bool testAddAllParametersToSet() {
+        ParameterSet s;
+        ASSERT_NOT_NULL(s.add(new FloatParameter("Parameter 1", 0.0, 1.0, 0.5)));
+        std::vector<Parameter *> parameters;
+        parameters.push_back(new FloatParameter("Parameter 2", 0.0, 1.0, 0.5));
+        Parameter *duplicate = new BooleanParameter("Parameter 1");
+        parameters.push_back(duplicate);
+        parameters.push_back(new IntegerParameter("Parameter 3", 0, 10, 7));
+        ASSERT_SIZE_EQUALS((size_t)2, s.addAll(parameters));
+        ASSERT_SIZE_EQUALS((size_t)3, s.size());
+        ASSERT_STRING("Parameter 3", s.get(2)->getName());
+        ASSERT_NOT_NULL(s.get("Parameter 2"));
+        // Duplicates are not owned by the set
+        ASSERT(s.get("Parameter 1") != duplicate);
+        delete duplicate;
+        return true;
+    }
+
+    static bool testCloneParameterSet() {
+        ParameterSet prototype;
+        Parameter *frequency = prototype.add(new FrequencyParameter("Cutoff", 20.0, 20000.0, 1000.0));
+        frequency->setDescription("Filter cutoff");
+        frequency->setValue(440.0);
+        prototype.add(new BooleanParameter("Bypass", false));
+        prototype.add(new StringParameter("Name", "Init"));
+        prototype.add(new IntegerParameter("Voices", 1, 16, 8));
+
+        ParameterSet s;
+        ASSERT_SIZE_EQUALS((size_t)4, s.cloneFrom(prototype));
+        ASSERT_SIZE_EQUALS((size_t)4, s.size());
+        for(size_t i = 0; i < s.size(); i++) {
+            ASSERT(s.get((int)i) != prototype.get((int)i));
+            ASSERT_STRING(prototype.get((int)i)->getName().c_str(), s.get((int)i)->getName());
+            ASSERT(s.get(prototype.get((int)i)->getName()) == s.get((int)i));
+        }
+        // Values are reset to the default, but metadata is shared
+        ASSERT_EQUALS(1000.0, s.get("Cutoff")->getValue());
+        ASSERT_STRING("Filter cutoff", s.get("Cutoff")->getDescription());
+        ASSERT(s.get("Cutoff")->getDescriptor() == frequency->getDescriptor());
+        ASSERT_STRING("Init", s.get("Name")->getDisplayText());
+        ASSERT_EQUALS(8.0, s.get("Voices")->getValue());
+
+        // Cloning into a set which is not empty skips duplicate names
+        ASSERT_SIZE_EQUALS((size_t)0, s.cloneFrom(prototype));
+        ASSERT_SIZE_EQUALS((size_t)4, s.size());
+        return true;
+    }
+
+    static bool testCloneParameterSetWithUnclonableParameter() {
+        ParameterSet prototype;
+        prototype.add(new BooleanParameter("Bypass", false));
+        prototype.add(new UnclonableParameter("Unclonable"));
+        prototype.add(new IntegerParameter("Voices", 1, 16, 8));
+
+        // Nothing is added, in either an empty set or one with other parameters
+        ParameterSet s;
+        ASSERT_SIZE_EQUALS((size_t)0, s.cloneFrom(prototype));
+        ASSERT_SIZE_EQUALS((size_t)0, s.size());
+        s.add(new BooleanParameter("Other", false));
+        ASSERT_SIZE_EQUALS((size_t)0, s.cloneFrom(prototype));
+        ASSERT_SIZE_EQUALS((size_t)1, s.size());
+        return true;
+    }
+
+    static bool testSmoothParameterValues() {
+        ParameterSet s;
+        // Use enough parameters to require more than one SIMD vector
+        for(int i = 0; i < 11; i++) {
+            char name[16];
+            snprintf(name, sizeof(name), "test%d", i);
+            ASSERT_NOT_NULL(s.add(new FloatParameter(name, 0.0, 100.0, (ParameterValue)i)));
+        }
+        ParameterSmoother smoother(s.size(), 0.5);
+        ASSERT_SIZE_EQUALS((size_t)11, smoother.getNumValues());
+        smoother.setTargets(s);
+        smoother.reset();
+        ASSERT_EQUALS(10.0, smoother.getValues()[10]);
+
+        s.get(0)->setValue(8.0);
+        s.get(10)->setValue(50.0);
+        smoother.setTargets(s);
+        smoother.process();
+        ASSERT_EQUALS(4.0, smoother.getValues()[0]);
+        ASSERT_EQUALS(5.0, smoother.getValues()[5]);
+        ASSERT_EQUALS(30.0, smoother.getValues()[10]);
+        smoother.process();
+        ASSERT_EQUALS(6.0, smoother.getValues()[0]);
+        ASSERT_EQUALS(40.0, smoother.getValues()[10]);
+        return true;
+    }
+
     static bool testGetParameterByName() {
         ParameterSet s;
         ASSERT_NOT_NULL(s.add(new BooleanParameter("Parameter 1")));
@@ -463,6 +965,44 @@ public:
         ASSERT_STRING("hello, world!", p.getDescription());
         return true;
     }
+
+    static bool testIdenticalParametersShareDescriptor() {
+        const size_t numDescriptors = ParameterDescriptor::getNumDescriptors();
+        FloatParameter *p1 = new FloatParameter("test", 0.0, 1.0, 0.5);
+        FloatParameter *p2 = new FloatParameter("test", 0.0, 1.0, 0.5);
+        ASSERT(p1->getDescriptor() == p2->getDescriptor());
+        ASSERT_SIZE_EQUALS(numDescriptors + 1, ParameterDescriptor::getNumDescriptors());
+
+        // Changing the metadata of one parameter must not affect the other
+        p2->setUnit("foo");
+        ASSERT(p1->getDescriptor() != p2->getDescriptor());
+        ASSERT_STRING("", p1->getUnit());
+        ASSERT_STRING("foo", p2->getUnit());
+        ASSERT_STRING("test", p2->getName());
+        ASSERT_EQUALS(0.5, p2->getDefaultValue());
+        ASSERT_SIZE_EQUALS(numDescriptors + 2, ParameterDescriptor::getNumDescriptors());
+
+        delete p1;
+        delete p2;
+        ASSERT_SIZE_EQUALS(numDescriptors, ParameterDescriptor::getNumDescriptors());
+        return true;
+    }
+
+    static bool testParametersWithNaNShareDescriptor() {
+        const size_t numDescriptors = ParameterDescriptor::getNumDescriptors();
+        const ParameterValue nan = std::numeric_limits<ParameterValue>::quiet_NaN();
+        FloatParameter *p1 = new FloatParameter("test", 0.0, 1.0, nan);
+        FloatParameter *p2 = new FloatParameter("test", 0.0, 1.0, nan);
+        FloatParameter *p3 = new FloatParameter("test", 0.0, 1.0, 0.5);
+        ASSERT(p1->getDescriptor() == p2->getDescriptor());
+        ASSERT(p1->getDescriptor() != p3->getDescriptor());
+        ASSERT_SIZE_EQUALS(numDescriptors + 2, ParameterDescriptor::getNumDescriptors());
+        delete p1;
+        delete p2;
+        delete p3;
+        ASSERT_SIZE_EQUALS(numDescriptors, ParameterDescriptor::getNumDescriptors());
+        return true;
+    }
 };
 
 } // namespace teragon
@@ -478,6 +1018,9 @@ int main(int argc, char *argv[]) {
 
     ADD_TEST(_Tests::testCreateBlobParameter());
     ADD_TEST(_Tests::testSetBlobParameter());
+    ADD_TEST(_Tests::testUploadBlobParameterInChunks());
+    ADD_TEST(_Tests::testIdenticalBlobsAreShared());
+    ADD_TEST(_Tests::testMapFileIntoBlobParameter());
 
     ADD_TEST(_Tests::testCreateBoolParameter());
     ADD_TEST(_Tests::testSetBoolParameter());
@@ -498,6 +1041,7 @@ int main(int argc, char *argv[]) {
     ADD_TEST(_Tests::testCreateStringParameter());
     ADD_TEST(_Tests::testSetStringParameter());
     ADD_TEST(_Tests::testSetStringParameterWithListener());
+    ADD_TEST(_Tests::testSmallDataBuffersAreRecycled());
 
     ADD_TEST(_Tests::testCreateVoidParameter());
 
@@ -511,6 +1055,18 @@ int main(int argc, char *argv[]) {
     ADD_TEST(_Tests::testAddDuplicateSafeNameParameterToSet());
 
     ADD_TEST(_Tests::testClearParameterSet());
+    ADD_TEST(_Tests::testEmplaceParameterInSet());
+    ADD_TEST(_Tests::testEmplaceDuplicateParameterInSet());
+    ADD_TEST(_Tests::testClearEmplacedParameters());
+    ADD_TEST(_Tests::testGetValuesFromSet());
+    ADD_TEST(_Tests::testValidateParameterValues());
+    ADD_TEST(_Tests::testWriteAndReadJsonState());
+    ADD_TEST(_Tests::testReadMappedFileFromJsonState());
+    ADD_TEST(_Tests::testWriteAndLoadPresetBank());
+    ADD_TEST(_Tests::testAddAllParametersToSet());
+    ADD_TEST(_Tests::testCloneParameterSet());
+    ADD_TEST(_Tests::testCloneParameterSetWithUnclonableParameter());
+    ADD_TEST(_Tests::testSmoothParameterValues());
     ADD_TEST(_Tests::testGetParameterByName());
     ADD_TEST(_Tests::testGetParameterByIndex());
     ADD_TEST(_Tests::testGetParameterByNameOperator());
@@ -527,6 +1083,8 @@ int main(int argc, char *argv[]) {
     ADD_TEST(_Tests::testSetParameterUnit());
     ADD_TEST(_Tests::testSetPrecision());
     ADD_TEST(_Tests::testSetParameterDescription());
+    ADD_TEST(_Tests::testIdenticalParametersShareDescriptor());
+    ADD_TEST(_Tests::testParametersWithNaNShareDescriptor());
 
     if(gNumFailedTests > 0) {
         printf("\nFAILED %d tests\n", gNumFailedTests);
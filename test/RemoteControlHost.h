@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2013 Teragon Audio. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * - Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ * - Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __PluginParameters_RemoteControlHost_h__
+#define __PluginParameters_RemoteControlHost_h__
+
+#include "RemoteControlServer.h"
+
+namespace teragon {
+
+#if PLUGINPARAMETERS_MULTITHREADED && !WIN32
+/**
+ * Runs a RemoteControlServer on its own thread for tests and benchmarks, with
+ * the client on the main thread.
+ */
+class RemoteControlHost {
+public:
+    RemoteControlHost(ConcurrentParameterSet *inParameters, RemoteControlServer *inServer) :
+    parameters(inParameters), server(inServer), done(false) {}
+
+    ConcurrentParameterSet *parameters;
+    RemoteControlServer *server;
+    std::atomic<bool> done;
+};
+
+// Acts as the GUI thread, which is the only thread changing parameters
+static void remoteControlCallback(void *arg) {
+    RemoteControlHost *host = reinterpret_cast<RemoteControlHost *>(arg);
+    while(!host->done.load()) {
+        host->server->process(1);
+        host->parameters->processRealtimeEvents();
+        host->parameters->processAsyncEvents();
+    }
+}
+#endif // PLUGINPARAMETERS_MULTITHREADED && !WIN32
+
+} // namespace teragon
+
+#endif // __PluginParameters_RemoteControlHost_h__
@@ -47,11 +47,11 @@ static int gNumFailedTests = 0;
 }
 
 #define ASSERT(result) { \
-  if(!result) { printf("%s was false. ", TOSTRING(result)); return false; } \
+  if(!(result)) { printf("%s was false. ", TOSTRING(result)); return false; } \
 }
 
 #define ASSERT_FALSE(result) { \
-  if(result) { printf("%s was true. ", TOSTRING(result)); return false; } \
+  if((result)) { printf("%s was true. ", TOSTRING(result)); return false; } \
 }
 
 #define ASSERT_IS_NULL(result) { \